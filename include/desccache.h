@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef DESC_CACHE_H
+#define DESC_CACHE_H
+
+#include <stdint.h>
+#include <libusb.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define CACHE_MAX_AGE_DAYS	90
+
+/*
+ * GET_DESCRIPTOR answers kept on disk across runs. Devices are keyed by
+ * devpath, vid:pid, bcdDevice and serial number, and an entry is only
+ * trusted while the hash of the sysfs "descriptors" attribute (read by
+ * the kernel at enumeration, no bus traffic) is unchanged. Requests
+ * other than GET_DESCRIPTOR always go to the device. Devices not seen
+ * for CACHE_MAX_AGE_DAYS are dropped.
+ *
+ * Optional requests a device model stalls or lets time out are also
+ * remembered, per vid:pid:bcdDevice, and fail at once afterwards until
+ * the model is re-probed.
+ */
+class DescriptorCache {
+public:
+	/* a descriptor as it was read from a device */
+	struct Descriptor {
+		uint8_t requesttype;
+		uint16_t value;		/* type << 8 | index */
+		uint16_t index;		/* language, interface... */
+		vector<unsigned char> data;
+	};
+
+private:
+	struct Entry {
+		uint8_t requesttype;
+		uint16_t value;
+		uint16_t index;
+		bool complete;		/* shorter than asked for: all there is */
+		vector<unsigned char> data;
+	};
+
+	struct Device {
+		uint64_t stamp;
+		uint64_t seen;		/* time of the last Attach(), to the day */
+		vector<Entry> entries;
+
+		Device() : stamp(0), seen(0) {}
+	};
+
+	/* an optional request that failed */
+	struct Failure {
+		uint8_t requesttype;
+		uint8_t request;
+		uint16_t value;
+		uint16_t index;
+		int32_t error;		/* LIBUSB_ERROR_PIPE or _TIMEOUT */
+	};
+
+	struct Handle {
+		string device;		/* key in devices_, empty if not cached */
+		string model;		/* key in failures_ */
+	};
+
+	map<string, Device> devices_;
+	map<string, vector<Failure> > failures_;
+	map<libusb_device_handle *, Handle> handles_;
+	string path_;
+	bool enabled_;
+	bool reprobe_;		/* ignore the failures read from disk */
+	bool dirty_;
+
+	Entry *find(Device &dev, uint8_t requesttype, uint16_t value,
+			uint16_t index);
+	const Failure *find_failure(const string &model, uint8_t requesttype,
+			uint8_t request, uint16_t value, uint16_t index);
+	int parse(const unsigned char *buf, size_t size);
+	void prune();
+
+public:
+	DescriptorCache();
+
+	static DescriptorCache &Get();
+
+	void setEnabled(bool enabled) { enabled_ = enabled; }
+	void setReprobe(bool reprobe) { reprobe_ = reprobe; }
+	int Load();
+	int Save();
+	/* forget the failed requests of every model */
+	void ClearFailures();
+	/* forget what is known of a device and of its model */
+	void Forget(libusb_device_handle *handle);
+	/* drop a handle about to be closed, keeping what is known */
+	void Detach(libusb_device_handle *handle);
+	void getDescriptors(libusb_device_handle *handle,
+			vector<Descriptor> &descs);
+	void Attach(libusb_device_handle *handle, const string &sysfs_name,
+			const struct libusb_device_descriptor &desc);
+	int Control(libusb_device_handle *handle, uint8_t requesttype,
+			uint8_t request, uint16_t value, uint16_t index,
+			unsigned char *data, uint16_t size, unsigned int timeout);
+};
+
+#endif
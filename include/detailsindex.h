@@ -0,0 +1,66 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef DETAILS_INDEX_H
+#define DETAILS_INDEX_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* a details line matching a search */
+struct SearchMatch {
+	unsigned int device;
+	unsigned int line;
+};
+
+/*
+ * Inverted index over the details of every device: each suffix of each
+ * lower case alphanumeric token maps to the devices whose details
+ * contain it. A search takes the devices having, for each token of the
+ * query, a suffix starting with it, that is a token containing it ("ncm"
+ * finds "cdcncm", "1234" finds "0x1234"), and only scans the lines of
+ * those for the query.
+ * Devices are indexed again each time their details are read and
+ * removed when they go away.
+ */
+class DetailsIndex {
+	struct Doc {
+		bool indexed;
+		vector<string> lines;		/* lower case */
+		vector<string> tokens;
+	};
+
+	vector<Doc> docs_;
+	map<string, set<unsigned int> > postings_;
+
+	static void tokenize(const string &text, vector<string> &tokens);
+	void candidates(const string &token, set<unsigned int> &docs);
+
+public:
+	void Resize(unsigned int count);
+	bool IsIndexed(unsigned int device);
+	void Add(unsigned int device, const vector<string> &lines);
+	void Remove(unsigned int device);
+	/* device i becomes what was device from[i], or is new if from[i] < 0 */
+	void Remap(const vector<int> &from);
+	void Search(const string &query, vector<SearchMatch> &matches);
+};
+
+#endif
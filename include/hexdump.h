@@ -0,0 +1,36 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef HEX_DUMP_H
+#define HEX_DUMP_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* appends " xx" for each byte of buf */
+void hex_append(string &out, const unsigned char *buf, size_t len);
+
+/*
+ * buf as lines of width bytes, each starting with indent and the offset
+ * of its first byte.
+ */
+void hex_dump(vector<string> &lines, const char *indent,
+		const unsigned char *buf, size_t len, unsigned int width);
+
+#endif
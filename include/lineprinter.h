@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef LINE_PRINTER_H
+#define LINE_PRINTER_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * printf() style output into a list of lines. Text is split on '\n' and
+ * an unterminated line is completed by the next Print(), so the lsusb
+ * derived decoders can keep building a line out of several calls.
+ */
+class LinePrinter {
+	vector<string> &lines_;
+	string partial_;
+
+public:
+	LinePrinter(vector<string> &lines) : lines_(lines) {}
+	~LinePrinter() { Flush(); }
+
+	void Print(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+	/* " xx" for each byte, then ends the line */
+	void Bytes(const unsigned char *buf, unsigned int len);
+	/* the bytes of buf beyond len, if its bLength says there are any */
+	void Junk(const unsigned char *buf, const char *indent, unsigned int len);
+	/* warns and shows the bytes instead if bLength is below len */
+	bool TooShort(const unsigned char *buf, const char *indent, unsigned int len);
+	void Flush();
+};
+
+#endif
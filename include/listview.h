@@ -33,6 +33,7 @@ class ListView {
 	WINDOW* win_;
 	std::string	name_;
 	std::vector<std::string> listItems_;
+	std::vector<bool> highlights_;
 
 	int current_index_;
 	int win_height_;
@@ -63,7 +64,12 @@ public:
 	~ListView();
 	
 	void SetItems(std::vector<std::string> items);
+	void SetItem(unsigned int index, const std::string &item);
+	/* items shown in bold, indexed like the items */
+	void SetHighlights(std::vector<bool> highlights) { highlights_ = highlights; }
+	void SetHighlight(unsigned int index, bool highlight);
 	int getCurrentIndex(void) { return current_index_;}
+	void SetCurrentIndex(int index);
 	
 	void Refresh();
 	void CursorDown();
@@ -19,8 +19,11 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <thread>
+#include <atomic>
 #include <listview.h>
 #include <usbcontext.h>
+#include <usbsnapshot.h>
 
 using namespace std;
 
@@ -33,6 +36,24 @@ const int STATUS_LINE_COLOR_PAIR	= 3;
 #define UNFOCUSED_FG_COLOR		COLOR_BLACK
 #define UNFOCUSED_BG_COLOR		COLOR_WHITE
 
+// Details of the selected device are only fetched once the cursor has
+// rested this long, so that key repeat never waits for a slow device
+#define DETAILS_DEBOUNCE_MS		150
+// How often the event loop looks for the details being read
+#define DETAILS_POLL_MS			20
+
+// What the right pane currently shows
+enum DetailsView {
+	DETAILS_DEVICE,
+	DETAILS_BANDWIDTH,
+	DETAILS_TRAFFIC,
+	DETAILS_PORTS,
+	DETAILS_RAW,
+};
+
+// monotonic clock, for the startup timing
+long now_ms();
+
 class mainview {
 	int mCursor;
 	//vector<string> mLines;
@@ -46,6 +67,42 @@ class mainview {
 	UsbContext *m_usb_ctx;
 
 	int m_devices_idx;
+	DetailsView m_details_view;
+	bool m_details_pending;		// cursor moved, details not fetched yet
+	long m_details_due_ms;
+	unsigned int m_list_filled;	// devices whose summary is shown
+
+	// details are read by a worker thread; while it runs the context
+	// is its own, and the event loop only moves the cursor
+	std::thread m_details_thread;
+	std::atomic<bool> m_details_ready;
+	bool m_details_busy;
+	int m_details_device;		// device being read
+	int m_details_line;		// line to select once shown, -1 if none
+	std::vector<std::string> m_details;
+
+	// the device list rows: all devices, or those matching the filter
+	std::vector<std::string> m_lines;
+	std::vector<bool> m_alerts;
+	std::vector<int> m_visible;	// row -> device index
+	std::string m_filter;
+
+	std::string m_search;		// last '/' query
+	std::vector<SearchMatch> m_matches;
+	int m_match;			// current match, -1 if none
+	std::string m_message;		// shown in the status line
+
+	// history mode: the snapshot shown instead of the live devices
+	SnapshotReader *m_history;
+	Snapshot m_snapshot;
+
+	// startup milestones, in ms since m_start_ms, printed with -t
+	bool m_timing;
+	long m_start_ms;
+	long m_enumerated_ms;
+	long m_first_frame_ms;
+	long m_list_done_ms;
+	long m_details_done_ms;
 
 private:
 	void show();
@@ -56,9 +113,38 @@ private:
 	void showHeaderBar();
 	void showStatusLine();
 	void toggle_panes();
+	void show_bandwidth();
+	void toggle_traffic();
+	void show_traffic();
+	void show_device_info();
+	void read_device_info();
+	void finish_device_info();
+	void show_raw();
+	void toggle_raw();
+	void schedule_device_info();
+	void fill_next_device();
+	void print_timing();
+	int drain_keys(int ch);
+	void toggle_hub_watch();
+	void show_hub_watch();
+	void reprobe_device();
+	bool prompt(const char *label, std::string &text);
+	void search();
+	void goto_match(int step);
+	int selected_device();
+	int device_row(int device);
+	void filter();
+	void show_error(const char *what, int err, const char *hint);
+	void history();
+	void show_snapshot();
+	void show_snapshot_device();
+	void goto_time();
 
 public:
 	mainview();
 	~mainview();
 	void show(UsbContext *ctx);
+	void setTiming(long start_ms, long enumerated_ms);
+	// scrubs through a snapshot log, starting at time
+	void showHistory(SnapshotReader *reader, int64_t time);
 };
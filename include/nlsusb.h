@@ -0,0 +1,149 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef NLSUSB_H
+#define NLSUSB_H
+
+/*
+ * libnlsusb: the device list, descriptors and details of nlsusb for C
+ * programs (and anything with a C FFI), without the viewer.
+ *
+ *	nlsusb_context *ctx;
+ *
+ *	if (nlsusb_init(&ctx) < 0)
+ *		return;
+ *	for (int i = 0; i < nlsusb_device_count(ctx); i++) {
+ *		struct nlsusb_device_info info = { sizeof(info) };
+ *
+ *		nlsusb_device_get_info(nlsusb_get_device(ctx, i), &info);
+ *		...
+ *	}
+ *	nlsusb_exit(ctx);
+ *
+ * Functions returning int give a negative libusb error code on failure.
+ * Device pointers stay valid until nlsusb_handle_events() reports that
+ * the device list changed, or nlsusb_exit().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NLSUSB_API	__attribute__((visibility("default")))
+
+typedef struct nlsusb_context nlsusb_context;
+typedef struct nlsusb_device nlsusb_device;
+
+/* same values as enum libusb_speed */
+enum nlsusb_speed {
+	NLSUSB_SPEED_UNKNOWN = 0,
+	NLSUSB_SPEED_LOW = 1,
+	NLSUSB_SPEED_FULL = 2,
+	NLSUSB_SPEED_HIGH = 3,
+	NLSUSB_SPEED_SUPER = 4,
+	NLSUSB_SPEED_SUPER_PLUS = 5,
+};
+
+/*
+ * The caller sets size to sizeof(struct nlsusb_device_info); fields
+ * are only ever added at the end, and a library newer than the caller
+ * fills the ones the caller knows about.
+ */
+struct nlsusb_device_info {
+	size_t size;
+	uint8_t bus;
+	uint8_t address;
+	uint16_t vendor_id;
+	uint16_t product_id;
+	uint16_t bcd_usb;
+	uint16_t bcd_device;
+	uint8_t device_class;
+	uint8_t device_subclass;
+	uint8_t device_protocol;
+	int speed;			/* enum nlsusb_speed */
+	int capable_speed;		/* highest it supports, or -1 */
+	int alert;			/* below its speed, or UAS unused */
+	char path[32];			/* sysfs name: "usb1", "1-2.3" */
+	char vendor_name[128];		/* from usb.ids */
+	char product_name[128];
+};
+
+struct nlsusb_endpoint {
+	uint8_t address;
+	uint8_t attributes;
+	uint16_t max_packet_size;
+	uint8_t interval;
+};
+
+struct nlsusb_interface {
+	uint8_t number;
+	uint8_t alt_setting;
+	uint8_t interface_class;
+	uint8_t interface_subclass;
+	uint8_t interface_protocol;
+	uint8_t num_endpoints;
+	const struct nlsusb_endpoint *endpoints;
+};
+
+/* the active configuration, with every altsetting of every interface */
+struct nlsusb_config {
+	uint8_t value;
+	uint8_t attributes;
+	uint16_t max_power_ma;
+	int num_interfaces;
+	const struct nlsusb_interface *interfaces;
+};
+
+NLSUSB_API int nlsusb_init(nlsusb_context **ctx);
+NLSUSB_API void nlsusb_exit(nlsusb_context *ctx);
+
+NLSUSB_API int nlsusb_device_count(nlsusb_context *ctx);
+NLSUSB_API nlsusb_device *nlsusb_get_device(nlsusb_context *ctx, int index);
+/* indexes of the devices matching a filter expression as nlsusb's 'f' */
+NLSUSB_API int nlsusb_filter(nlsusb_context *ctx, const char *expression,
+		int *indexes, int max);
+
+NLSUSB_API int nlsusb_device_get_info(nlsusb_device *dev,
+		struct nlsusb_device_info *info);
+NLSUSB_API int nlsusb_device_get_config(nlsusb_device *dev,
+		struct nlsusb_config **config);
+NLSUSB_API void nlsusb_free_config(struct nlsusb_config *config);
+/* string descriptor index, as UTF-8; returns its length */
+NLSUSB_API int nlsusb_device_get_string(nlsusb_device *dev, uint8_t index,
+		char *buf, size_t size);
+/* the details pane as text, one line per '\n', freed with free() */
+NLSUSB_API int nlsusb_device_get_details(nlsusb_device *dev, char **text);
+
+/*
+ * Hotplug: the callback is run from nlsusb_handle_events() once the
+ * device list has been updated. nlsusb_handle_events() waits up to
+ * timeout_ms for events and returns 1 if the list changed.
+ */
+typedef void (*nlsusb_hotplug_cb)(nlsusb_context *ctx, void *user_data);
+
+NLSUSB_API int nlsusb_set_hotplug_callback(nlsusb_context *ctx,
+		nlsusb_hotplug_cb cb, void *user_data);
+NLSUSB_API int nlsusb_handle_events(nlsusb_context *ctx, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
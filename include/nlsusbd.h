@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef NLSUSBD_H
+#define NLSUSBD_H
+
+#include <stdlib.h>
+#include <string>
+
+using namespace std;
+
+/*
+ * nlsusbd keeps the devices enumerated, opened and probed, follows
+ * hotplug events, and answers on a Unix stream socket. A request is one
+ * line of text:
+ *
+ *	list			every device
+ *	details INDEX|PATH	the details pane of one device
+ *	query EXPRESSION	the devices matching a filter expression
+ *
+ * and its answer is one JSON object per line (NDJSON), ended by an
+ * empty line, so a client can send requests one after another on the
+ * same connection. Errors are answered as {"error":"..."}.
+ *
+ * list and query give, for each device:
+ *
+ *	{"index":0,"path":"1-2","bus":1,"device":3,"vid":"0bda",
+ *	 "pid":"8153","speed":"5G","alert":false,"summary":"..."}
+ *
+ * and details gives {"index":0,"path":"1-2","lines":["...",...]}.
+ */
+
+#define NLSUSBD_MAX_REQUEST	4096
+
+/* $XDG_RUNTIME_DIR/nlsusbd.sock, or /run/nlsusbd.sock for root */
+inline string nlsusbd_socket_path()
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	return string(dir && *dir ? dir : "/run") + "/nlsusbd.sock";
+}
+
+#endif
@@ -0,0 +1,100 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef USB_BANDWIDTH_H
+#define USB_BANDWIDTH_H
+
+#include "usbdevice.h"
+#include <map>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+/*
+ * Periodic (interrupt and isochronous) bandwidth reserved by the active
+ * configuration and altsettings of every device, aggregated per
+ * scheduling domain: a high speed or SuperSpeed bus, a full speed bus
+ * or root port, or a hub transaction translator (TT).
+ *
+ * Reservations are expressed in nanoseconds of bus time per (micro)frame,
+ * using the same per-transaction cost the Linux host controller drivers
+ * use, averaged over each endpoint's service interval.
+ */
+class UsbBandwidth {
+public:
+	/* the UVC modes of a camera and the bus time each would reserve */
+	struct VideoDevice {
+		string label;
+		unsigned long current_ns;
+		vector<VideoMode> modes;
+		vector<unsigned long> mode_ns;
+	};
+
+	/* bus time an audio device reserves now, and with every streaming
+	 * interface at its largest altsetting */
+	struct AudioDevice {
+		string label;
+		unsigned long current_ns;
+		unsigned long max_ns;
+	};
+
+private:
+	struct Endpoint {
+		PeriodicEndpoint ep;
+		unsigned long ns;	/* bus time per domain period */
+	};
+
+	struct Member {
+		int device_index;
+		string label;
+		unsigned long ns;
+		vector<Endpoint> endpoints;
+	};
+
+	struct Domain {
+		string name;
+		unsigned long period_ns;
+		unsigned long budget_ns;
+		unsigned long used_ns;
+		vector<Member> members;
+		vector<VideoDevice> video;
+		vector<AudioDevice> audio;
+	};
+
+	vector<Domain> domains_;
+	map<string, int> domain_ids_;
+
+	/* per device index: domain id (or -1) and reserved bus time */
+	vector<int> device_domain_;
+	vector<unsigned long> device_ns_;
+
+	int getDomain(const string &name, int speed);
+	int findDomain(vector<UsbDevice> &devices,
+			const map<string, int> &by_name, unsigned int index);
+	void getVideoBreakdown(const Domain &d, vector<string> &info);
+	void getAudioBreakdown(const Domain &d, vector<string> &info);
+	static bool memberCmp(const Member &a, const Member &b);
+
+public:
+	void Compute(vector<UsbDevice> &devices);
+
+	string getDeviceBar(int device_index);
+	void getBreakdown(vector<string> &info);
+};
+
+#endif
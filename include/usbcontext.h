@@ -19,6 +19,11 @@
 #define USB_CONTEXT_H
 
 #include "usbdevice.h"
+#include "usbbandwidth.h"
+#include "usbmon.h"
+#include "detailsindex.h"
+#include "usbquery.h"
+#include "usbselector.h"
 #include <list>
 #include <vector>
 #include <libusb.h>
@@ -28,6 +33,19 @@ using namespace std;
 class UsbContext {
 	vector<UsbDevice> usb_devices_;
 	libusb_context *ctx_;
+	UsbBandwidth bandwidth_;
+	UsbMonitor monitor_;
+	string monitor_source_;
+	unsigned int hex_width_;	/* bytes per line of the raw view */
+	DetailsIndex index_;
+	UsbSelector selector_;		/* devices to open, all if empty */
+	libusb_hotplug_callback_handle hotplug_;
+	bool hotplug_pending_;		/* devices came or went since Rescan() */
+
+	static int LIBUSB_CALL hotplug_cb(libusb_context *ctx,
+			libusb_device *dev, libusb_hotplug_event event,
+			void *user_data);
+	void add_device(libusb_device *dev);
 
 public:
 	UsbContext();
@@ -35,7 +53,47 @@ public:
 	int Init();
 	void Clean();
 	void getUsbDevicesList(vector<string> &list);
+	void getUsbDevicesAlerts(vector<bool> &alerts);
+	/* the list one device at a time, starting from the brief lines */
+	unsigned int getUsbDevicesCount() { return usb_devices_.size(); }
+	void getUsbDevicesBriefList(vector<string> &list);
+	string getUsbDeviceSummary(int index);
+	bool getUsbDeviceAlert(int index);
 	void getUsbDeviceInfo(int usb_device_index, vector<string> &list);
+	void reprobeDevice(int index);
+	void searchDevices(const string &query, vector<SearchMatch> &matches);
+	/* indexes of the devices matching a UsbQuery expression, all if empty */
+	int filterDevices(const string &query, vector<int> &matching, string &error);
+	void getUsbDeviceRaw(int index, vector<string> &list) {
+		usb_devices_[index].getRawDescriptors(list, hex_width_);
+	}
+	void setHexWidth(unsigned int width) { hex_width_ = width; }
+	/* before Init(): only open and probe the selected devices */
+	void setSelector(const UsbSelector &selector) { selector_ = selector; }
+	UsbDevice &getUsbDevice(unsigned int index) { return usb_devices_[index]; }
+
+	/*
+	 * Keeping the device list current: once startHotplug() succeeded,
+	 * pollHotplug() handles the pending libusb events and calls
+	 * Rescan() when devices were plugged or unplugged.
+	 */
+	int startHotplug();
+	int pollHotplug(int timeout_ms);
+	int Rescan();
+	void getBandwidthInfo(vector<string> &list);
+
+	void setMonitorSource(const string &source) { monitor_source_ = source; }
+	int startMonitor();
+	void stopMonitor();
+	bool isMonitoring() { return monitor_.IsOpen(); }
+	int pollMonitor();
+	void getTrafficInfo(vector<string> &list);
+	const UsbMonitor &getMonitor() { return monitor_; }
+
+	int toggleHubWatch(int index);
+	bool isWatchingHubs();
+	int pollHubWatch();
+	void getHubWatchInfo(int index, vector<string> &list);
 };
 
 #endif
\ No newline at end of file
@@ -21,17 +21,108 @@
 #include <iostream>
 #include <string>
 #include <libusb.h>
+#include <memory>
 #include <vector>
 #include "names.h"
+#include "usbmisc.h"
 
 #include "usb-spec.h"
 
 using namespace std;
 
+/* hub ports are numbered from 1, sysfs has no count without the hub */
+#define SYSFS_MAX_PORTS		31
+
+#define	HUB_STATUS_BYTELEN	3	/* max 3 bytes status = hub + 23 ports */
+
+class UsbMonitor;
+
+/*
+ * One interrupt or isochronous endpoint of the altsetting currently
+ * selected in the active configuration.
+ */
+struct PeriodicEndpoint {
+	uint8_t interface;
+	uint8_t altsetting;
+	uint8_t address;
+	uint8_t type;			/* LIBUSB_TRANSFER_TYPE_xxx */
+	unsigned int maxp;		/* bytes per transaction */
+	unsigned int packets;		/* transactions per service interval */
+	unsigned int bytes;		/* bytes per service interval */
+	unsigned int period_us;		/* service interval */
+};
+
+/*
+ * One format x frame size x frame interval combination of a UVC
+ * streaming interface, with the isochronous altsetting it needs.
+ */
+struct VideoMode {
+	uint8_t interface;
+	uint8_t format_index;
+	uint8_t frame_index;
+	char format[8];			/* FOURCC, or "MJPG" */
+	bool compressed;
+	unsigned int width;
+	unsigned int height;
+	uint32_t interval;		/* 100 ns units */
+	uint64_t bytes_per_sec;
+	unsigned int payload;		/* bytes per service interval of ep */
+	bool fits;
+	PeriodicEndpoint ep;		/* smallest fitting altsetting, or the largest */
+};
+
+/* a PCM altsetting of a UAC streaming interface */
+struct AudioAltsetting {
+	uint8_t protocol;		/* USB_AUDIO_CLASS_x */
+	unsigned int channels;
+	unsigned int subslot;		/* bytes per sample */
+	unsigned int bits;
+	vector<uint32_t> rates;
+	bool rates_assumed;		/* not in the descriptors (UAC2) */
+	PeriodicEndpoint ep;		/* data endpoint */
+
+	/* bytes per service interval of ep at a sample rate */
+	unsigned int getBytes(uint32_t rate) const;
+};
+
 class UsbDevice {
 
+	/* last GET_STATUS result of a hub downstream port */
+	struct HubPort {
+		bool valid;
+		int error;		/* errno of the last failed read */
+		unsigned char status[4];	/* wPortStatus, wPortChange */
+
+		HubPort() : valid(false), error(0) {}
+	};
+
+	enum PortWatchMode {
+		PORT_WATCH_NONE,
+		PORT_WATCH_INTERRUPT,	/* hub status change endpoint */
+		PORT_WATCH_SYSFS,	/* sysfs port state attributes */
+	};
+
+	/*
+	 * A running port watch. The status change transfer points here
+	 * rather than at the device, which is copied around by value: the
+	 * copies share one watch and all see it stopped.
+	 */
+	struct PortWatch {
+		PortWatchMode mode;
+		struct libusb_transfer *status_xfer;
+		unsigned char status_buf[HUB_STATUS_BYTELEN];
+		uint32_t changed_ports;		/* bit N: port N needs a re-read */
+		vector<int> port_state_fds;	/* indexed by port - 1, -1 if none */
+
+		PortWatch() : mode(PORT_WATCH_NONE), status_xfer(NULL),
+			changed_ports(0) {}
+	};
+
 	int bus_num_;
 	int device_addr_;
+	int speed_;
+	int capable_speed_;		/* -1 until known */
+	string sysfs_name_;
 	uint16_t id_vendor_;
 	uint16_t id_product_;
 	string product_name_;
@@ -40,19 +131,18 @@ class UsbDevice {
 	struct libusb_device_descriptor descriptor_;
 
 	libusb_device *usb_dev_;
+	const UsbMonitor *monitor_;
+	int cur_config_;		/* bConfigurationValue being dumped */
+	const struct libusb_endpoint_descriptor *cur_endpoint_;	/* ditto */
+
+	vector<HubPort> hub_ports_;
+	libusb_context *ctx_;
+	shared_ptr<PortWatch> watch_;	/* NULL until StartPortWatch() */
 
 private:
-	void dump_bytes(
-		const unsigned char *buf,
-		unsigned int len,
-		char **bytes_str,
-		unsigned int max_str_len);
-	void dump_junk(
-		const unsigned char *buf,
-		const char *indent,
-		unsigned int len,
-		char **junk_str,
-		unsigned int max_str_len);
+	void dump_bytes(const unsigned char *buf, unsigned int len, string &line);
+	void dump_junk(const unsigned char *buf, const char *indent,
+			unsigned int len, vector<string> &info);
 
 	void dump_device(vector<string> &desc_info);
 	int do_wireless(vector<string> &desc_info);
@@ -60,16 +150,89 @@ private:
 	void dump_config(struct libusb_config_descriptor *config, vector<string> &config_info);
 	void dump_interface(const struct libusb_interface *interface, vector<string> &intf_info);
 	void dump_altsetting(const struct libusb_interface_descriptor *interface, vector<string> &intf_info);
+	void dump_endpoint(const struct libusb_interface_descriptor *interface,
+			const struct libusb_endpoint_descriptor *endpoint,
+			vector<string> &ep_info);
+	void dump_ss_endpoint_companion(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &ep_info);
+	void dump_endpoint_latency(const struct libusb_endpoint_descriptor *endpoint,
+			vector<string> &ep_info);
 
-	void dump_dfu_interface(const unsigned char *buf, vector<string> &intf_info);
-	void dump_ccid_device(const unsigned char *buf, vector<string> &intf_info);
+	/*
+	 * Decoders for the class specific descriptors found in the extra
+	 * bytes of altsettings and endpoints, picked by (class, subclass,
+	 * descriptor type) in a single walk by dump_class_descriptors().
+	 */
+	typedef void (UsbDevice::*DescDecoder)(
+			const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf,
+			vector<string> &info);
+	struct ClassDispatch {
+		int cls;		/* bInterfaceClass, -1 for any */
+		int subclass;		/* bInterfaceSubClass, -1 for any */
+		int type;		/* bDescriptorType, -1 for any, 0 ends */
+		unsigned int min_len;	/* bytes the decoder relies on */
+		DescDecoder decode;	/* NULL when shown elsewhere */
+	};
+	static const ClassDispatch altsetting_dispatch_[];
+	static const ClassDispatch endpoint_dispatch_[];
+
+	void dump_class_descriptors(const ClassDispatch *table,
+			const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, int size, const char *indent,
+			vector<string> &info);
+
+	void dump_dfu_interface(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
+	void dump_ccid_device(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
+	void dump_comm_descriptor(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
+	void dump_audiocontrol_interface(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
+	void dump_audiostreaming_interface(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
+	void dump_audiostreaming_endpoint(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &ep_info);
+	void dump_midistreaming_interface(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
+	void dump_midistreaming_endpoint(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &ep_info);
+	void dump_videocontrol_interface(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
+	void dump_videostreaming_interface(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &intf_info);
 
 	void dump_hid_device(
 			    const struct libusb_interface_descriptor *interface,
 			    const unsigned char *buf,
 			    vector<string> &intf_info);
+	void dump_report_layout(const unsigned char *b, int l,
+			    const struct libusb_interface_descriptor *interface,
+			    vector<string> &intf_info);
+	unsigned int getEndpointPeriod(const struct libusb_endpoint_descriptor *ep);
+	int get_current_altsetting(uint8_t config_value, uint8_t interface_number);
+	void check_storage(const struct libusb_config_descriptor *config,
+			vector<string> *status, vector<string> *issues);
+	void dump_storage_info(vector<string> &info);
+	int get_bos_speed();
+	void dump_speed_info(vector<string> &info);
+	void get_periodic_endpoint(const struct libusb_interface_descriptor *alt,
+			const struct libusb_endpoint_descriptor *ep,
+			PeriodicEndpoint &pep);
+	void dump_video_bandwidth(vector<string> &info);
+	void dump_audio_bandwidth(vector<string> &info);
 
 	void do_hub(vector<string> &hub_info);
+	int get_hub_descriptor(unsigned char *buf, int size);
+	int read_port_status(int port);
+	void read_all_port_status();
+	void format_port_status(int port, const unsigned char *status,
+			char *port_status, size_t size);
+	void dump_port_status(vector<string> &hub_info);
+	int start_status_endpoint();
+	int start_sysfs_port_watch();
+	static void LIBUSB_CALL status_change_cb(struct libusb_transfer *transfer);
 	void dump_hub(const char *prefix, const unsigned char *p, vector<string> &hub_info);
 	void dump_bos_descriptor(vector<string> &bos_info);
 	void do_dualspeed(vector<string> &info);
@@ -81,33 +244,74 @@ private:
 	void dump_security(const unsigned char *buf, vector<string> &info);
 
 	void dump_encryption_type(const unsigned char *buf, vector<string> &info);
-	void dump_association(const unsigned char *buf, vector<string> &info);
+	void dump_association(const struct libusb_interface_descriptor *interface,
+			const unsigned char *buf, vector<string> &info);
 
 
 public:
 	UsbDevice(libusb_device *dev);
 	UsbDevice();
 	void FillDeviceInfo(libusb_device *dev);
+	void setMonitor(const UsbMonitor *monitor) { monitor_ = monitor; }
+	void setContext(libusb_context *ctx) { ctx_ = ctx; }
 	~UsbDevice();
 	
 	int getBusNumber() { return bus_num_; }
 	int getDeviceAddr() { return device_addr_; }
 	int getIdVendor() { return id_vendor_; }
 	int getIdProduct() { return id_product_; }
+	int getSpeed() { return speed_; }
+	int getDeviceClass() { return descriptor_.bDeviceClass; }
+	int getDeviceProtocol() { return descriptor_.bDeviceProtocol; }
+	string getSysfsName() { return sysfs_name_; }
+	bool isRootHub() { return sysfs_name_.compare(0, 3, "usb") == 0; }
 	string getProductName() { return product_name_; }
 	string getVendorName() { return vendor_name_; }
+	const struct libusb_device_descriptor &getDescriptor() { return descriptor_; }
+	libusb_device *getLibusbDevice() { return usb_dev_; }
+	/* a string descriptor, empty if there is none or it can't be read */
+	string getString(uint8_t index);
 
+	string getInfoBrief();
 	string getInfoSummary();
 	void getInfoDetails(vector<string> &info);
+	void getRawDescriptors(vector<string> &info, unsigned int width);
+	void getPeriodicEndpoints(vector<PeriodicEndpoint> &eps);
+	/* interface number -> selected altsetting, from sysfs */
+	void getCurrentAltsettings(vector<pair<int, int> > &alts);
+	void getVideoModes(vector<VideoMode> &modes);
+	void getAudioAltsettings(vector<AudioAltsetting> &alts);
+	static const char *getSpeedName(int speed);
+	int getCapableSpeed();
+	/* drops cached answers and failures, the next dump asks the device */
+	void Reprobe();
+	/* releases the device once it is gone, the object is not used after */
+	void Close();
+	bool getSpeedDowngrade(string &hop);
+	/* mass storage interfaces offering UAS but running bulk-only */
+	void getUasIssues(vector<string> &issues);
+
+	/*
+	 * Live hub port monitoring: after StartPortWatch(), PollPortWatch()
+	 * waits for port change notifications and re-reads the status of
+	 * the ports that changed only.
+	 */
+	int getActiveConfig();
+	bool isHub() { return descriptor_.bDeviceClass == LIBUSB_CLASS_HUB; }
+	bool isWatchingPorts() { return watch_ && watch_->mode != PORT_WATCH_NONE; }
+	int StartPortWatch();
+	void StopPortWatch();
+	int PollPortWatch(int timeout_ms);
+	void getPortWatchInfo(vector<string> &info);
 };
 
-// helper function
+// helper function, descriptor reads may be answered by the cache
 inline int typesafe_control_msg(libusb_device_handle *dev,
 	unsigned char requesttype, unsigned char request,
 	int value, int idx,
 	unsigned char *bytes, unsigned size, int timeout)
 {
-	int ret = libusb_control_transfer(dev, requesttype, request, value,
+	int ret = desc_cache_control(dev, requesttype, request, value,
 					idx, bytes, size, timeout);
 
 	return ret;
@@ -119,6 +323,7 @@ inline int typesafe_control_msg(libusb_device_handle *dev,
 #define le16_to_cpu(x) libusb_cpu_to_le16(libusb_cpu_to_le16(x))
 
 const char *get_guid(const unsigned char *buf);
+const unsigned char *find_ss_companion(const struct libusb_endpoint_descriptor *ep);
 unsigned int convert_le_u32 (const unsigned char *buf);
 unsigned int convert_le_u16 (const unsigned char *buf);
 
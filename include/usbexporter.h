@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef USB_EXPORTER_H
+#define USB_EXPORTER_H
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class UsbContext;
+class UsbDevice;
+
+/*
+ * Writes the device list as metrics in the Prometheus text format, for
+ * node_exporter's textfile collector. What can only change with a
+ * replug (identity, speeds, MaxPower, alerts) is read once per device
+ * and kept until it is unplugged; hub port states and usbmon counters
+ * are read from sysfs and memory at every write.
+ */
+class UsbExporter {
+	struct DeviceMetrics {
+		string sysfs_name;
+		int bus;
+		int addr;
+		string labels;		/* path="..." */
+		string info;		/* identity labels */
+		double speed;		/* bit/s, 0 if unknown */
+		double capable_speed;
+		int max_power;		/* mA, -1 if unknown */
+		bool alert;
+		bool hub;
+	};
+
+	string path_;
+	map<string, DeviceMetrics> devices_;	/* by path and address */
+
+	void update(UsbContext &ctx, vector<DeviceMetrics *> &list);
+	void write_ports(FILE *f, const vector<DeviceMetrics *> &list);
+	void write_traffic(FILE *f, const vector<DeviceMetrics *> &list,
+			UsbContext &ctx);
+
+public:
+	UsbExporter() {}
+	void setPath(const string &path) { path_ = path; }
+	bool IsEnabled() { return !path_.empty(); }
+	/* replaces the file at once, returns -errno on failure */
+	int Write(UsbContext &ctx);
+};
+
+#endif
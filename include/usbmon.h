@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef USB_MON_H
+#define USB_MON_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+/* usbmon transfer types, as found in struct mon_bin_hdr */
+#define USBMON_XFER_ISO		0
+#define USBMON_XFER_INTR	1
+#define USBMON_XFER_CTRL	2
+#define USBMON_XFER_BULK	3
+
+/* one usbmon event, decoded from any of the supported sources */
+struct UsbMonEvent {
+	uint64_t id;		/* URB tag, pairs submissions and callbacks */
+	char type;		/* 'S'ubmission, 'C'allback, 'E'rror */
+	uint8_t xfer_type;	/* USBMON_XFER_xxx */
+	uint8_t epnum;		/* endpoint number, bit 7 set for IN */
+	uint8_t devnum;
+	uint16_t busnum;
+	int32_t status;
+	uint32_t length;	/* requested (S) or actual (C) length */
+	uint64_t ts_us;
+};
+
+class UsbMonSource {
+public:
+	virtual ~UsbMonSource() {}
+	/* appends the available events, returns their count or < 0 */
+	virtual int Read(vector<UsbMonEvent> &events) = 0;
+	virtual string getName() = 0;
+};
+
+/* /dev/usbmonN, through the mmap()ed ring when the kernel allows it */
+class UsbMonBinSource : public UsbMonSource {
+	int fd_;
+	string path_;
+	unsigned char *ring_;
+	size_t ring_size_;
+	unsigned int nflush_;
+
+	int ReadRing(vector<UsbMonEvent> &events);
+	int ReadCopy(vector<UsbMonEvent> &events);
+
+public:
+	UsbMonBinSource();
+	~UsbMonBinSource();
+	int Open(const string &path);
+	int Read(vector<UsbMonEvent> &events);
+	string getName() { return path_; }
+};
+
+/* pcap capture (LINKTYPE_USB_LINUX[_MMAPPED]) or usbmon text log */
+class UsbMonFileSource : public UsbMonSource {
+	FILE *file_;
+	string path_;
+	bool pcap_;
+	bool swapped_;
+	unsigned int hdr_len_;
+
+	int ReadPcap(vector<UsbMonEvent> &events);
+	int ReadText(vector<UsbMonEvent> &events);
+
+public:
+	UsbMonFileSource();
+	~UsbMonFileSource();
+	int Open(const string &path);
+	int Read(vector<UsbMonEvent> &events);
+	string getName() { return path_; }
+};
+
+/*
+ * Log-linear (HDR style) histogram of latencies in microseconds: values
+ * below LATENCY_SUB_BUCKETS are exact, larger ones land in one of
+ * LATENCY_SUB_BUCKETS / 2 linear buckets per power of two, i.e. within
+ * about 6% of their true value. The fixed size keeps recording O(1) and
+ * memory bounded however long the monitor runs.
+ */
+#define LATENCY_SUB_BUCKET_BITS	5
+#define LATENCY_SUB_BUCKETS	(1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS		((32 - LATENCY_SUB_BUCKET_BITS + 2) * LATENCY_SUB_BUCKETS / 2)
+
+struct LatencyHistogram {
+	uint32_t counts[LATENCY_BUCKETS];
+	uint64_t total;
+	uint32_t max_us;
+
+	void Record(uint64_t us);
+	/* highest value equivalent to the q quantile (0 < q <= 1) */
+	uint32_t Percentile(double q) const;
+
+	static unsigned int BucketIndex(uint32_t us);
+	static uint32_t BucketHighest(unsigned int index);
+};
+
+#define TRAFFIC_WINDOW_SECS	10
+/* an URB unlinked this long after its submission timed out */
+#define UNLINK_TIMEOUT_US	1000000
+
+/* traffic seen during one second */
+struct TrafficSlot {
+	uint64_t sec;
+	uint64_t bytes;
+	uint64_t latency_us;
+	uint32_t urbs;
+	uint32_t errors;
+	uint32_t latency_count;
+};
+
+struct EndpointTraffic {
+	uint16_t busnum;
+	uint8_t devnum;
+	uint8_t epnum;
+	uint8_t xfer_type;
+	TrafficSlot slots[TRAFFIC_WINDOW_SECS];
+
+	/* since the monitor was started */
+	LatencyHistogram latency;
+	uint64_t timeouts;		/* -ETIMEDOUT, or unlinked late */
+	uint64_t unlinks;		/* unlinked before UNLINK_TIMEOUT_US */
+	uint64_t total_bytes;
+	uint64_t total_urbs;
+	uint64_t total_errors;
+
+	TrafficSlot &getSlot(uint64_t sec);
+	void Sum(uint64_t now_sec, unsigned int secs, TrafficSlot &total) const;
+};
+
+class UsbMonitor {
+	UsbMonSource *source_;
+	map<uint32_t, EndpointTraffic> endpoints_;
+	map<uint64_t, uint64_t> pending_;	/* URB tag -> submission time */
+	uint64_t now_us_;
+
+	void Account(const UsbMonEvent &ev);
+
+public:
+	UsbMonitor();
+	~UsbMonitor();
+	int Open(const string &spec);
+	void Close();
+	bool IsOpen() { return source_ != NULL; }
+	int Poll();
+
+	/* NULL when no traffic was seen on the endpoint */
+	const EndpointTraffic *getEndpoint(int busnum, int devnum, uint8_t epnum) const;
+	/* sums of the endpoint totals of a device, false if it had no traffic */
+	bool getDeviceTotals(int busnum, int devnum, uint64_t &bytes,
+			uint64_t &urbs, uint64_t &errors) const;
+
+	/* "top"-like view, devices sorted by throughput; labels indexed
+	 * by (busnum << 8 | devnum) */
+	void getTopList(vector<string> &list, const map<int, string> &labels);
+};
+
+#endif
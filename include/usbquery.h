@@ -0,0 +1,111 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef USB_QUERY_H
+#define USB_QUERY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <libusb.h>
+
+using namespace std;
+
+class UsbDevice;
+
+/*
+ * Device filter expressions such as
+ *
+ *	class==0x0e && speed<high
+ *	bInterval<4 && type==interrupt
+ *	MaxPower>=500 || product~"hub"
+ *
+ * compiled to a postfix program over typed fields of the device, its
+ * active configuration, interfaces and endpoints. A device matches when
+ * the expression holds for one of its endpoints (or altsettings without
+ * endpoints), so several endpoint conditions apply to the same endpoint.
+ *
+ * Fields are grouped by what it takes to read them. The program is first
+ * run with the costlier groups unknown, in three-valued logic, and a
+ * costlier group is only read when the cheaper fields did not decide the
+ * match: string descriptors are only asked to the devices that the
+ * descriptor fields could not rule out.
+ */
+class UsbQuery {
+public:
+	enum Cost {
+		COST_DEVICE,		/* known from enumeration */
+		COST_DESCRIPTORS,	/* configuration descriptors, from sysfs */
+		COST_REQUESTS,		/* needs control transfers */
+	};
+
+private:
+	enum Value { Q_FALSE, Q_TRUE, Q_UNKNOWN };
+
+	enum OpCode {
+		OP_CMP,			/* field cmp constant */
+		OP_NOT,
+		OP_AND,
+		OP_OR,
+	};
+
+	enum CmpOp { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_CONTAINS };
+
+	struct Op {
+		OpCode code;
+		int field;
+		CmpOp cmp;
+		int64_t number;
+		string text;		/* lower case */
+	};
+
+	/* where the fields of one evaluation come from */
+	struct Scope {
+		UsbDevice *dev;
+		const struct libusb_config_descriptor *config;
+		const struct libusb_interface_descriptor *alt;
+		const struct libusb_endpoint_descriptor *ep;
+		Cost cost;		/* costliest fields that may be read */
+	};
+
+	vector<Op> program_;
+	Cost cost_;			/* costliest field used */
+
+	/* parser state */
+	const char *pos_;
+	string error_;
+
+	void skip_space();
+	bool accept(const char *token);
+	bool parse_or();
+	bool parse_and();
+	bool parse_unary();
+	bool parse_cmp();
+
+	Value compare(const Op &op, const Scope &scope);
+	Value run(const Scope &scope);
+	Value run_descriptors(UsbDevice &dev, Cost cost);
+
+public:
+	UsbQuery() : cost_(COST_DEVICE), pos_(NULL) {}
+
+	/* returns false and sets error on a syntax error */
+	bool Compile(const string &text, string &error);
+	bool IsEmpty() { return program_.empty(); }
+	bool Match(UsbDevice &dev);
+};
+
+#endif
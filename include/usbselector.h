@@ -0,0 +1,52 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef USB_SELECTOR_H
+#define USB_SELECTOR_H
+
+#include <string>
+#include <libusb.h>
+
+using namespace std;
+
+/*
+ * lsusb style device selection from the command line: -d vid:pid,
+ * -s [bus:]dev, -D /dev/bus/usb/BBB/DDD and -p devpath. Selectors are
+ * checked against what enumeration already gave, before a device is
+ * opened, so the devices left out cost nothing. Several selectors must
+ * all match.
+ */
+class UsbSelector {
+	int vendor_;		/* -1 for any */
+	int product_;
+	int bus_;
+	int device_;
+	string devpath_;	/* sysfs name, e.g. "1-2.3" */
+
+public:
+	UsbSelector() : vendor_(-1), product_(-1), bus_(-1), device_(-1) {}
+
+	/* returns false if arg is not valid for option */
+	bool Parse(char option, const char *arg);
+	bool IsEmpty() {
+		return vendor_ < 0 && product_ < 0 && bus_ < 0 && device_ < 0
+			&& devpath_.empty();
+	}
+	bool Match(libusb_device *dev);
+};
+
+#endif
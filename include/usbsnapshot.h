@@ -0,0 +1,158 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef USB_SNAPSHOT_H
+#define USB_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class UsbContext;
+
+/* what a snapshot keeps of one device */
+struct SnapshotDevice {
+	string path;		/* sysfs name, unique within a snapshot */
+	int bus;
+	int addr;
+	uint16_t vid;
+	uint16_t pid;
+	uint16_t bcd_usb;
+	uint16_t bcd_device;
+	int speed;
+	int config;		/* active configuration, 0 if unconfigured */
+	vector<pair<int, int> > altsettings;	/* interface -> alt */
+	vector<string> ports;	/* hub port states, port 1 first */
+	string serial;
+	string vendor;
+	string product;
+
+	bool operator==(const SnapshotDevice &o) const;
+	bool operator!=(const SnapshotDevice &o) const { return !(*this == o); }
+	/* one line of the log, tab separated */
+	string Encode() const;
+	bool Decode(const string &line);
+};
+
+struct Snapshot {
+	int64_t time;			/* seconds since the epoch */
+	vector<SnapshotDevice> devices;	/* sorted by path */
+
+	Snapshot() : time(0) {}
+	static void Capture(UsbContext &ctx, Snapshot &snap);
+	/* local "YYYY-MM-DD HH:MM[:SS]" */
+	static bool ParseTime(const string &text, int64_t &time);
+	int Find(const string &path) const;
+	void getList(vector<string> &list) const;
+	void getDetails(unsigned int index, vector<string> &info) const;
+	/*
+	 * Field level changes from a to b, one line each; returns their
+	 * count. Devices are the same if they have the same path and no
+	 * conflicting serial, or else the same serial, found once in each
+	 * snapshot, at another path.
+	 */
+	static int Diff(const Snapshot &a, const Snapshot &b, vector<string> &out);
+};
+
+/*
+ * Snapshot log: an append-only text file of records, each a keyframe
+ * holding every device or a delta holding the devices added or changed
+ * and the paths removed since the previous record. Nothing is written
+ * while nothing changes, except a keyframe every SNAPSHOT_KEYFRAME_SECS
+ * (or SNAPSHOT_KEYFRAME_DELTAS deltas), which bounds the replay needed
+ * to rebuild any moment. The offsets of the keyframes are appended to
+ * "<log>.idx", so a seek is a binary search and the replay of one
+ * keyframe interval.
+ *
+ *	NLSUSBSNAP 1
+ *	K <time> <devices>
+ *	<device line>...
+ *	D <time> <changed> <removed>
+ *	<device line>...
+ *	<removed path>...
+ */
+#define SNAPSHOT_KEYFRAME_SECS		3600
+#define SNAPSHOT_KEYFRAME_DELTAS	256
+
+class SnapshotWriter {
+	FILE *file_;
+	FILE *index_;
+	Snapshot last_;
+	bool has_last_;
+	int64_t key_time_;	/* of the last keyframe */
+	unsigned int deltas_;	/* since the last keyframe */
+
+public:
+	SnapshotWriter() : file_(NULL), index_(NULL), has_last_(false),
+		key_time_(0), deltas_(0) {}
+	~SnapshotWriter() { Close(); }
+	/*
+	 * Appends to the log, or creates it; returns -errno on failure. A
+	 * record cut by a crash is dropped first.
+	 */
+	int Open(const string &path);
+	void Close();
+	bool IsOpen() { return file_ != NULL; }
+	/* returns 1 if a record was written, 0 if nothing changed */
+	int Append(const Snapshot &snap);
+};
+
+class SnapshotReader {
+	struct Keyframe {
+		int64_t time;
+		long offset;
+	};
+
+	struct Header {
+		char type;		/* 'K' or 'D' */
+		int64_t time;
+		unsigned int changed;
+		unsigned int removed;
+	};
+
+	FILE *file_;
+	vector<Keyframe> keys_;
+	int64_t last_time_;
+	long end_;		/* of the last complete record */
+
+	bool read_line(string &line);
+	bool read_header(Header &h);
+	bool apply(const Header &h, Snapshot &snap);
+	void scan(long from);
+	bool seek(int64_t time, Snapshot &snap, bool one_more);
+
+public:
+	SnapshotReader() : file_(NULL), last_time_(0), end_(0) {}
+	~SnapshotReader() { Close(); }
+	int Open(const string &path);
+	void Close();
+	bool IsEmpty() { return keys_.empty(); }
+	int64_t getFirstTime() { return keys_.empty() ? 0 : keys_[0].time; }
+	int64_t getLastTime() { return last_time_; }
+	long getEnd() { return end_; }
+	/* the state at time: as of the last record at or before it */
+	bool Seek(int64_t time, Snapshot &snap);
+	/* moves snap to the record after or before its time */
+	bool Next(Snapshot &snap);
+	bool Prev(Snapshot &snap);
+};
+
+#endif
@@ -32,6 +32,7 @@ ListView::ListView(const ListView& lv)
 	win_ = lv.win_;
 	name_= lv.name_;
 	listItems_= lv.listItems_;
+	highlights_= lv.highlights_;
 	current_index_= lv.current_index_;
 	win_height_= lv.win_height_;
 	start_index_= lv.start_index_;
@@ -101,6 +102,7 @@ ListView::~ListView()
 void ListView::SetItems(std::vector<std::string> items)
 {
 	listItems_ = items;
+	highlights_.clear();
 	
 #ifdef DEBUG
 	if (dbg_file.is_open()) {
@@ -110,6 +112,33 @@ void ListView::SetItems(std::vector<std::string> items)
 	
 }
 
+void ListView::SetItem(unsigned int index, const std::string &item)
+{
+	if (index < listItems_.size())
+		listItems_[index] = item;
+}
+
+/* moves the cursor to an item, scrolling it into view */
+void ListView::SetCurrentIndex(int index)
+{
+	if (index < 0 || index >= (int)listItems_.size())
+		return;
+
+	current_index_ = index;
+	if (current_index_ < start_index_)
+		start_index_ = current_index_;
+	else if (current_index_ >= start_index_ + win_height_)
+		start_index_ = current_index_ - win_height_ + 1;
+}
+
+void ListView::SetHighlight(unsigned int index, bool highlight)
+{
+	if (highlights_.size() < listItems_.size())
+		highlights_.resize(listItems_.size(), false);
+	if (index < highlights_.size())
+		highlights_[index] = highlight;
+}
+
 #define max(a,b) a > b ? a : b;
 #define min(a,b) a < b ? a : b;
 void ListView::Refresh()
@@ -126,13 +155,19 @@ void ListView::Refresh()
 	int start_x = 0;
 	int disp_size = min (start_index_ + win_height_, listItems_.size());
 	for (int i = start_index_; i < disp_size; i++) {
+		bool bold = i < (int)highlights_.size() && highlights_[i];
+
 		if (i == current_index_) {
 			wattron(win_, A_REVERSE);
 			wattron(win_, COLOR_PAIR(color_));
 		}
+		if (bold)
+			wattron(win_, A_BOLD);
 		
 		mvwprintw(win_, start_x + 1, 1, listItems_[i].c_str());
 		
+		if (bold)
+			wattroff(win_, A_BOLD);
 		if (i == current_index_) {
 			wattroff(win_, A_REVERSE);
 			wattroff(win_, COLOR_PAIR(color_));
@@ -16,20 +16,221 @@
 */
 
 #include "usbcontext.h"
+#include "desccache.h"
 #include <list>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "mainview.h"
 
 using namespace std;
 
+/* long options without a short equivalent */
+#define OPT_DIFF	0x100
 
-int main(int argc, char **argv)
+static void usage(const char *prog)
+{
+	cout << "Usage: " << prog << " [-n] [-r] [-t] [-w BYTES] [-m SOURCE]" << endl
+		<< "       " << prog << " [-d vid:pid] [-s [bus:]dev] [-D device] [-p devpath]" << endl
+		<< "       " << prog << " -H FILE [-T TIME]" << endl
+		<< "       " << prog << " --diff SNAPSHOT [SNAPSHOT]" << endl
+		<< "  -d, -s, -D, -p  print the details of the selected devices" << endl
+		<< "              and exit, without opening any other device" << endl
+		<< "  -H FILE     browse a snapshot log recorded by nlsusbd -R," << endl
+		<< "              from TIME (\"YYYY-MM-DD HH:MM[:SS]\") or its end" << endl
+		<< "  --diff      changes from the first snapshot to the second, or" << endl
+		<< "              to the devices plugged now; a snapshot is a log" << endl
+		<< "              at its end or FILE@TIME" << endl
+		<< "  -m SOURCE   traffic source for the monitor view: a usbmon" << endl
+		<< "              device (default /dev/usbmon0), a pcap capture" << endl
+		<< "              or a usbmon text log" << endl
+		<< "  -n          do not use the descriptor cache" << endl
+		<< "  -r          re-probe the requests devices failed before" << endl
+		<< "  -t          print startup timings on exit" << endl
+		<< "  -w BYTES    bytes per line of the raw descriptor view (16)" << endl;
+}
+
+/* lsusb -v style, for scripts checking one device */
+static int print_selected(UsbContext &ctx)
+{
+	unsigned int count = ctx.getUsbDevicesCount();
+
+	for (unsigned int i = 0; i < count; i++) {
+		vector<string> info;
+
+		if (i)
+			cout << endl;
+		ctx.getUsbDeviceInfo(i, info);
+		for (unsigned int j = 0; j < info.size(); j++)
+			cout << info[j] << endl;
+	}
+
+	ctx.Clean();
+	return count ? 0 : 1;
+}
+
+/* "FILE" for the end of a log, "FILE@TIME" for the state at TIME */
+static bool load_snapshot(const string &spec, Snapshot &snap)
 {
+	SnapshotReader reader;
+	size_t at = spec.rfind('@');
+	string path = spec;
+	int64_t t;
+	int r;
+
+	if (at == string::npos || !Snapshot::ParseTime(spec.substr(at + 1), t))
+		at = string::npos;
+	else
+		path = spec.substr(0, at);
+
+	r = reader.Open(path);
+	if (r < 0 || reader.IsEmpty()) {
+		cerr << "unable to read snapshots from " << path << ": "
+			<< (r < 0 ? strerror(-r) : "no snapshot") << endl;
+		return false;
+	}
+	if (at == string::npos)
+		t = reader.getLastTime();
+	if (!reader.Seek(t, snap)) {
+		cerr << "nothing recorded in " << path << " before " << spec.substr(at + 1) << endl;
+		return false;
+	}
+	return true;
+}
+
+/* diff(1) style status: 0 if nothing changed, 1 if something did, 2 on error */
+static int diff_snapshots(UsbContext &ctx, int argc, char **argv)
+{
+	Snapshot a, b;
+	vector<string> changes;
+
+	if (argc < 1 || argc > 2)
+		return 2;
+	if (!load_snapshot(argv[0], a))
+		return 2;
+	if (argc == 2) {
+		if (!load_snapshot(argv[1], b))
+			return 2;
+	} else {
+		if (ctx.Init() < 0) {
+			cerr << "unable to initialize libusb" << endl;
+			return 2;
+		}
+		Snapshot::Capture(ctx, b);
+		ctx.Clean();
+	}
+
+	Snapshot::Diff(a, b, changes);
+	for (unsigned int i = 0; i < changes.size(); i++)
+		cout << changes[i] << endl;
+	return changes.empty() ? 0 : 1;
+}
 
+static int show_history(const char *path, const char *start)
+{
+	SnapshotReader reader;
+	int64_t t;
+	int r;
+
+	r = reader.Open(path);
+	if (r < 0 || reader.IsEmpty()) {
+		cerr << "unable to read snapshots from " << path << ": "
+			<< (r < 0 ? strerror(-r) : "no snapshot") << endl;
+		return 1;
+	}
+
+	t = reader.getLastTime();
+	if (start && !Snapshot::ParseTime(start, t)) {
+		cerr << "invalid time " << start << endl;
+		return 1;
+	}
+
+	mainview mV;
+	mV.showHistory(&reader, t);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	long start_ms = now_ms();
+	bool timing = false;
 	UsbContext TheCtx;
+	UsbSelector selector;
+	static const struct option long_options[] = {
+		{ "diff", no_argument, NULL, OPT_DIFF },
+		{ NULL, 0, NULL, 0 }
+	};
+	const char *history = NULL, *start = NULL;
+	bool diff = false;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "d:s:D:p:H:T:m:nrtw:h",
+					long_options, NULL)) != -1) {
+		switch (opt) {
+		case OPT_DIFF:
+			diff = true;
+			break;
+		case 'd':
+		case 's':
+		case 'D':
+		case 'p':
+			if (!selector.Parse(opt, optarg)) {
+				cerr << "invalid -" << (char)opt << " " << optarg << endl;
+				return 1;
+			}
+			break;
+		case 'H':
+			history = optarg;
+			break;
+		case 'T':
+			start = optarg;
+			break;
+		case 'm':
+			TheCtx.setMonitorSource(optarg);
+			break;
+		case 'n':
+			DescriptorCache::Get().setEnabled(false);
+			break;
+		case 'r':
+			DescriptorCache::Get().setReprobe(true);
+			break;
+		case 't':
+			timing = true;
+			break;
+		case 'w':
+			if (atoi(optarg) <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			TheCtx.setHexWidth(atoi(optarg));
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
 	
+	if (diff) {
+		int r = diff_snapshots(TheCtx, argc - optind, argv + optind);
+
+		if (r == 2 && argc - optind != 1 && argc - optind != 2)
+			usage(argv[0]);
+		return r;
+	}
+	if (history)
+		return show_history(history, start);
+
+	TheCtx.setSelector(selector);
 	TheCtx.Init();
+
+	if (!selector.IsEmpty())
+		return print_selected(TheCtx);
 	
 	mainview mV;
+
+	if (timing)
+		mV.setTiming(start_ms, now_ms());
 	
 	mV.show(&TheCtx);
 	
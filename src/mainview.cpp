@@ -16,19 +16,47 @@
 */
 
 #include "mainview.h"
+#include <string.h>
+#include <time.h>
 
 using namespace std;
 
 #define ERROR	std::cout << __PRETTY_FUNCTION__
 
+long now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
 mainview::mainview()
 	: mCursor (0),
-	m_devices_idx(0)
+	m_devices_idx(0),
+	m_details_view(DETAILS_DEVICE),
+	m_details_pending(false),
+	m_details_due_ms(0),
+	m_list_filled(0),
+	m_details_ready(false),
+	m_details_busy(false),
+	m_details_device(-1),
+	m_details_line(-1),
+	m_match(-1),
+	m_history(NULL),
+	m_timing(false),
+	m_start_ms(0),
+	m_enumerated_ms(-1),
+	m_first_frame_ms(-1),
+	m_list_done_ms(-1),
+	m_details_done_ms(-1)
 {	
 }
 
 mainview::~mainview()
 {
+	if (m_details_thread.joinable())
+		m_details_thread.join();
 }
 
 void mainview::init()
@@ -64,20 +92,73 @@ void mainview::init()
 	free(c);
 }
 
+void mainview::setTiming(long start_ms, long enumerated_ms)
+{
+	m_timing = true;
+	m_start_ms = start_ms;
+	m_enumerated_ms = enumerated_ms - start_ms;
+}
+
+/*
+ * The first frame only shows what enumeration already gave (bus,
+ * address, vid:pid). Names, flags and the details pane are then filled
+ * in from the event loop, one device at a time, so keys are served in
+ * between and a slow device only delays its own line.
+ */
 void mainview::show(UsbContext *ctx)
 {
 	// TODO: verify ctx is not NULL
 	m_usb_ctx = ctx;
 
-	std::vector<std::string> usbdevs;
-	m_usb_ctx->getUsbDevicesList(usbdevs);
+	init();
+
+	m_lines.clear();
+	m_usb_ctx->getUsbDevicesBriefList(m_lines);
+	m_alerts.assign(m_lines.size(), false);
+	m_visible.clear();
+	for (unsigned int i = 0; i < m_lines.size(); i++)
+		m_visible.push_back(i);
+	m_UsbDevices_ListView.SetItems(m_lines);
+	m_list_filled = 0;
 
-	m_UsbDevices_ListView.SetItems(usbdevs);
+	refresh();
+	m_first_frame_ms = now_ms() - m_start_ms;
 
-	std::vector<std::string> usbdevinfo;
-	m_usb_ctx->getUsbDeviceInfo(0, usbdevinfo);
-	m_UsbDeviceInfo_ListView.SetItems(usbdevinfo);
 	show();
+
+	if (m_timing)
+		print_timing();
+}
+
+void mainview::fill_next_device()
+{
+	unsigned int i = m_list_filled++;
+	int row;
+
+	m_lines[i] = m_usb_ctx->getUsbDeviceSummary(i);
+	m_alerts[i] = m_usb_ctx->getUsbDeviceAlert(i);
+	row = device_row(i);
+	if (row >= 0) {
+		m_UsbDevices_ListView.SetItem(row, m_lines[i]);
+		m_UsbDevices_ListView.SetHighlight(row, m_alerts[i]);
+	}
+
+	if (m_list_filled == m_usb_ctx->getUsbDevicesCount()) {
+		m_list_done_ms = now_ms() - m_start_ms;
+		if (!m_details_pending && m_details_done_ms < 0
+				&& m_details_view == DETAILS_DEVICE) {
+			m_details_pending = true;
+			m_details_due_ms = now_ms();
+		}
+	}
+}
+
+void mainview::print_timing()
+{
+	std::cerr << "enumeration " << m_enumerated_ms << " ms, "
+		<< "first frame " << m_first_frame_ms << " ms, "
+		<< "device list " << m_list_done_ms << " ms, "
+		<< "first details " << m_details_done_ms << " ms" << std::endl;
 }
 
 void mainview::refresh()
@@ -93,15 +174,8 @@ void mainview::scroll_up()
 {
 	m_UsbDevices_ListView.CursorUp();
 
-	if (m_UsbDevices_ListView.IsFocused()) {
-		// Update specific device info pane
-		m_devices_idx = m_UsbDevices_ListView.getCurrentIndex();
-		std::vector<std::string> usbdevinfo;
-		m_usb_ctx->getUsbDeviceInfo(m_devices_idx, usbdevinfo);
-		m_UsbDeviceInfo_ListView.ResetCursor();
-		m_UsbDeviceInfo_ListView.SetItems(usbdevinfo);
-		m_UsbDeviceInfo_ListView.Refresh();
-	}
+	if (m_UsbDevices_ListView.IsFocused())
+		schedule_device_info();
 
 	m_UsbDeviceInfo_ListView.CursorUp();
 }
@@ -110,15 +184,8 @@ void mainview::scroll_down()
 {
 	m_UsbDevices_ListView.CursorDown();
 
-	if (m_UsbDevices_ListView.IsFocused()) {
-		// Update specific device info pane
-		m_devices_idx = m_UsbDevices_ListView.getCurrentIndex();
-		std::vector<std::string> usbdevinfo;
-		m_usb_ctx->getUsbDeviceInfo(m_devices_idx, usbdevinfo);
-		m_UsbDeviceInfo_ListView.ResetCursor();
-		m_UsbDeviceInfo_ListView.SetItems(usbdevinfo);
-		m_UsbDeviceInfo_ListView.Refresh();
-	}
+	if (m_UsbDevices_ListView.IsFocused())
+		schedule_device_info();
 	m_UsbDeviceInfo_ListView.CursorDown();
 }
 
@@ -129,6 +196,505 @@ void mainview::toggle_panes()
 	m_UsbDeviceInfo_ListView.ToggleFocus();	
 }
 
+/*
+ * Moving in the device list only moves the cursor; the details follow
+ * once it rests on a device for DETAILS_DEBOUNCE_MS.
+ */
+void mainview::schedule_device_info()
+{
+	m_details_pending = true;
+	m_details_due_ms = now_ms() + DETAILS_DEBOUNCE_MS;
+}
+
+/*
+ * Applies the cursor moves already queued behind ch, so that the keys
+ * typed (or repeated) while the last frame was drawn cost one redraw.
+ * Returns the first key that is not a cursor move, or ERR.
+ */
+int mainview::drain_keys(int ch)
+{
+	timeout(0);
+	while (ch == KEY_UP || ch == KEY_DOWN) {
+		if (ch == KEY_UP)
+			scroll_up();
+		else
+			scroll_down();
+		ch = getch();
+	}
+	return ch;
+}
+
+/*
+ * Reading the details can take seconds when a device times out, so it
+ * is left to a worker thread and the pane is updated from the event
+ * loop by finish_device_info().
+ */
+void mainview::show_device_info()
+{
+	// Update specific device info pane
+	m_details_pending = false;
+	m_details_view = DETAILS_DEVICE;
+	m_devices_idx = selected_device();
+	if (m_details_busy) {
+		// try again once the device being read is done
+		m_details_pending = true;
+		m_details_due_ms = now_ms();
+		return;
+	}
+
+	m_details.clear();
+	m_details_device = m_devices_idx;
+	if (m_devices_idx < 0) {
+		m_details_line = -1;
+		m_UsbDeviceInfo_ListView.ResetCursor();
+		m_UsbDeviceInfo_ListView.SetItems(m_details);
+		return;
+	}
+	m_details_ready = false;
+	m_details_busy = true;
+	m_details_thread = std::thread(&mainview::read_device_info, this);
+}
+
+void mainview::read_device_info()
+{
+	m_usb_ctx->getUsbDeviceInfo(m_details_device, m_details);
+	m_details_ready = true;
+}
+
+/*
+ * Waits for the worker, then shows what it read unless the cursor moved
+ * on meanwhile.
+ */
+void mainview::finish_device_info()
+{
+	m_details_thread.join();
+	m_details_busy = false;
+
+	if (m_details_pending || m_details_view != DETAILS_DEVICE
+			|| m_details_device != selected_device()) {
+		m_details_line = -1;
+		return;
+	}
+	m_UsbDeviceInfo_ListView.ResetCursor();
+	m_UsbDeviceInfo_ListView.SetItems(m_details);
+	if (m_details_line >= 0)
+		m_UsbDeviceInfo_ListView.SetCurrentIndex(m_details_line);
+	m_details_line = -1;
+	m_UsbDeviceInfo_ListView.Refresh();
+	if (m_details_done_ms < 0)
+		m_details_done_ms = now_ms() - m_start_ms;
+}
+
+void mainview::show_raw()
+{
+	m_details_pending = false;
+	m_details_view = DETAILS_RAW;
+	m_devices_idx = selected_device();
+	std::vector<std::string> raw;
+	if (m_devices_idx >= 0)
+		m_usb_ctx->getUsbDeviceRaw(m_devices_idx, raw);
+	m_UsbDeviceInfo_ListView.ResetCursor();
+	m_UsbDeviceInfo_ListView.SetItems(raw);
+}
+
+void mainview::toggle_raw()
+{
+	if (m_details_view == DETAILS_RAW)
+		show_device_info();
+	else
+		show_raw();
+}
+
+void mainview::show_bandwidth()
+{
+	m_details_pending = false;
+	m_details_view = DETAILS_BANDWIDTH;
+	std::vector<std::string> bwinfo;
+	m_usb_ctx->getBandwidthInfo(bwinfo);
+	m_UsbDeviceInfo_ListView.ResetCursor();
+	m_UsbDeviceInfo_ListView.SetItems(bwinfo);
+}
+
+void mainview::show_traffic()
+{
+	std::vector<std::string> traffic;
+	m_usb_ctx->getTrafficInfo(traffic);
+	m_UsbDeviceInfo_ListView.SetItems(traffic);
+}
+
+void mainview::toggle_traffic()
+{
+	if (m_details_view == DETAILS_TRAFFIC) {
+		show_device_info();
+		return;
+	}
+
+	int r = m_usb_ctx->startMonitor();
+	if (r < 0) {
+		show_error("Unable to open the usbmon source:", r,
+			"Load the usbmon module (modprobe usbmon) and run\n"
+			"as root, or pass a capture file with -m.");
+		return;
+	}
+
+	m_details_pending = false;
+	m_details_view = DETAILS_TRAFFIC;
+	m_usb_ctx->pollMonitor();
+	m_UsbDeviceInfo_ListView.ResetCursor();
+	show_traffic();
+}
+
+void mainview::show_hub_watch()
+{
+	std::vector<std::string> ports;
+	m_usb_ctx->getHubWatchInfo(m_devices_idx, ports);
+	m_UsbDeviceInfo_ListView.SetItems(ports);
+}
+
+void mainview::toggle_hub_watch()
+{
+	m_devices_idx = selected_device();
+	if (m_devices_idx < 0)
+		return;
+
+	int r = m_usb_ctx->toggleHubWatch(m_devices_idx);
+	if (r < 0) {
+		show_error("Unable to watch the hub ports:", r,
+			"The selected device must be a hub that can be opened;\n"
+			"sysfs port notifications need Linux 6.6 or later.");
+		return;
+	}
+	if (r == 0) {
+		show_device_info();
+		return;
+	}
+
+	m_details_pending = false;
+	m_details_view = DETAILS_PORTS;
+	m_UsbDeviceInfo_ListView.ResetCursor();
+	show_hub_watch();
+}
+
+void mainview::reprobe_device()
+{
+	int device = selected_device();
+
+	if (device < 0)
+		return;
+	m_usb_ctx->reprobeDevice(device);
+	show_device_info();
+}
+
+int mainview::selected_device()
+{
+	int row = m_UsbDevices_ListView.getCurrentIndex();
+
+	if (row < 0 || row >= (int)m_visible.size())
+		return -1;
+	return m_visible[row];
+}
+
+int mainview::device_row(int device)
+{
+	for (unsigned int i = 0; i < m_visible.size(); i++) {
+		if (m_visible[i] == device)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Narrows the device list to the devices matching a UsbQuery
+ * expression; an empty one shows them all again.
+ */
+void mainview::filter()
+{
+	std::vector<std::string> rows;
+	std::vector<int> visible;
+	std::string query, error;
+	char msg[64];
+	int device = selected_device();
+	int row;
+
+	prompt("filter: ", query);
+	if (m_usb_ctx->filterDevices(query, visible, error) < 0) {
+		m_message = "filter: " + error;
+		return;
+	}
+
+	m_filter = query;
+	m_visible = visible;
+	for (unsigned int i = 0; i < m_visible.size(); i++)
+		rows.push_back(m_lines[m_visible[i]]);
+	m_UsbDevices_ListView.ResetCursor();
+	m_UsbDevices_ListView.SetItems(rows);
+	for (unsigned int i = 0; i < m_visible.size(); i++)
+		m_UsbDevices_ListView.SetHighlight(i, m_alerts[m_visible[i]]);
+
+	// stay on the selected device if it is still listed
+	row = device_row(device);
+	if (row >= 0)
+		m_UsbDevices_ListView.SetCurrentIndex(row);
+
+	if (m_filter.empty()) {
+		m_message.clear();
+	} else {
+		snprintf(msg, sizeof(msg), "%u of %u devices",
+				(unsigned int)m_visible.size(),
+				m_usb_ctx->getUsbDevicesCount());
+		m_message = msg;
+	}
+
+	// the matches of the last search may have been filtered out
+	m_matches.clear();
+	m_match = -1;
+
+	if (row < 0 && m_details_view == DETAILS_DEVICE)
+		show_device_info();
+}
+
+/* reads a line of text on the status line, false if left empty */
+bool mainview::prompt(const char *label, std::string &text)
+{
+	char buf[128];
+	int rows, cols, r;
+
+	getmaxyx(stdscr, rows, cols);
+	move(rows - 1, 0);
+	clrtoeol();
+	mvprintw(rows - 1, 1, "%s", label);
+	echo();
+	curs_set(TRUE);
+	timeout(-1);
+	r = getnstr(buf, cols - 3 < (int)sizeof(buf) - 1 ? cols - 3 : sizeof(buf) - 1);
+	curs_set(FALSE);
+	noecho();
+
+	if (r == ERR || !buf[0])
+		return false;
+	text = buf;
+	return true;
+}
+
+void mainview::search()
+{
+	std::string query;
+
+	if (!prompt("/", query))
+		return;
+
+	m_search = query;
+	m_matches.clear();
+	m_usb_ctx->searchDevices(m_search, m_matches);
+	for (unsigned int i = 0; i < m_matches.size(); ) {
+		if (device_row(m_matches[i].device) < 0)
+			m_matches.erase(m_matches.begin() + i);
+		else
+			i++;
+	}
+	if (m_matches.empty()) {
+		m_match = -1;
+		m_message = "no match for \"" + m_search + "\"";
+		return;
+	}
+
+	// start with the first match from the selected device on
+	int cur = m_UsbDevices_ListView.getCurrentIndex();
+	m_match = m_matches.size() - 1;
+	for (unsigned int i = 0; i < m_matches.size(); i++) {
+		if (device_row(m_matches[i].device) >= cur) {
+			m_match = i - 1;
+			break;
+		}
+	}
+	goto_match(1);
+}
+
+/* moves step matches forward or back, across devices, wrapping around */
+void mainview::goto_match(int step)
+{
+	char msg[64];
+	int n = m_matches.size();
+
+	if (!n) {
+		m_message = m_search.empty() ? "no search, use /" : "no match";
+		return;
+	}
+
+	m_match = ((m_match + step) % n + n) % n;
+	const SearchMatch &m = m_matches[m_match];
+
+	if ((int)m.device != selected_device()
+			|| m_details_view != DETAILS_DEVICE) {
+		m_UsbDevices_ListView.SetCurrentIndex(device_row(m.device));
+		show_device_info();
+	}
+	if (m_details_busy)
+		m_details_line = m.line;
+	else
+		m_UsbDeviceInfo_ListView.SetCurrentIndex(m.line);
+
+	snprintf(msg, sizeof(msg), "match %d/%d", m_match + 1, n);
+	m_message = msg;
+}
+
+void mainview::show_error(const char *what, int err, const char *hint)
+{
+	std::vector<std::string> lines;
+	std::string h = hint;
+	size_t pos;
+
+	lines.push_back(what);
+	lines.push_back(std::string("  ") + strerror(-err));
+	lines.push_back(" ");
+	while ((pos = h.find('\n')) != std::string::npos) {
+		lines.push_back(h.substr(0, pos));
+		h.erase(0, pos + 1);
+	}
+	lines.push_back(h);
+
+	m_UsbDeviceInfo_ListView.ResetCursor();
+	m_UsbDeviceInfo_ListView.SetItems(lines);
+}
+
+void mainview::showHistory(SnapshotReader *reader, int64_t time)
+{
+	m_history = reader;
+	if (!m_history->Seek(time, m_snapshot))
+		m_history->Seek(m_history->getFirstTime(), m_snapshot);
+
+	init();
+	show_snapshot();
+	refresh();
+	history();
+}
+
+/* redraws both panes for m_snapshot, staying on the selected device */
+void mainview::show_snapshot()
+{
+	std::vector<std::string> list;
+	std::string path;
+	int row = m_UsbDevices_ListView.getCurrentIndex();
+	char msg[64];
+	time_t t = m_snapshot.time;
+
+	if (row >= 0 && row < (int)m_lines.size())
+		path = m_lines[row];
+
+	m_snapshot.getList(list);
+	m_UsbDevices_ListView.ResetCursor();
+	m_UsbDevices_ListView.SetItems(list);
+
+	// m_lines holds the paths of the rows
+	m_lines.clear();
+	for (unsigned int i = 0; i < m_snapshot.devices.size(); i++)
+		m_lines.push_back(m_snapshot.devices[i].path);
+	row = path.empty() ? -1 : m_snapshot.Find(path);
+	if (row >= 0)
+		m_UsbDevices_ListView.SetCurrentIndex(row);
+
+	strftime(msg, sizeof(msg), "%Y-%m-%d %H:%M:%S", localtime(&t));
+	m_message = std::string(msg) + (row < 0 && !path.empty()
+			? "  (" + path + " not present)" : "");
+	show_snapshot_device();
+}
+
+void mainview::show_snapshot_device()
+{
+	std::vector<std::string> info;
+	int row = m_UsbDevices_ListView.getCurrentIndex();
+
+	if (row >= 0 && row < (int)m_snapshot.devices.size())
+		m_snapshot.getDetails(row, info);
+	m_UsbDeviceInfo_ListView.ResetCursor();
+	m_UsbDeviceInfo_ListView.SetItems(info);
+}
+
+void mainview::goto_time()
+{
+	std::string text;
+	Snapshot snap;
+	int64_t t;
+
+	if (!prompt("time (YYYY-MM-DD HH:MM[:SS]): ", text))
+		return;
+
+	if (!Snapshot::ParseTime(text, t)) {
+		m_message = "bad time " + text;
+		return;
+	}
+	if (!m_history->Seek(t, snap)) {
+		m_message = "nothing recorded before " + text;
+		return;
+	}
+	m_snapshot = snap;
+	show_snapshot();
+}
+
+void mainview::history()
+{
+	int done = 0;
+
+	while (!done) {
+		Snapshot snap = m_snapshot;
+		int ch;
+
+		timeout(-1);
+		ch = getch();
+		switch (ch) {
+		case KEY_UP:
+			scroll_up();
+			if (m_UsbDevices_ListView.IsFocused())
+				show_snapshot_device();
+			break;
+		case KEY_DOWN:
+			scroll_down();
+			if (m_UsbDevices_ListView.IsFocused())
+				show_snapshot_device();
+			break;
+		case '\t':
+		case KEY_LEFT:
+		case KEY_RIGHT:
+			toggle_panes();
+			break;
+		case ']':
+			if (m_history->Next(snap)) {
+				m_snapshot = snap;
+				show_snapshot();
+			}
+			break;
+		case '[':
+			if (m_history->Prev(snap)) {
+				m_snapshot = snap;
+				show_snapshot();
+			}
+			break;
+		case '}':
+			if (m_history->Seek(m_snapshot.time + 3600, snap)) {
+				m_snapshot = snap;
+				show_snapshot();
+			}
+			break;
+		case '{':
+			if (m_history->Seek(m_snapshot.time - 3600, snap)) {
+				m_snapshot = snap;
+				show_snapshot();
+			}
+			break;
+		case 'g':
+			goto_time();
+			break;
+		case 'q':
+		case KEY_F(10):
+			done = 1;
+			break;
+		}
+		refresh();
+	}
+
+	endwin();
+}
+
 void mainview::showHeaderBar()
 {
 }
@@ -138,34 +704,118 @@ void mainview::showStatusLine()
 	int rows;
 	int cols;
 	getmaxyx(stdscr,rows,cols);
+	wmove(stdscr, rows - 1, 0);
+	wclrtoeol(stdscr);
 	wattron(stdscr, A_BOLD);
-	mvwprintw(stdscr, rows - 1 , 1, "[F10] Exit");
+	if (m_history)
+		mvwprintw(stdscr, rows - 1, 1, "[F10] Exit  [[ ]] Prev/Next  [{ }] -/+1 h  [g] Go to time");
+	else
+		mvwprintw(stdscr, rows - 1 , 1, "[F10] Exit  [b] Bandwidth  [m] Traffic  [h] Hub ports  [r] Re-probe  [x] Raw  [/] Search  [f] Filter");
 	wattroff(stdscr, A_BOLD);
+	if (!m_message.empty())
+		wprintw(stdscr, "  %s", m_message.c_str());
 	wrefresh(stdscr);
 }
 
 void mainview::show()
 {
-	init();
-	refresh();
-
 	int ch;
 	int done = 0;
 
 	while (!done) {
+		int wait;
+
+		// nothing but the cursor moves while the details are read;
+		// keep draining usbmon once a second, even when the traffic
+		// view is hidden, so that latency histograms stay complete;
+		// watched hubs are checked more often to keep up with plugs
+		if (m_details_busy) {
+			wait = DETAILS_POLL_MS;
+		} else if (m_list_filled < m_usb_ctx->getUsbDevicesCount()) {
+			wait = 0;
+		} else if (m_details_pending) {
+			// never more than DETAILS_DEBOUNCE_MS
+			wait = m_details_due_ms - now_ms();
+			if (wait < 0)
+				wait = 0;
+		} else if (m_usb_ctx->isWatchingHubs()) {
+			wait = 250;
+		} else if (m_usb_ctx->isMonitoring()) {
+			wait = 1000;
+		} else {
+			wait = -1;
+		}
+		timeout(wait);
 		ch = getch();
+		if (ch == KEY_UP || ch == KEY_DOWN) {
+			ch = drain_keys(ch);
+			if (ch == ERR) {
+				refresh();
+				continue;
+			}
+		}
+		// the other keys use the context: let the worker finish first
+		if (m_details_busy && ch != ERR)
+			finish_device_info();
 		switch (ch) {
-		case KEY_UP:
-			scroll_up();
-			break;
-		case KEY_DOWN:
-			scroll_down();
+		case ERR:
+			if (m_details_busy) {
+				if (m_details_ready)
+					finish_device_info();
+				break;
+			}
+			if (m_details_pending && now_ms() >= m_details_due_ms) {
+				if (m_details_view == DETAILS_RAW)
+					show_raw();
+				else
+					show_device_info();
+				break;
+			}
+			if (m_list_filled < m_usb_ctx->getUsbDevicesCount()) {
+				fill_next_device();
+				break;
+			}
+			if (m_usb_ctx->isMonitoring()) {
+				m_usb_ctx->pollMonitor();
+				if (m_details_view == DETAILS_TRAFFIC)
+					show_traffic();
+			}
+			if (m_usb_ctx->pollHubWatch() > 0
+					&& m_details_view == DETAILS_PORTS)
+				show_hub_watch();
 			break;
 		case '\t':
 		case KEY_LEFT:
 		case KEY_RIGHT:
 			toggle_panes();
 			break;
+		case 'b':
+			show_bandwidth();
+			break;
+		case 'm':
+			toggle_traffic();
+			break;
+		case 'h':
+			toggle_hub_watch();
+			break;
+		case 'r':
+			reprobe_device();
+			break;
+		case 'x':
+			toggle_raw();
+			break;
+		case '/':
+			search();
+			break;
+		case 'f':
+			filter();
+			break;
+		case 'n':
+			goto_match(1);
+			break;
+		case 'N':
+			goto_match(-1);
+			break;
 		case 'q':
 		case KEY_F(10):
 			done = 1;
@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "nlsusbd.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <iostream>
+
+using namespace std;
+
+/*
+ * Thin client for nlsusbd: sends its arguments as one request and
+ * prints the answer. It does not link libusb, so that asking the daemon
+ * costs a connect and a round trip only.
+ */
+
+static void usage(const char *prog)
+{
+	cout << "Usage: " << prog << " [-S SOCKET] list" << endl
+		<< "       " << prog << " [-S SOCKET] details INDEX|PATH" << endl
+		<< "       " << prog << " [-S SOCKET] query EXPRESSION" << endl;
+}
+
+/* an answer ends with an empty line */
+static bool is_complete(const string &answer)
+{
+	size_t n = answer.size();
+
+	return answer == "\n" || (n >= 2 && answer.compare(n - 2, 2, "\n\n") == 0);
+}
+
+int main(int argc, char **argv)
+{
+	string path = nlsusbd_socket_path();
+	string request, answer;
+	struct sockaddr_un addr;
+	char buf[4096];
+	ssize_t r;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "S:h")) != -1) {
+		switch (opt) {
+		case 'S':
+			path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind == argc || path.size() >= sizeof(addr.sun_path)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = optind; i < argc; i++)
+		request += string(i > optind ? " " : "") + argv[i];
+	request += "\n";
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		cerr << "unable to reach nlsusbd on " << path << ": "
+			<< strerror(errno) << endl;
+		return 1;
+	}
+
+	if (write(fd, request.data(), request.size()) != (ssize_t)request.size()) {
+		cerr << "unable to send the request: " << strerror(errno) << endl;
+		return 1;
+	}
+
+	while (!is_complete(answer)) {
+		r = read(fd, buf, sizeof(buf));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+		answer.append(buf, r);
+	}
+	close(fd);
+
+	if (!answer.empty())
+		answer.erase(answer.size() - 1);
+	fwrite(answer.data(), 1, answer.size(), stdout);
+	return answer.compare(0, 9, "{\"error\":") ? 0 : 1;
+}
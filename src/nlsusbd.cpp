@@ -0,0 +1,444 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "nlsusbd.h"
+#include "usbcontext.h"
+#include "desccache.h"
+#include "usbexporter.h"
+#include "usbsnapshot.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+
+using namespace std;
+
+/* how often hotplug events are handled while no request comes */
+#define HOTPLUG_POLL_MS		250
+
+#define EXPORT_INTERVAL_SECS	15
+
+/* answers queued for a client that does not read them */
+#define MAX_PENDING_OUTPUT	(1 << 20)
+
+/*
+ * Client sockets are non-blocking: answers are queued and sent as the
+ * client reads them, so a slow one does not hold up the others.
+ */
+struct Client {
+	int fd;
+	string in;		/* received, not yet a full line */
+	string out;		/* answered, not yet sent */
+	bool eof;		/* nothing more to read, close once sent */
+};
+
+/*
+ * The list object of a device, kept until it is unplugged. Devices are
+ * keyed by path and address, which changes on every plug. Details are
+ * not kept: they show the live port and power state.
+ */
+struct Entry {
+	string json;
+};
+
+static UsbContext ctx;
+static UsbExporter exporter;
+static SnapshotWriter recorder;
+static map<string, Entry> entries;
+static volatile sig_atomic_t quit;
+
+static void usage(const char *prog)
+{
+	cout << "Usage: " << prog << " [-n] [-S SOCKET] [-e FILE] [-R FILE] [-i SECS] [-m SOURCE]" << endl
+		<< "  -e FILE     write Prometheus metrics to FILE, for the" << endl
+		<< "              node_exporter textfile collector" << endl
+		<< "  -R FILE     record snapshots of the devices to FILE, on" << endl
+		<< "              every plug and unplug and every interval" << endl
+		<< "  -i SECS     metrics and snapshot interval ("
+		<< EXPORT_INTERVAL_SECS << ")" << endl
+		<< "  -m SOURCE   usbmon source for the traffic counters" << endl
+		<< "              (default /dev/usbmon0, skipped if unavailable)" << endl
+		<< "  -n          do not use the descriptor cache" << endl
+		<< "  -S SOCKET   listen on SOCKET instead of "
+		<< nlsusbd_socket_path() << endl;
+}
+
+static void on_signal(int sig)
+{
+	quit = 1;
+}
+
+static string json_string(const string &s)
+{
+	string out = "\"";
+	char esc[8];
+
+	for (size_t i = 0; i < s.size(); i++) {
+		unsigned char c = s[i];
+
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (c < 0x20) {
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			out += esc;
+		} else {
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+static string device_key(UsbDevice &dev)
+{
+	char addr[16];
+
+	snprintf(addr, sizeof(addr), " %d:%d", dev.getBusNumber(),
+			dev.getDeviceAddr());
+	return dev.getSysfsName() + addr;
+}
+
+static Entry &get_entry(unsigned int index)
+{
+	UsbDevice &dev = ctx.getUsbDevice(index);
+	Entry &e = entries[device_key(dev)];
+	char buf[160];
+
+	if (!e.json.empty())
+		return e;
+
+	snprintf(buf, sizeof(buf), "\"bus\":%d,\"device\":%d,\"vid\":\"%04x\",\"pid\":\"%04x\",\"speed\":\"%s\",\"alert\":%s,",
+			dev.getBusNumber(), dev.getDeviceAddr(),
+			dev.getIdVendor(), dev.getIdProduct(),
+			UsbDevice::getSpeedName(dev.getSpeed()),
+			ctx.getUsbDeviceAlert(index) ? "true" : "false");
+	e.json = string("\"path\":") + json_string(dev.getSysfsName()) + ","
+		+ buf + "\"summary\":"
+		+ json_string(ctx.getUsbDeviceSummary(index));
+	return e;
+}
+
+static string list_object(unsigned int index)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "{\"index\":%u,", index);
+	return buf + get_entry(index).json + "}\n";
+}
+
+/* forgets what was answered about the devices gone */
+static void prune_entries()
+{
+	map<string, Entry> kept;
+
+	for (unsigned int i = 0; i < ctx.getUsbDevicesCount(); i++) {
+		string key = device_key(ctx.getUsbDevice(i));
+		map<string, Entry>::iterator it = entries.find(key);
+
+		if (it != entries.end())
+			kept[key] = it->second;
+	}
+	entries.swap(kept);
+}
+
+static int find_device(const string &arg)
+{
+	unsigned int count = ctx.getUsbDevicesCount();
+
+	if (!arg.empty() && arg.find_first_not_of("0123456789") == string::npos) {
+		unsigned int index = atoi(arg.c_str());
+
+		return index < count ? (int)index : -1;
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		if (ctx.getUsbDevice(i).getSysfsName() == arg)
+			return i;
+	}
+	return -1;
+}
+
+static string handle_request(const string &line)
+{
+	size_t sp = line.find(' ');
+	string cmd = line.substr(0, sp);
+	string arg = sp == string::npos ? "" : line.substr(sp + 1);
+	string out;
+
+	if (cmd == "list") {
+		for (unsigned int i = 0; i < ctx.getUsbDevicesCount(); i++)
+			out += list_object(i);
+	} else if (cmd == "details") {
+		int index = find_device(arg);
+		vector<string> details;
+		char buf[32];
+
+		if (index < 0)
+			return "{\"error\":" + json_string("no device " + arg) + "}\n\n";
+
+		ctx.getUsbDeviceInfo(index, details);
+		snprintf(buf, sizeof(buf), "{\"index\":%d,", index);
+		out = buf;
+		out += "\"path\":" + json_string(ctx.getUsbDevice(index).getSysfsName())
+			+ ",\"lines\":[";
+		for (unsigned int i = 0; i < details.size(); i++)
+			out += (i ? "," : "") + json_string(details[i]);
+		out += "]}\n";
+	} else if (cmd == "query") {
+		vector<int> matching;
+		string error;
+
+		if (ctx.filterDevices(arg, matching, error) < 0)
+			return "{\"error\":" + json_string(error) + "}\n\n";
+		for (unsigned int i = 0; i < matching.size(); i++)
+			out += list_object(matching[i]);
+	} else {
+		return "{\"error\":" + json_string("unknown request " + cmd) + "}\n\n";
+	}
+
+	return out + "\n";
+}
+
+/* sends what the socket takes, false once the client is gone */
+static bool flush_client(Client &c)
+{
+	while (!c.out.empty()) {
+		ssize_t r = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (r <= 0)
+			return false;
+		c.out.erase(0, r);
+	}
+	return !c.eof;
+}
+
+/* false once the client misbehaved */
+static bool serve_client(Client &c)
+{
+	char buf[1024];
+	size_t nl;
+	ssize_t r;
+
+	r = recv(c.fd, buf, sizeof(buf), 0);
+	if (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+		return true;
+	if (r <= 0) {
+		c.eof = true;
+		return r == 0;
+	}
+	c.in.append(buf, r);
+
+	while ((nl = c.in.find('\n')) != string::npos) {
+		string line = c.in.substr(0, nl);
+
+		c.in.erase(0, nl + 1);
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		c.out += handle_request(line);
+	}
+	return c.in.size() <= NLSUSBD_MAX_REQUEST;
+}
+
+static int listen_on(const string &path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (path.size() >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+	/* a socket left by a previous run */
+	unlink(path.c_str());
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| listen(fd, 16) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	string path = nlsusbd_socket_path();
+	vector<Client> clients;
+	int interval = EXPORT_INTERVAL_SECS;
+	time_t next_export = 0, next_snapshot = 0;
+	const char *record = NULL;
+	bool hotplug;
+	int opt, fd, wait;
+
+	while ((opt = getopt(argc, argv, "e:i:m:nR:S:h")) != -1) {
+		switch (opt) {
+		case 'e':
+			exporter.setPath(optarg);
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			if (interval <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'm':
+			ctx.setMonitorSource(optarg);
+			break;
+		case 'n':
+			DescriptorCache::Get().setEnabled(false);
+			break;
+		case 'R':
+			record = optarg;
+			break;
+		case 'S':
+			path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (ctx.Init() < 0) {
+		cerr << "unable to initialize libusb" << endl;
+		return 1;
+	}
+	/* without hotplug the list stays as enumerated at startup */
+	hotplug = ctx.startHotplug() == 0;
+	if (!hotplug)
+		cerr << "hotplug not supported, the device list will not be updated" << endl;
+	wait = hotplug ? HOTPLUG_POLL_MS : -1;
+	if (exporter.IsEnabled()) {
+		/* traffic counters are only exported when usbmon can be read */
+		ctx.startMonitor();
+		wait = HOTPLUG_POLL_MS;
+	}
+	if (record) {
+		int r = recorder.Open(record);
+
+		if (r < 0) {
+			cerr << "unable to open " << record << ": " << strerror(-r) << endl;
+			ctx.Clean();
+			return 1;
+		}
+		wait = HOTPLUG_POLL_MS;
+	}
+
+	fd = listen_on(path);
+	if (fd < 0) {
+		cerr << "unable to listen on " << path << ": " << strerror(errno) << endl;
+		ctx.Clean();
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	while (!quit) {
+		vector<struct pollfd> fds(clients.size() + 1);
+
+		fds[0].fd = fd;
+		fds[0].events = POLLIN;
+		for (unsigned int i = 0; i < clients.size(); i++) {
+			const Client &c = clients[i];
+
+			fds[i + 1].fd = c.fd;
+			/* stop reading from clients not reading their answers */
+			fds[i + 1].events = !c.eof && c.out.size() < MAX_PENDING_OUTPUT
+				? POLLIN : 0;
+			if (!c.out.empty())
+				fds[i + 1].events |= POLLOUT;
+		}
+
+		if (poll(&fds[0], fds.size(), wait) < 0 && errno != EINTR)
+			break;
+
+		if (hotplug && ctx.pollHotplug(0) > 0) {
+			prune_entries();
+			next_snapshot = 0;
+		}
+		if (ctx.isMonitoring())
+			ctx.pollMonitor();
+		if (exporter.IsEnabled() && time(NULL) >= next_export) {
+			int r = exporter.Write(ctx);
+
+			if (r < 0)
+				cerr << "unable to write the metrics: " << strerror(-r) << endl;
+			next_export = time(NULL) + interval;
+		}
+		if (recorder.IsOpen() && time(NULL) >= next_snapshot) {
+			Snapshot snap;
+
+			/* only written if something changed */
+			Snapshot::Capture(ctx, snap);
+			recorder.Append(snap);
+			next_snapshot = time(NULL) + interval;
+		}
+
+		/* back to front, so that erasing keeps the fds in step */
+		for (unsigned int i = clients.size(); i > 0; i--) {
+			Client &c = clients[i - 1];
+			bool ok;
+
+			if (!fds[i].revents)
+				continue;
+			if (fds[i].revents & (POLLERR | POLLNVAL))
+				ok = false;
+			else if (fds[i].revents & (POLLIN | POLLHUP))
+				ok = serve_client(c) && flush_client(c);
+			else
+				ok = flush_client(c);
+			if (!ok) {
+				close(c.fd);
+				clients.erase(clients.begin() + i - 1);
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			Client c;
+
+			c.fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+			c.eof = false;
+			if (c.fd >= 0)
+				clients.push_back(c);
+		}
+	}
+
+	for (unsigned int i = 0; i < clients.size(); i++)
+		close(clients[i].fd);
+	close(fd);
+	unlink(path.c_str());
+	ctx.Clean();
+	return 0;
+}
@@ -0,0 +1,513 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "desccache.h"
+#include "usbmisc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/*
+ * File layout, in host byte order since the cache never leaves the host:
+ *
+ *	"NLSUDC3\0"  u32 device count
+ *	per device:  u16 key length, key, u64 stamp, u64 last seen,
+ *	             u16 entry count
+ *	per entry:   u8 bmRequestType, u16 wValue, u16 wIndex, u8 complete,
+ *	             u16 length, data
+ *	             u32 model count
+ *	per model:   u16 key length, key, u16 failure count
+ *	per failure: u8 bmRequestType, u8 bRequest, u16 wValue, u16 wIndex,
+ *	             i32 error
+ */
+static const char cache_magic[8] = { 'N', 'L', 'S', 'U', 'D', 'C', '3', '\0' };
+
+#define SECS_PER_DAY		(24 * 60 * 60)
+
+/* bmRequestType bits 6..5, not defined by libusb */
+#define REQUEST_TYPE_MASK	(0x03 << 5)
+
+/*
+ * Requests a device may legitimately not support: descriptors (debug,
+ * qualifier, BOS, strings...) and the wireless device status selectors.
+ * The plain device status is mandatory, a failure there is not a trait
+ * of the model. Vendor requests may reuse bRequest 6 for anything.
+ */
+static bool is_optional(uint8_t requesttype, uint8_t request, uint16_t index)
+{
+	if (request == LIBUSB_REQUEST_GET_DESCRIPTOR)
+		return (requesttype & REQUEST_TYPE_MASK) != LIBUSB_REQUEST_TYPE_VENDOR;
+	return request == LIBUSB_REQUEST_GET_STATUS
+		&& (requesttype & 0x7f) == (LIBUSB_REQUEST_TYPE_STANDARD
+				| LIBUSB_RECIPIENT_DEVICE)
+		&& index != 0;
+}
+
+/* FNV-1a of the descriptors the kernel read at enumeration */
+static uint64_t read_descriptors_stamp(const string &sysfs_name)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	unsigned char buf[4096];
+	char path[256];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s/descriptors",
+			sysfs_name.c_str());
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (ssize_t i = 0; i < n; i++) {
+			hash ^= buf[i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	close(fd);
+
+	return hash;
+}
+
+static int make_dirs(const string &path)
+{
+	for (size_t pos = 1; (pos = path.find('/', pos)) != string::npos; pos++) {
+		if (mkdir(path.substr(0, pos).c_str(), 0700) < 0 && errno != EEXIST)
+			return -errno;
+	}
+	return 0;
+}
+
+/* reads a value of type T at *p, if it lies before end */
+template <typename T>
+static bool take(const unsigned char *&p, const unsigned char *end, T &val)
+{
+	if (end - p < (ptrdiff_t)sizeof(T))
+		return false;
+	memcpy(&val, p, sizeof(T));
+	p += sizeof(T);
+	return true;
+}
+
+template <typename T>
+static void put(FILE *f, T val)
+{
+	fwrite(&val, sizeof(T), 1, f);
+}
+
+DescriptorCache::DescriptorCache()
+	: enabled_(true),
+	reprobe_(false),
+	dirty_(false)
+{
+	const char *dir = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+
+	if (dir && *dir)
+		path_ = string(dir) + "/nlsusb/descriptors";
+	else if (home && *home)
+		path_ = string(home) + "/.cache/nlsusb/descriptors";
+}
+
+DescriptorCache &DescriptorCache::Get()
+{
+	static DescriptorCache cache;
+
+	return cache;
+}
+
+DescriptorCache::Entry *DescriptorCache::find(Device &dev,
+		uint8_t requesttype, uint16_t value, uint16_t index)
+{
+	for (unsigned int i = 0; i < dev.entries.size(); i++) {
+		Entry &e = dev.entries[i];
+
+		if (e.requesttype == requesttype && e.value == value
+				&& e.index == index)
+			return &e;
+	}
+	return NULL;
+}
+
+const DescriptorCache::Failure *DescriptorCache::find_failure(
+		const string &model, uint8_t requesttype, uint8_t request,
+		uint16_t value, uint16_t index)
+{
+	map<string, vector<Failure> >::iterator it = failures_.find(model);
+
+	if (it == failures_.end())
+		return NULL;
+	for (unsigned int i = 0; i < it->second.size(); i++) {
+		const Failure &f = it->second[i];
+
+		if (f.requesttype == requesttype && f.request == request
+				&& f.value == value && f.index == index)
+			return &f;
+	}
+	return NULL;
+}
+
+int DescriptorCache::parse(const unsigned char *p, size_t size)
+{
+	const unsigned char *end = p + size;
+	uint32_t ndevices, nmodels;
+
+	if (size < sizeof(cache_magic) || memcmp(p, cache_magic, sizeof(cache_magic)))
+		return -EINVAL;
+	p += sizeof(cache_magic);
+	if (!take(p, end, ndevices))
+		return -EINVAL;
+
+	for (uint32_t i = 0; i < ndevices; i++) {
+		uint16_t keylen, nentries;
+		Device dev;
+		string key;
+
+		if (!take(p, end, keylen) || end - p < keylen)
+			return -EINVAL;
+		key.assign((const char *)p, keylen);
+		p += keylen;
+		if (!take(p, end, dev.stamp) || !take(p, end, dev.seen)
+				|| !take(p, end, nentries))
+			return -EINVAL;
+
+		for (uint16_t j = 0; j < nentries; j++) {
+			uint8_t complete;
+			uint16_t len;
+			Entry e;
+
+			if (!take(p, end, e.requesttype) || !take(p, end, e.value)
+					|| !take(p, end, e.index)
+					|| !take(p, end, complete)
+					|| !take(p, end, len) || end - p < len)
+				return -EINVAL;
+			e.complete = complete;
+			e.data.assign(p, p + len);
+			p += len;
+			dev.entries.push_back(e);
+		}
+		devices_[key] = dev;
+	}
+
+	if (!take(p, end, nmodels))
+		return -EINVAL;
+	for (uint32_t i = 0; i < nmodels; i++) {
+		uint16_t keylen, nfailures;
+		vector<Failure> failures;
+		string key;
+
+		if (!take(p, end, keylen) || end - p < keylen)
+			return -EINVAL;
+		key.assign((const char *)p, keylen);
+		p += keylen;
+		if (!take(p, end, nfailures))
+			return -EINVAL;
+
+		for (uint16_t j = 0; j < nfailures; j++) {
+			Failure f;
+
+			if (!take(p, end, f.requesttype) || !take(p, end, f.request)
+					|| !take(p, end, f.value)
+					|| !take(p, end, f.index)
+					|| !take(p, end, f.error))
+				return -EINVAL;
+			failures.push_back(f);
+		}
+		failures_[key] = failures;
+	}
+
+	return 0;
+}
+
+/* drops the devices not attached for CACHE_MAX_AGE_DAYS */
+void DescriptorCache::prune()
+{
+	uint64_t now = time(NULL);
+	map<string, Device>::iterator it;
+
+	for (it = devices_.begin(); it != devices_.end(); ) {
+		if (it->second.seen + CACHE_MAX_AGE_DAYS * SECS_PER_DAY < now) {
+			devices_.erase(it++);
+			dirty_ = true;
+		} else {
+			++it;
+		}
+	}
+}
+
+int DescriptorCache::Load()
+{
+	struct stat st;
+	void *map;
+	int fd, ret;
+
+	if (!enabled_ || path_.empty())
+		return 0;
+
+	fd = open(path_.c_str(), O_RDONLY);
+	if (fd < 0)
+		return errno == ENOENT ? 0 : -errno;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	ret = parse((const unsigned char *)map, st.st_size);
+	munmap(map, st.st_size);
+	if (ret < 0) {
+		/* start over rather than trust half of it */
+		devices_.clear();
+		failures_.clear();
+		dirty_ = true;
+	}
+	prune();
+	if (reprobe_)
+		ClearFailures();
+
+	return ret;
+}
+
+int DescriptorCache::Save()
+{
+	string tmp = path_ + ".tmp";
+	map<string, Device>::iterator it;
+	map<string, vector<Failure> >::iterator mit;
+	FILE *f;
+	int ret;
+
+	if (!enabled_ || !dirty_ || path_.empty())
+		return 0;
+
+	ret = make_dirs(path_);
+	if (ret < 0)
+		return ret;
+	f = fopen(tmp.c_str(), "w");
+	if (!f)
+		return -errno;
+
+	fwrite(cache_magic, sizeof(cache_magic), 1, f);
+	put<uint32_t>(f, devices_.size());
+	for (it = devices_.begin(); it != devices_.end(); ++it) {
+		const Device &dev = it->second;
+
+		put<uint16_t>(f, it->first.size());
+		fwrite(it->first.data(), it->first.size(), 1, f);
+		put<uint64_t>(f, dev.stamp);
+		put<uint64_t>(f, dev.seen);
+		put<uint16_t>(f, dev.entries.size());
+		for (unsigned int i = 0; i < dev.entries.size(); i++) {
+			const Entry &e = dev.entries[i];
+
+			put<uint8_t>(f, e.requesttype);
+			put<uint16_t>(f, e.value);
+			put<uint16_t>(f, e.index);
+			put<uint8_t>(f, e.complete);
+			put<uint16_t>(f, e.data.size());
+			fwrite(e.data.data(), e.data.size(), 1, f);
+		}
+	}
+
+	put<uint32_t>(f, failures_.size());
+	for (mit = failures_.begin(); mit != failures_.end(); ++mit) {
+		put<uint16_t>(f, mit->first.size());
+		fwrite(mit->first.data(), mit->first.size(), 1, f);
+		put<uint16_t>(f, mit->second.size());
+		for (unsigned int i = 0; i < mit->second.size(); i++) {
+			const Failure &fl = mit->second[i];
+
+			put<uint8_t>(f, fl.requesttype);
+			put<uint8_t>(f, fl.request);
+			put<uint16_t>(f, fl.value);
+			put<uint16_t>(f, fl.index);
+			put<int32_t>(f, fl.error);
+		}
+	}
+
+	if (fclose(f) != 0 || rename(tmp.c_str(), path_.c_str()) < 0) {
+		ret = -errno;
+		unlink(tmp.c_str());
+		return ret;
+	}
+
+	dirty_ = false;
+	return 0;
+}
+
+void DescriptorCache::Attach(libusb_device_handle *handle,
+		const string &sysfs_name, const struct libusb_device_descriptor &desc)
+{
+	char serial[128], key[256];
+	uint64_t stamp, now;
+
+	if (!enabled_ || !handle || sysfs_name.empty())
+		return;
+
+	Handle &h = handles_[handle];
+	snprintf(key, sizeof(key), "%04x:%04x:%04x", desc.idVendor,
+			desc.idProduct, desc.bcdDevice);
+	h.model = key;
+
+	/* without the stamp, a replaced device could not be told apart */
+	stamp = read_descriptors_stamp(sysfs_name);
+	if (!stamp)
+		return;
+
+	read_sysfs_prop(serial, sizeof(serial), sysfs_name.c_str(), "serial");
+	snprintf(key, sizeof(key), "%s %04x:%04x %04x %s", sysfs_name.c_str(),
+			desc.idVendor, desc.idProduct, desc.bcdDevice, serial);
+
+	Device &dev = devices_[key];
+	if (dev.stamp != stamp) {
+		dev.stamp = stamp;
+		dev.entries.clear();
+		dirty_ = true;
+	}
+	/* to the day, which spares rewriting the cache on every run */
+	now = time(NULL);
+	if (dev.seen + SECS_PER_DAY <= now) {
+		dev.seen = now;
+		dirty_ = true;
+	}
+	h.device = key;
+}
+
+void DescriptorCache::ClearFailures()
+{
+	if (!failures_.empty())
+		dirty_ = true;
+	failures_.clear();
+}
+
+void DescriptorCache::Forget(libusb_device_handle *handle)
+{
+	map<libusb_device_handle *, Handle>::iterator it = handles_.find(handle);
+
+	if (it == handles_.end())
+		return;
+	if (!it->second.device.empty())
+		devices_[it->second.device].entries.clear();
+	failures_.erase(it->second.model);
+	dirty_ = true;
+}
+
+/*
+ * libusb may hand the freed pointer out again for another device, so
+ * the entry goes with the handle; the cached answers stay.
+ */
+void DescriptorCache::Detach(libusb_device_handle *handle)
+{
+	handles_.erase(handle);
+}
+
+void DescriptorCache::getDescriptors(libusb_device_handle *handle,
+		vector<Descriptor> &descs)
+{
+	map<libusb_device_handle *, Handle>::iterator it = handles_.find(handle);
+
+	if (it == handles_.end() || it->second.device.empty())
+		return;
+
+	const Device &dev = devices_[it->second.device];
+	for (unsigned int i = 0; i < dev.entries.size(); i++) {
+		const Entry &e = dev.entries[i];
+		Descriptor d;
+
+		d.requesttype = e.requesttype;
+		d.value = e.value;
+		d.index = e.index;
+		d.data = e.data;
+		descs.push_back(d);
+	}
+}
+
+int DescriptorCache::Control(libusb_device_handle *handle, uint8_t requesttype,
+		uint8_t request, uint16_t value, uint16_t index,
+		unsigned char *data, uint16_t size, unsigned int timeout)
+{
+	map<libusb_device_handle *, Handle>::iterator it;
+	const Failure *fail;
+	Device *dev = NULL;
+	Entry *e = NULL;
+	int ret;
+
+	if (!enabled_ || !(requesttype & LIBUSB_ENDPOINT_IN)
+			|| !is_optional(requesttype, request, index)
+			|| (it = handles_.find(handle)) == handles_.end())
+		return libusb_control_transfer(handle, requesttype, request,
+				value, index, data, size, timeout);
+
+	fail = find_failure(it->second.model, requesttype, request, value, index);
+	if (fail)
+		return fail->error;
+
+	if (request == LIBUSB_REQUEST_GET_DESCRIPTOR && !it->second.device.empty()) {
+		dev = &devices_[it->second.device];
+		e = find(*dev, requesttype, value, index);
+		if (e && (e->complete || e->data.size() >= size)) {
+			ret = e->data.size() < size ? e->data.size() : size;
+			memcpy(data, e->data.data(), ret);
+			return ret;
+		}
+	}
+
+	ret = libusb_control_transfer(handle, requesttype, request, value,
+			index, data, size, timeout);
+	if (ret == LIBUSB_ERROR_PIPE || ret == LIBUSB_ERROR_TIMEOUT) {
+		Failure f = { requesttype, request, value, index, ret };
+
+		failures_[it->second.model].push_back(f);
+		dirty_ = true;
+		return ret;
+	}
+	if (ret < 0 || !dev)
+		return ret;
+
+	if (!e) {
+		dev->entries.push_back(Entry());
+		e = &dev->entries.back();
+		e->requesttype = requesttype;
+		e->value = value;
+		e->index = index;
+	}
+	e->complete = ret < size;
+	e->data.assign(data, data + ret);
+	dirty_ = true;
+
+	return ret;
+}
+
+extern "C" int desc_cache_control(libusb_device_handle *dev,
+		uint8_t requesttype, uint8_t request, uint16_t value,
+		uint16_t index, unsigned char *data, uint16_t size,
+		unsigned int timeout)
+{
+	return DescriptorCache::Get().Control(dev, requesttype, request,
+			value, index, data, size, timeout);
+}
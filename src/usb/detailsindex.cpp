@@ -0,0 +1,183 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "detailsindex.h"
+
+#include <ctype.h>
+#include <algorithm>
+
+using namespace std;
+
+static string lower(const string &text)
+{
+	string s = text;
+
+	for (size_t i = 0; i < s.size(); i++)
+		s[i] = tolower((unsigned char)s[i]);
+	return s;
+}
+
+void DetailsIndex::tokenize(const string &text, vector<string> &tokens)
+{
+	size_t i = 0;
+
+	while (i < text.size()) {
+		size_t start;
+
+		while (i < text.size() && !isalnum((unsigned char)text[i]))
+			i++;
+		start = i;
+		while (i < text.size() && isalnum((unsigned char)text[i]))
+			i++;
+		if (i > start)
+			tokens.push_back(lower(text.substr(start, i - start)));
+	}
+}
+
+/* devices having a token containing token */
+void DetailsIndex::candidates(const string &token, set<unsigned int> &docs)
+{
+	map<string, set<unsigned int> >::iterator it;
+
+	for (it = postings_.lower_bound(token); it != postings_.end()
+			&& it->first.compare(0, token.size(), token) == 0; ++it)
+		docs.insert(it->second.begin(), it->second.end());
+}
+
+void DetailsIndex::Resize(unsigned int count)
+{
+	for (unsigned int i = count; i < docs_.size(); i++)
+		Remove(i);
+	docs_.resize(count);
+}
+
+bool DetailsIndex::IsIndexed(unsigned int device)
+{
+	return device < docs_.size() && docs_[device].indexed;
+}
+
+void DetailsIndex::Add(unsigned int device, const vector<string> &lines)
+{
+	if (device >= docs_.size())
+		docs_.resize(device + 1);
+	Remove(device);
+
+	Doc &doc = docs_[device];
+	for (unsigned int i = 0; i < lines.size(); i++) {
+		doc.lines.push_back(lower(lines[i]));
+		tokenize(lines[i], doc.tokens);
+	}
+	sort(doc.tokens.begin(), doc.tokens.end());
+	doc.tokens.erase(unique(doc.tokens.begin(), doc.tokens.end()),
+			doc.tokens.end());
+	for (unsigned int i = 0; i < doc.tokens.size(); i++) {
+		for (size_t k = 0; k < doc.tokens[i].size(); k++)
+			postings_[doc.tokens[i].substr(k)].insert(device);
+	}
+	doc.indexed = true;
+}
+
+void DetailsIndex::Remove(unsigned int device)
+{
+	if (device >= docs_.size())
+		return;
+
+	Doc &doc = docs_[device];
+	for (unsigned int i = 0; i < doc.tokens.size(); i++) {
+		for (size_t k = 0; k < doc.tokens[i].size(); k++) {
+			map<string, set<unsigned int> >::iterator it =
+				postings_.find(doc.tokens[i].substr(k));
+
+			/* a suffix shared by two tokens is already gone */
+			if (it == postings_.end())
+				continue;
+			it->second.erase(device);
+			if (it->second.empty())
+				postings_.erase(it);
+		}
+	}
+	doc.lines.clear();
+	doc.tokens.clear();
+	doc.indexed = false;
+}
+
+void DetailsIndex::Remap(const vector<int> &from)
+{
+	vector<int> to(docs_.size(), -1);
+	vector<Doc> docs(from.size());
+	map<string, set<unsigned int> >::iterator it;
+
+	for (unsigned int i = 0; i < from.size(); i++) {
+		if (from[i] < 0 || (unsigned int)from[i] >= docs_.size())
+			continue;
+		to[from[i]] = i;
+		docs[i].indexed = docs_[from[i]].indexed;
+		docs[i].lines.swap(docs_[from[i]].lines);
+		docs[i].tokens.swap(docs_[from[i]].tokens);
+	}
+
+	/* the tokens of the devices gone drop out of the postings here */
+	for (it = postings_.begin(); it != postings_.end(); ) {
+		set<unsigned int> devices;
+
+		for (set<unsigned int>::iterator d = it->second.begin();
+				d != it->second.end(); ++d) {
+			if (*d < to.size() && to[*d] >= 0)
+				devices.insert(to[*d]);
+		}
+		if (devices.empty()) {
+			postings_.erase(it++);
+		} else {
+			it->second.swap(devices);
+			++it;
+		}
+	}
+
+	docs_.swap(docs);
+}
+
+void DetailsIndex::Search(const string &query, vector<SearchMatch> &matches)
+{
+	string phrase = lower(query);
+	vector<string> tokens;
+	set<unsigned int> docs;
+
+	tokenize(query, tokens);
+	if (tokens.empty())
+		return;
+
+	candidates(tokens[0], docs);
+	for (unsigned int i = 1; i < tokens.size() && !docs.empty(); i++) {
+		set<unsigned int> more, both;
+
+		candidates(tokens[i], more);
+		set_intersection(docs.begin(), docs.end(), more.begin(),
+				more.end(), inserter(both, both.begin()));
+		docs.swap(both);
+	}
+
+	for (set<unsigned int>::iterator it = docs.begin(); it != docs.end(); ++it) {
+		const Doc &doc = docs_[*it];
+
+		for (unsigned int i = 0; i < doc.lines.size(); i++) {
+			if (doc.lines[i].find(phrase) == string::npos)
+				continue;
+			SearchMatch m = { *it, i };
+			matches.push_back(m);
+		}
+	}
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "hexdump.h"
+
+#include <stdio.h>
+
+using namespace std;
+
+/* " xx" for every byte value, so that a byte costs one 3 byte copy */
+struct HexTable {
+	char text[256][3];
+
+	HexTable()
+	{
+		static const char digits[] = "0123456789abcdef";
+
+		for (int i = 0; i < 256; i++) {
+			text[i][0] = ' ';
+			text[i][1] = digits[i >> 4];
+			text[i][2] = digits[i & 0xf];
+		}
+	}
+};
+
+static const HexTable hex_table;
+
+void hex_append(string &out, const unsigned char *buf, size_t len)
+{
+	size_t pos = out.size();
+	char *p;
+
+	if (!len)
+		return;
+
+	out.resize(pos + 3 * len);
+	p = &out[pos];
+	for (size_t i = 0; i < len; i++, p += 3) {
+		const char *t = hex_table.text[buf[i]];
+
+		p[0] = t[0];
+		p[1] = t[1];
+		p[2] = t[2];
+	}
+}
+
+void hex_dump(vector<string> &lines, const char *indent,
+		const unsigned char *buf, size_t len, unsigned int width)
+{
+	char offset[16];
+
+	if (!width)
+		width = 16;
+
+	for (size_t i = 0; i < len; i += width) {
+		string line = indent;
+
+		snprintf(offset, sizeof(offset), "%04zx:", i);
+		line += offset;
+		hex_append(line, buf + i, len - i < width ? len - i : width);
+		lines.push_back(line);
+	}
+}
@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "lineprinter.h"
+#include "hexdump.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+void LinePrinter::Print(const char *fmt, ...)
+{
+	char text[512];
+	const char *p, *nl;
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(text, sizeof(text), fmt, ap);
+	va_end(ap);
+
+	for (p = text; (nl = strchr(p, '\n')) != NULL; p = nl + 1) {
+		partial_.append(p, nl - p);
+		lines_.push_back(partial_);
+		partial_.clear();
+	}
+	partial_ += p;
+}
+
+void LinePrinter::Bytes(const unsigned char *buf, unsigned int len)
+{
+	/* not through Print(), whose buffer would cut long descriptors */
+	hex_append(partial_, buf, len);
+	lines_.push_back(partial_);
+	partial_.clear();
+}
+
+void LinePrinter::Junk(const unsigned char *buf, const char *indent, unsigned int len)
+{
+	if (buf[0] <= len)
+		return;
+
+	Print("%sjunk at descriptor end:", indent);
+	Bytes(buf + len, buf[0] - len);
+}
+
+bool LinePrinter::TooShort(const unsigned char *buf, const char *indent, unsigned int len)
+{
+	if (buf[0] >= len)
+		return false;
+
+	Flush();
+	Print("%sWarning: Descriptor too short:", indent);
+	Bytes(buf, buf[0]);
+	return true;
+}
+
+void LinePrinter::Flush()
+{
+	if (partial_.empty())
+		return;
+	lines_.push_back(partial_);
+	partial_.clear();
+}
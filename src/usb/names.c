@@ -245,6 +245,30 @@ int get_protocol_string(char *buf, size_t size, u_int8_t cls, u_int8_t subcls, u
 	return snprintf(buf, size, "%s", cp);
 }
 
+int get_audioterminal_string(char *buf, size_t size, u_int16_t termt)
+{
+	const char *cp;
+
+	if (size < 1)
+		return 0;
+	*buf = 0;
+	if (!(cp = names_audioterminal(termt)))
+		return 0;
+	return snprintf(buf, size, "%s", cp);
+}
+
+int get_videoterminal_string(char *buf, size_t size, u_int16_t termt)
+{
+	const char *cp;
+
+	if (size < 1)
+		return 0;
+	*buf = 0;
+	if (!(cp = names_videoterminal(termt)))
+		return 0;
+	return snprintf(buf, size, "%s", cp);
+}
+
 /* ---------------------------------------------------------------------- */
 
 static int hash_audioterminal(struct audioterminal *at)
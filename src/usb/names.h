@@ -40,6 +40,8 @@ int get_product_string(char *buf, size_t size, u_int16_t vid, u_int16_t pid);
 int get_class_string(char *buf, size_t size, u_int8_t cls);
 int get_subclass_string(char *buf, size_t size, u_int8_t cls, u_int8_t subcls);
 int get_protocol_string(char *buf, size_t size, u_int8_t cls, u_int8_t subcls, u_int8_t proto);
+int get_audioterminal_string(char *buf, size_t size, u_int16_t termt);
+int get_videoterminal_string(char *buf, size_t size, u_int16_t termt);
 
 int names_init(void);
 void names_exit(void);
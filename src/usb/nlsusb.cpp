@@ -0,0 +1,254 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "nlsusb.h"
+#include "usbcontext.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+struct nlsusb_context {
+	UsbContext usb;
+	bool hotplug;
+	nlsusb_hotplug_cb cb;
+	void *user_data;
+};
+
+/* an nlsusb_device is the UsbDevice itself */
+static UsbDevice *to_device(nlsusb_device *dev)
+{
+	return reinterpret_cast<UsbDevice *>(dev);
+}
+
+static void copy_string(char *dst, size_t size, const string &src)
+{
+	strncpy(dst, src.c_str(), size - 1);
+	dst[size - 1] = '\0';
+}
+
+int nlsusb_init(nlsusb_context **ctx)
+{
+	nlsusb_context *c = new nlsusb_context;
+	int r;
+
+	c->hotplug = false;
+	c->cb = NULL;
+	c->user_data = NULL;
+	r = c->usb.Init();
+	if (r < 0) {
+		delete c;
+		return r;
+	}
+	*ctx = c;
+	return 0;
+}
+
+void nlsusb_exit(nlsusb_context *ctx)
+{
+	if (!ctx)
+		return;
+	ctx->usb.Clean();
+	delete ctx;
+}
+
+int nlsusb_device_count(nlsusb_context *ctx)
+{
+	return ctx->usb.getUsbDevicesCount();
+}
+
+nlsusb_device *nlsusb_get_device(nlsusb_context *ctx, int index)
+{
+	if (index < 0 || index >= (int)ctx->usb.getUsbDevicesCount())
+		return NULL;
+	return reinterpret_cast<nlsusb_device *>(&ctx->usb.getUsbDevice(index));
+}
+
+int nlsusb_filter(nlsusb_context *ctx, const char *expression, int *indexes,
+		int max)
+{
+	vector<int> matching;
+	string error;
+
+	if (ctx->usb.filterDevices(expression, matching, error) < 0)
+		return LIBUSB_ERROR_INVALID_PARAM;
+	for (int i = 0; i < max && i < (int)matching.size(); i++)
+		indexes[i] = matching[i];
+	return matching.size();
+}
+
+int nlsusb_device_get_info(nlsusb_device *dev, struct nlsusb_device_info *info)
+{
+	UsbDevice *d = to_device(dev);
+	const struct libusb_device_descriptor &desc = d->getDescriptor();
+	struct nlsusb_device_info i;
+	vector<string> uas;
+	string hop;
+
+	if (!info || info->size < offsetof(struct nlsusb_device_info, bus))
+		return LIBUSB_ERROR_INVALID_PARAM;
+
+	memset(&i, 0, sizeof(i));
+	i.size = info->size < sizeof(i) ? info->size : sizeof(i);
+	i.bus = d->getBusNumber();
+	i.address = d->getDeviceAddr();
+	i.vendor_id = desc.idVendor;
+	i.product_id = desc.idProduct;
+	i.bcd_usb = desc.bcdUSB;
+	i.bcd_device = desc.bcdDevice;
+	i.device_class = desc.bDeviceClass;
+	i.device_subclass = desc.bDeviceSubClass;
+	i.device_protocol = desc.bDeviceProtocol;
+	i.speed = d->getSpeed();
+	i.capable_speed = d->getCapableSpeed();
+	d->getUasIssues(uas);
+	i.alert = d->getSpeedDowngrade(hop) || !uas.empty();
+	copy_string(i.path, sizeof(i.path), d->getSysfsName());
+	copy_string(i.vendor_name, sizeof(i.vendor_name), d->getVendorName());
+	copy_string(i.product_name, sizeof(i.product_name), d->getProductName());
+
+	/* as much as the caller's struct holds */
+	memcpy(info, &i, i.size);
+	return 0;
+}
+
+/*
+ * The whole tree is one allocation: the config, then the interfaces,
+ * then the endpoints of all interfaces.
+ */
+int nlsusb_device_get_config(nlsusb_device *dev, struct nlsusb_config **config)
+{
+	UsbDevice *d = to_device(dev);
+	struct libusb_config_descriptor *desc;
+	struct nlsusb_interface *intfs;
+	struct nlsusb_endpoint *eps;
+	struct nlsusb_config *c;
+	int n_intfs = 0, n_eps = 0, r;
+
+	if (!d->getLibusbDevice())
+		return LIBUSB_ERROR_NO_DEVICE;
+	r = libusb_get_active_config_descriptor(d->getLibusbDevice(), &desc);
+	if (r < 0)
+		return r;
+
+	for (int i = 0; i < desc->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &desc->interface[i];
+
+		n_intfs += intf->num_altsetting;
+		for (int j = 0; j < intf->num_altsetting; j++)
+			n_eps += intf->altsetting[j].bNumEndpoints;
+	}
+
+	c = (struct nlsusb_config *)calloc(1, sizeof(*c)
+			+ n_intfs * sizeof(*intfs) + n_eps * sizeof(*eps));
+	if (!c) {
+		libusb_free_config_descriptor(desc);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+	intfs = (struct nlsusb_interface *)(c + 1);
+	eps = (struct nlsusb_endpoint *)(intfs + n_intfs);
+
+	c->value = desc->bConfigurationValue;
+	c->attributes = desc->bmAttributes;
+	c->max_power_ma = desc->MaxPower
+		* (d->getDescriptor().bcdUSB >= 0x0300 ? 8 : 2);
+	c->num_interfaces = n_intfs;
+	c->interfaces = intfs;
+
+	for (int i = 0; i < desc->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &desc->interface[i];
+
+		for (int j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+
+			intfs->number = alt->bInterfaceNumber;
+			intfs->alt_setting = alt->bAlternateSetting;
+			intfs->interface_class = alt->bInterfaceClass;
+			intfs->interface_subclass = alt->bInterfaceSubClass;
+			intfs->interface_protocol = alt->bInterfaceProtocol;
+			intfs->num_endpoints = alt->bNumEndpoints;
+			intfs->endpoints = eps;
+			for (int k = 0; k < alt->bNumEndpoints; k++, eps++) {
+				const struct libusb_endpoint_descriptor *ep = &alt->endpoint[k];
+
+				eps->address = ep->bEndpointAddress;
+				eps->attributes = ep->bmAttributes;
+				eps->max_packet_size = ep->wMaxPacketSize;
+				eps->interval = ep->bInterval;
+			}
+			intfs++;
+		}
+	}
+
+	libusb_free_config_descriptor(desc);
+	*config = c;
+	return 0;
+}
+
+void nlsusb_free_config(struct nlsusb_config *config)
+{
+	free(config);
+}
+
+int nlsusb_device_get_string(nlsusb_device *dev, uint8_t index, char *buf,
+		size_t size)
+{
+	string s = to_device(dev)->getString(index);
+
+	if (!size)
+		return LIBUSB_ERROR_INVALID_PARAM;
+	copy_string(buf, size, s);
+	return s.size();
+}
+
+int nlsusb_device_get_details(nlsusb_device *dev, char **text)
+{
+	vector<string> lines;
+	string s;
+
+	to_device(dev)->getInfoDetails(lines);
+	for (unsigned int i = 0; i < lines.size(); i++)
+		s += lines[i] + "\n";
+
+	*text = strdup(s.c_str());
+	return *text ? (int)s.size() : LIBUSB_ERROR_NO_MEM;
+}
+
+int nlsusb_set_hotplug_callback(nlsusb_context *ctx, nlsusb_hotplug_cb cb,
+		void *user_data)
+{
+	if (!ctx->hotplug) {
+		int r = ctx->usb.startHotplug();
+
+		if (r < 0)
+			return r;
+		ctx->hotplug = true;
+	}
+	ctx->cb = cb;
+	ctx->user_data = user_data;
+	return 0;
+}
+
+int nlsusb_handle_events(nlsusb_context *ctx, int timeout_ms)
+{
+	if (ctx->usb.pollHotplug(timeout_ms) <= 0)
+		return 0;
+	if (ctx->cb)
+		ctx->cb(ctx, ctx->user_data);
+	return 1;
+}
@@ -0,0 +1,528 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbbandwidth.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+/*
+ * Bus time of a single transaction, as computed by usb_calc_bus_time()
+ * in the Linux USB core (drivers/usb/core/hcd.c).
+ */
+#define BW_HOST_DELAY		1000L		/* nanoseconds */
+#define BW_HUB_LS_SETUP		333L		/* nanoseconds */
+#define USB2_HOST_DELAY		5		/* nsec, guess */
+#define BitTime(bytecount)	(7 * 8 * (bytecount) / 6)
+#define HS_NSECS(bytes)		(((55 * 8 * 2083) \
+	+ (2083UL * (3 + BitTime(bytes))))/1000 \
+	+ USB2_HOST_DELAY)
+#define HS_NSECS_ISO(bytes)	(((38 * 8 * 2083) \
+	+ (2083UL * (3 + BitTime(bytes))))/1000 \
+	+ USB2_HOST_DELAY)
+
+/* scheduling periods and the share the host may reserve for periodic use */
+#define FRAME_NS		1000000UL
+#define MICROFRAME_NS		125000UL
+#define FS_PERIODIC_PERCENT	90
+#define HS_PERIODIC_PERCENT	80
+#define SS_PERIODIC_PERCENT	90
+
+#define BAR_WIDTH		10
+
+static unsigned long transaction_ns(int speed, int is_input, int isoc,
+		unsigned int bytecount)
+{
+	unsigned long tmp;
+
+	switch (speed) {
+	case LIBUSB_SPEED_LOW:
+		if (is_input) {
+			tmp = (67667L * (31L + 10L * BitTime(bytecount))) / 1000L;
+			return 64060L + (2 * BW_HUB_LS_SETUP) + BW_HOST_DELAY + tmp;
+		} else {
+			tmp = (66700L * (31L + 10L * BitTime(bytecount))) / 1000L;
+			return 64107L + (2 * BW_HUB_LS_SETUP) + BW_HOST_DELAY + tmp;
+		}
+	case LIBUSB_SPEED_HIGH:
+		return isoc ? HS_NSECS_ISO(bytecount) : HS_NSECS(bytecount);
+	case LIBUSB_SPEED_SUPER:
+		/* 5 Gbps, 8b/10b: 2ns per payload byte */
+		return 2UL * bytecount;
+	case LIBUSB_SPEED_SUPER_PLUS:
+		/* 10 Gbps, 128b/132b */
+		return 33UL * bytecount / 40;
+	case LIBUSB_SPEED_FULL:
+	default:
+		tmp = (8354L * (31L + 10L * BitTime(bytecount))) / 1000L;
+		if (isoc)
+			return ((is_input) ? 7268L : 6265L) + BW_HOST_DELAY + tmp;
+		return 9107L + BW_HOST_DELAY + tmp;
+	}
+}
+
+static string parent_sysfs_name(const string &name, int bus)
+{
+	size_t dot = name.rfind('.');
+	char root[16];
+
+	if (dot != string::npos)
+		return name.substr(0, dot);
+
+	snprintf(root, sizeof(root), "usb%d", bus);
+	return root;
+}
+
+/* port number on the parent hub, i.e. the last component of the path */
+static int port_on_parent(const string &name)
+{
+	size_t sep = name.find_last_of(".-");
+
+	if (sep == string::npos)
+		return 0;
+	return atoi(name.c_str() + sep + 1);
+}
+
+static void format_us(char *buf, size_t size, unsigned long ns)
+{
+	snprintf(buf, size, "%lu.%lu us", ns / 1000, (ns % 1000) / 100);
+}
+
+static string make_bar(unsigned long used, unsigned long budget)
+{
+	char bar[BAR_WIDTH + 16];
+	unsigned long filled, pct;
+
+	if (!budget)
+		return "";
+
+	pct = (used * 100 + budget / 2) / budget;
+	filled = (used * BAR_WIDTH + budget / 2) / budget;
+	if (used && !filled)
+		filled = 1;
+	if (filled > BAR_WIDTH)
+		filled = BAR_WIDTH;
+
+	bar[0] = '[';
+	memset(bar + 1, '#', filled);
+	memset(bar + 1 + filled, '-', BAR_WIDTH - filled);
+	snprintf(bar + 1 + BAR_WIDTH, sizeof(bar) - 1 - BAR_WIDTH,
+			"] %3lu%%", pct);
+	return bar;
+}
+
+int UsbBandwidth::getDomain(const string &name, int speed)
+{
+	map<string, int>::iterator it = domain_ids_.find(name);
+
+	if (it != domain_ids_.end())
+		return it->second;
+
+	Domain d;
+	d.name = name;
+	d.used_ns = 0;
+	if (speed >= LIBUSB_SPEED_SUPER) {
+		d.period_ns = MICROFRAME_NS;
+		d.budget_ns = MICROFRAME_NS * SS_PERIODIC_PERCENT / 100;
+	} else if (speed == LIBUSB_SPEED_HIGH) {
+		d.period_ns = MICROFRAME_NS;
+		d.budget_ns = MICROFRAME_NS * HS_PERIODIC_PERCENT / 100;
+	} else {
+		d.period_ns = FRAME_NS;
+		d.budget_ns = FRAME_NS * FS_PERIODIC_PERCENT / 100;
+	}
+
+	domains_.push_back(d);
+	domain_ids_[name] = domains_.size() - 1;
+	return domains_.size() - 1;
+}
+
+/* bus time one endpoint reserves, averaged over a domain period */
+static unsigned long endpoint_ns(int speed, const PeriodicEndpoint &ep,
+		unsigned long domain_period_ns)
+{
+	unsigned long period_ns = ep.period_us * 1000UL;
+	unsigned long ns;
+
+	if (speed >= LIBUSB_SPEED_SUPER)
+		ns = transaction_ns(speed, 0, 0, ep.bytes);
+	else
+		ns = ep.packets * transaction_ns(speed,
+			ep.address & LIBUSB_ENDPOINT_IN,
+			ep.type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS,
+			ep.maxp);
+
+	/* average over the endpoint's service interval */
+	if (period_ns > domain_period_ns)
+		ns = ns * domain_period_ns / period_ns;
+
+	return ns;
+}
+
+int UsbBandwidth::findDomain(vector<UsbDevice> &devices,
+		const map<string, int> &by_name, unsigned int index)
+{
+	UsbDevice &dev = devices[index];
+	int speed = dev.getSpeed();
+	char name[128];
+
+	if (speed >= LIBUSB_SPEED_SUPER) {
+		snprintf(name, sizeof(name), "Bus %03d SuperSpeed",
+				dev.getBusNumber());
+		return getDomain(name, speed);
+	}
+	if (speed == LIBUSB_SPEED_HIGH) {
+		snprintf(name, sizeof(name), "Bus %03d High Speed",
+				dev.getBusNumber());
+		return getDomain(name, speed);
+	}
+
+	/*
+	 * Full and low speed traffic is scheduled by the nearest high speed
+	 * hub's TT, or by the bus itself when there is no high speed hop
+	 * upstream.
+	 */
+	string child = dev.getSysfsName();
+	string up = parent_sysfs_name(child, dev.getBusNumber());
+
+	name[0] = '\0';
+	while (true) {
+		map<string, int>::const_iterator it = by_name.find(up);
+
+		if (it == by_name.end())
+			break;
+
+		UsbDevice &hub = devices[it->second];
+		if (hub.isRootHub()) {
+			if (hub.getSpeed() >= LIBUSB_SPEED_HIGH)
+				snprintf(name, sizeof(name),
+					"Bus %03d root port %d Full Speed",
+					dev.getBusNumber(),
+					port_on_parent(child));
+			break;
+		}
+		if (hub.getSpeed() == LIBUSB_SPEED_HIGH) {
+			if (hub.getDeviceProtocol() == 2)
+				snprintf(name, sizeof(name),
+					"Hub %s TT (port %d)",
+					up.c_str(), port_on_parent(child));
+			else
+				snprintf(name, sizeof(name),
+					"Hub %s TT", up.c_str());
+			break;
+		}
+		child = up;
+		up = parent_sysfs_name(up, dev.getBusNumber());
+	}
+	if (!name[0])
+		snprintf(name, sizeof(name), "Bus %03d Full Speed",
+				dev.getBusNumber());
+	return getDomain(name, speed);
+}
+
+void UsbBandwidth::Compute(vector<UsbDevice> &devices)
+{
+	map<string, int> by_name;
+
+	domains_.clear();
+	domain_ids_.clear();
+	device_domain_.assign(devices.size(), -1);
+	device_ns_.assign(devices.size(), 0);
+
+	for (unsigned int i = 0; i < devices.size(); i++)
+		by_name[devices[i].getSysfsName()] = i;
+
+	for (unsigned int i = 0; i < devices.size(); i++) {
+		UsbDevice &dev = devices[i];
+		vector<PeriodicEndpoint> eps;
+		vector<VideoMode> modes;
+		vector<AudioAltsetting> audio;
+		int speed = dev.getSpeed();
+		int domain;
+
+		if (dev.isRootHub() || dev.getSysfsName().empty())
+			continue;
+
+		dev.getPeriodicEndpoints(eps);
+		dev.getVideoModes(modes);
+		dev.getAudioAltsettings(audio);
+		if (eps.empty() && modes.empty() && audio.empty())
+			continue;
+
+		domain = findDomain(devices, by_name, i);
+
+		Domain &d = domains_[domain];
+		Member m;
+		char label[160];
+
+		snprintf(label, sizeof(label), "Bus %03d Device %03d: ID %04x:%04x %s",
+				dev.getBusNumber(), dev.getDeviceAddr(),
+				dev.getIdVendor(), dev.getIdProduct(),
+				dev.getProductName().c_str());
+		m.device_index = i;
+		m.label = label;
+		m.ns = 0;
+
+		for (unsigned int j = 0; j < eps.size(); j++) {
+			Endpoint e;
+
+			e.ep = eps[j];
+			e.ns = endpoint_ns(speed, eps[j], d.period_ns);
+			m.endpoints.push_back(e);
+			m.ns += e.ns;
+		}
+
+		if (!modes.empty()) {
+			VideoDevice v;
+
+			v.label = label;
+			v.current_ns = m.ns;
+			v.modes = modes;
+			for (unsigned int j = 0; j < modes.size(); j++)
+				v.mode_ns.push_back(modes[j].fits ?
+					endpoint_ns(speed, modes[j].ep, d.period_ns) : 0);
+			d.video.push_back(v);
+		}
+
+		if (!audio.empty()) {
+			map<uint8_t, unsigned long> largest;
+			AudioDevice a;
+
+			a.label = label;
+			a.current_ns = m.ns;
+			a.max_ns = 0;
+			for (unsigned int j = 0; j < audio.size(); j++) {
+				unsigned long ns = endpoint_ns(speed, audio[j].ep,
+						d.period_ns);
+				unsigned long &l = largest[audio[j].ep.interface];
+
+				if (ns > l)
+					l = ns;
+			}
+			for (map<uint8_t, unsigned long>::iterator it = largest.begin();
+					it != largest.end(); ++it)
+				a.max_ns += it->second;
+			d.audio.push_back(a);
+		}
+
+		if (eps.empty())
+			continue;
+
+		d.used_ns += m.ns;
+		d.members.push_back(m);
+		device_domain_[i] = domain;
+		device_ns_[i] = m.ns;
+	}
+}
+
+string UsbBandwidth::getDeviceBar(int device_index)
+{
+	if (device_index < 0 || device_index >= (int)device_domain_.size()
+			|| device_domain_[device_index] < 0)
+		return string(BAR_WIDTH + 7, ' ');
+
+	return make_bar(device_ns_[device_index],
+			domains_[device_domain_[device_index]].budget_ns);
+}
+
+/* the mode moving the most data among those reserving at most limit_ns */
+static int largest_mode(const UsbBandwidth::VideoDevice &v, unsigned long limit_ns)
+{
+	int best = -1;
+
+	for (unsigned int i = 0; i < v.modes.size(); i++) {
+		if (!v.modes[i].fits || v.mode_ns[i] > limit_ns)
+			continue;
+		if (best < 0 || v.modes[i].bytes_per_sec > v.modes[best].bytes_per_sec)
+			best = i;
+	}
+	return best;
+}
+
+static string describe_mode(const UsbBandwidth::VideoDevice &v, int i)
+{
+	char buf[128], ns[32];
+
+	if (i < 0)
+		return "none";
+
+	const VideoMode &m = v.modes[i];
+
+	format_us(ns, sizeof(ns), v.mode_ns[i]);
+	snprintf(buf, sizeof(buf), "%s %ux%u @ %.2f fps (alt %u, %s)",
+			m.format, m.width, m.height, 10000000.0 / m.interval,
+			m.ep.altsetting, ns);
+	return buf;
+}
+
+/*
+ * Which video modes can still be started next to the traffic already
+ * reserved in a domain, and whether the cameras sharing it can all run
+ * their largest modes at once.
+ */
+void UsbBandwidth::getVideoBreakdown(const Domain &d, vector<string> &info)
+{
+	unsigned long video_ns = 0, others_ns, free_ns, together_ns = 0;
+	char line[256], used[32], budget[32];
+
+	for (unsigned int i = 0; i < d.video.size(); i++)
+		video_ns += d.video[i].current_ns;
+	others_ns = d.used_ns - video_ns;
+	free_ns = d.budget_ns > others_ns ? d.budget_ns - others_ns : 0;
+
+	info.push_back("  Video modes:");
+	for (unsigned int i = 0; i < d.video.size(); i++) {
+		const VideoDevice &v = d.video[i];
+		unsigned long alone_ns = free_ns - (video_ns - v.current_ns);
+		unsigned int fit = 0;
+		int best;
+
+		if (video_ns - v.current_ns > free_ns)
+			alone_ns = 0;
+		for (unsigned int j = 0; j < v.modes.size(); j++) {
+			if (v.modes[j].fits && v.mode_ns[j] <= alone_ns)
+				fit++;
+		}
+		best = largest_mode(v, alone_ns);
+		together_ns += best >= 0 ? v.mode_ns[best] : 0;
+
+		snprintf(line, sizeof(line), "  %-56.56s", v.label.c_str());
+		info.push_back(line);
+		snprintf(line, sizeof(line), "    %u of %u modes can start, largest %s",
+				fit, (unsigned int)v.modes.size(),
+				describe_mode(v, best).c_str());
+		info.push_back(line);
+		if (d.video.size() > 1) {
+			snprintf(line, sizeof(line), "    sharing equally with the other cameras: %s",
+					describe_mode(v, largest_mode(v,
+						free_ns / d.video.size())).c_str());
+			info.push_back(line);
+		}
+	}
+
+	if (d.video.size() > 1 && together_ns > free_ns) {
+		format_us(used, sizeof(used), together_ns);
+		format_us(budget, sizeof(budget), free_ns);
+		snprintf(line, sizeof(line),
+				"    largest modes cannot run simultaneously: %s of %s left",
+				used, budget);
+		info.push_back(line);
+	}
+}
+
+/*
+ * Audio streams sharing a domain, as reserved now and with every
+ * streaming interface opened at its largest altsetting.
+ */
+void UsbBandwidth::getAudioBreakdown(const Domain &d, vector<string> &info)
+{
+	unsigned long now_ns = 0, max_ns = 0, others_ns;
+	char line[256], now[32], max[32], budget[32];
+
+	info.push_back("  Audio streams:");
+	for (unsigned int i = 0; i < d.audio.size(); i++) {
+		const AudioDevice &a = d.audio[i];
+
+		now_ns += a.current_ns;
+		max_ns += a.max_ns;
+		format_us(now, sizeof(now), a.current_ns);
+		format_us(max, sizeof(max), a.max_ns);
+		snprintf(line, sizeof(line), "  %-56.56s %10s, all open %10s",
+				a.label.c_str(), now, max);
+		info.push_back(line);
+	}
+
+	others_ns = d.used_ns - now_ns;
+	format_us(now, sizeof(now), now_ns);
+	format_us(max, sizeof(max), max_ns + others_ns);
+	format_us(budget, sizeof(budget), d.budget_ns);
+	snprintf(line, sizeof(line), "    audio now %s, with all streams open %s of %s%s",
+			now, max, budget,
+			max_ns + others_ns > d.budget_ns ? "  OVERSUBSCRIBED" : "");
+	info.push_back(line);
+}
+
+bool UsbBandwidth::memberCmp(const Member &a, const Member &b)
+{
+	return a.ns > b.ns;
+}
+
+void UsbBandwidth::getBreakdown(vector<string> &info)
+{
+	static const char * const types[] = { "Ctrl", "Isoc", "Bulk", "Int" };
+	char line[256];
+	char used[32], budget[32], ns[32];
+
+	info.push_back("Periodic Bandwidth:");
+	if (domains_.empty()) {
+		info.push_back("  no interrupt or isochronous endpoints in use");
+		return;
+	}
+
+	for (map<string, int>::iterator it = domain_ids_.begin();
+			it != domain_ids_.end(); ++it) {
+		Domain &d = domains_[it->second];
+
+		sort(d.members.begin(), d.members.end(), memberCmp);
+
+		format_us(used, sizeof(used), d.used_ns);
+		format_us(budget, sizeof(budget), d.budget_ns);
+
+		info.push_back(" ");
+		snprintf(line, sizeof(line), "%s (%s %s)", d.name.c_str(),
+				d.period_ns == FRAME_NS ? "1 ms" : "125 us",
+				d.period_ns == FRAME_NS ? "frame" : "microframe");
+		info.push_back(line);
+		snprintf(line, sizeof(line), "  %s  %s of %s%s",
+				make_bar(d.used_ns, d.budget_ns).c_str(),
+				used, budget,
+				d.used_ns > d.budget_ns ? "  OVERSUBSCRIBED" : "");
+		info.push_back(line);
+
+		for (unsigned int i = 0; i < d.members.size(); i++) {
+			Member &m = d.members[i];
+
+			format_us(ns, sizeof(ns), m.ns);
+			snprintf(line, sizeof(line), "  %-56.56s %10s",
+					m.label.c_str(), ns);
+			info.push_back(line);
+
+			for (unsigned int j = 0; j < m.endpoints.size(); j++) {
+				const PeriodicEndpoint &ep = m.endpoints[j].ep;
+
+				format_us(ns, sizeof(ns), m.endpoints[j].ns);
+				snprintf(line, sizeof(line),
+					"    If %u Alt %u EP 0x%02x %-4s %-3s %ux%u B every %u us %10s",
+					ep.interface, ep.altsetting, ep.address,
+					types[ep.type & 3],
+					(ep.address & LIBUSB_ENDPOINT_IN) ? "IN" : "OUT",
+					ep.packets, ep.packets ? ep.bytes / ep.packets : 0,
+					ep.period_us, ns);
+				info.push_back(line);
+			}
+		}
+
+		if (!d.video.empty())
+			getVideoBreakdown(d, info);
+		if (!d.audio.empty())
+			getAudioBreakdown(d, info);
+	}
+}
@@ -16,10 +16,17 @@
 */
 
 #include "usbcontext.h"
+#include "desccache.h"
 #include "string.h"
+#include <algorithm>
 
 
 UsbContext::UsbContext()
+	: ctx_(NULL),
+	monitor_source_("/dev/usbmon0"),
+	hex_width_(16),
+	hotplug_(0),
+	hotplug_pending_(false)
 {
 }
 
@@ -40,6 +47,9 @@ int UsbContext::Init()
 	r = libusb_init(&ctx_);
 	if (r < 0)
 		return r;
+
+	/* a missing or damaged cache only means probing the devices again */
+	DescriptorCache::Get().Load();
 		
 	libusb_device **devs;
 
@@ -50,24 +60,180 @@ int UsbContext::Init()
 	libusb_device *dev;
 	int i = 0;
 
-	while ((dev = devs[i++]) != NULL) {
-		UsbDevice *usbDev = new UsbDevice(dev);
-		if (usbDev)
-			usb_devices_.push_back(*usbDev);
+	while ((dev = devs[i++]) != NULL)
+		add_device(dev);
+
+	libusb_free_device_list(devs, 1);
+
+	bandwidth_.Compute(usb_devices_);
+	index_.Resize(usb_devices_.size());
+
+	return 0;
+}
+
+void UsbContext::add_device(libusb_device *dev)
+{
+	if (!selector_.IsEmpty() && !selector_.Match(dev))
+		return;
+
+	usb_devices_.push_back(UsbDevice(dev));
+	usb_devices_.back().setMonitor(&monitor_);
+	usb_devices_.back().setContext(ctx_);
+}
+
+int LIBUSB_CALL UsbContext::hotplug_cb(libusb_context *ctx,
+		libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+	((UsbContext *)user_data)->hotplug_pending_ = true;
+	return 0;
+}
+
+int UsbContext::startHotplug()
+{
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+
+	/* the devices already there were enumerated by Init() */
+	return libusb_hotplug_register_callback(ctx_,
+			(libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+				| LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+			(libusb_hotplug_flag)0, LIBUSB_HOTPLUG_MATCH_ANY,
+			LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+			hotplug_cb, this, &hotplug_);
+}
+
+/* returns 1 if the device list changed */
+int UsbContext::pollHotplug(int timeout_ms)
+{
+	struct timeval tv;
+
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	libusb_handle_events_timeout_completed(ctx_, &tv, NULL);
+	if (!hotplug_pending_)
+		return 0;
+
+	hotplug_pending_ = false;
+	return Rescan() < 0 ? 0 : 1;
+}
+
+/*
+ * Brings the device list in line with the bus: devices that are still
+ * there keep their open handle and cached answers, the ones gone are
+ * closed and new ones are probed. Indexes follow libusb's order: the
+ * details index moves the entries of the devices that stayed to their
+ * new index and only drops the others.
+ *
+ * The kept devices are copied into the new list and the old objects
+ * destroyed. Copies share the port watch state, but port watches are
+ * still stopped before the list is rebuilt and started again on the
+ * devices that stayed, so no transfer completes halfway through.
+ */
+int UsbContext::Rescan()
+{
+	vector<UsbDevice> devices;
+	vector<int> old_index, from;
+	vector<libusb_device *> watched;
+	libusb_device **devs;
+	ssize_t cnt;
+
+	cnt = libusb_get_device_list(ctx_, &devs);
+	if (cnt < 0)
+		return (int) cnt;
+
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		if (!usb_devices_[i].isWatchingPorts())
+			continue;
+		usb_devices_[i].StopPortWatch();
+		watched.push_back(usb_devices_[i].getLibusbDevice());
 	}
 
+	usb_devices_.swap(devices);
+	for (unsigned int j = 0; j < devices.size(); j++)
+		old_index.push_back(j);
+	for (ssize_t i = 0; i < cnt; i++) {
+		unsigned int count = usb_devices_.size();
+		unsigned int j;
+
+		for (j = 0; j < devices.size(); j++) {
+			if (devices[j].getLibusbDevice() == devs[i])
+				break;
+		}
+		if (j < devices.size()) {
+			usb_devices_.push_back(devices[j]);
+			from.push_back(old_index[j]);
+			devices.erase(devices.begin() + j);
+			old_index.erase(old_index.begin() + j);
+		} else {
+			add_device(devs[i]);
+			/* unless the selector left it out */
+			if (usb_devices_.size() > count)
+				from.push_back(-1);
+		}
+	}
 	libusb_free_device_list(devs, 1);
+
+	for (unsigned int j = 0; j < devices.size(); j++)
+		devices[j].Close();
+
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		if (find(watched.begin(), watched.end(),
+				usb_devices_[i].getLibusbDevice()) != watched.end())
+			usb_devices_[i].StartPortWatch();
+	}
+
+	bandwidth_.Compute(usb_devices_);
+	index_.Remap(from);
+	return usb_devices_.size();
 }
 
 void UsbContext::getUsbDevicesList(vector<string> &list)
 {
-	for (UsbDevice device : usb_devices_) {
-		list.push_back (device.getInfoSummary());
+	for (unsigned int i = 0; i < usb_devices_.size(); i++)
+		list.push_back(getUsbDeviceSummary(i));
+}
+
+void UsbContext::getUsbDevicesBriefList(vector<string> &list)
+{
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		list.push_back (bandwidth_.getDeviceBar(i) + " "
+				+ usb_devices_[i].getInfoBrief());
 	}
 }
 
+string UsbContext::getUsbDeviceSummary(int index)
+{
+	return bandwidth_.getDeviceBar(index) + " "
+		+ usb_devices_[index].getInfoSummary();
+}
+
+/*
+ * Devices needing attention: running below the speed they support, or
+ * offering UAS but stuck on bulk-only.
+ */
+bool UsbContext::getUsbDeviceAlert(int index)
+{
+	vector<string> uas;
+	string hop;
+
+	usb_devices_[index].getUasIssues(uas);
+	return usb_devices_[index].getSpeedDowngrade(hop) || !uas.empty();
+}
+
+void UsbContext::getUsbDevicesAlerts(vector<bool> &alerts)
+{
+	for (unsigned int i = 0; i < usb_devices_.size(); i++)
+		alerts.push_back(getUsbDeviceAlert(i));
+}
+
 void UsbContext::Clean()
 {
+	monitor_.Close();
+	if (hotplug_)
+		libusb_hotplug_deregister_callback(ctx_, hotplug_);
+	for (unsigned int i = 0; i < usb_devices_.size(); i++)
+		usb_devices_[i].StopPortWatch();
+	DescriptorCache::Get().Save();
 	names_exit();
 	libusb_exit(ctx_);
 }
@@ -75,4 +241,129 @@ void UsbContext::Clean()
 void UsbContext::getUsbDeviceInfo(int index, vector<string> &list)
 {
 	usb_devices_[index].getInfoDetails(list);
+	/* hub details carry live port status: index what was just read */
+	index_.Add(index, list);
+}
+
+void UsbContext::reprobeDevice(int index)
+{
+	usb_devices_[index].Reprobe();
+	index_.Remove(index);
+}
+
+/*
+ * Devices never shown get their details read and indexed on the first
+ * search; later searches only look at the index.
+ */
+void UsbContext::searchDevices(const string &query, vector<SearchMatch> &matches)
+{
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		vector<string> details;
+
+		if (index_.IsIndexed(i))
+			continue;
+		usb_devices_[i].getInfoDetails(details);
+		index_.Add(i, details);
+	}
+
+	index_.Search(query, matches);
+}
+
+int UsbContext::filterDevices(const string &query, vector<int> &matching,
+		string &error)
+{
+	UsbQuery q;
+
+	if (!q.Compile(query, error))
+		return -1;
+
+	matching.clear();
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		if (q.IsEmpty() || q.Match(usb_devices_[i]))
+			matching.push_back(i);
+	}
+	return matching.size();
+}
+
+void UsbContext::getBandwidthInfo(vector<string> &list)
+{
+	bandwidth_.getBreakdown(list);
+}
+
+int UsbContext::startMonitor()
+{
+	if (monitor_.IsOpen())
+		return 0;
+	return monitor_.Open(monitor_source_);
+}
+
+void UsbContext::stopMonitor()
+{
+	monitor_.Close();
+}
+
+int UsbContext::pollMonitor()
+{
+	return monitor_.Poll();
+}
+
+void UsbContext::getTrafficInfo(vector<string> &list)
+{
+	map<int, string> labels;
+	char label[128];
+
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		UsbDevice &dev = usb_devices_[i];
+
+		snprintf(label, sizeof(label), "%03d:%03d %04x:%04x %s",
+				dev.getBusNumber(), dev.getDeviceAddr(),
+				dev.getIdVendor(), dev.getIdProduct(),
+				dev.getProductName().c_str());
+		labels[(dev.getBusNumber() << 8) | dev.getDeviceAddr()] = label;
+	}
+
+	monitor_.getTopList(list, labels);
+}
+
+/*
+ * Starts watching the ports of a hub, or stops if it was already watched.
+ * Returns 1 when watching, 0 when stopped, < 0 on error.
+ */
+int UsbContext::toggleHubWatch(int index)
+{
+	UsbDevice &dev = usb_devices_[index];
+	int r;
+
+	if (dev.isWatchingPorts()) {
+		dev.StopPortWatch();
+		return 0;
+	}
+
+	r = dev.StartPortWatch();
+	return r < 0 ? r : 1;
+}
+
+bool UsbContext::isWatchingHubs()
+{
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		if (usb_devices_[i].isWatchingPorts())
+			return true;
+	}
+	return false;
+}
+
+int UsbContext::pollHubWatch()
+{
+	int changed = 0;
+
+	for (unsigned int i = 0; i < usb_devices_.size(); i++) {
+		if (usb_devices_[i].isWatchingPorts())
+			changed += usb_devices_[i].PollPortWatch(0);
+	}
+	return changed;
+}
+
+void UsbContext::getHubWatchInfo(int index, vector<string> &list)
+{
+	usb_devices_[index].getPortWatchInfo(list);
 }
\ No newline at end of file
@@ -20,20 +20,37 @@
 #include "usbdevice.h"
 #include "names.h"
 #include "usbmisc.h"
+#include "desccache.h"
+#include "hexdump.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 using namespace std;
 
 UsbDevice::UsbDevice(libusb_device *dev)
-	: dev_handle_(NULL)
+	: speed_(LIBUSB_SPEED_UNKNOWN),
+	capable_speed_(-1),
+	dev_handle_(NULL),
+	usb_dev_(NULL),
+	monitor_(NULL),
+	cur_config_(0),
+	cur_endpoint_(NULL),
+	ctx_(NULL)
 {
 	FillDeviceInfo(dev);
 }
 
 UsbDevice::UsbDevice()
-	: dev_handle_(NULL)
+	: speed_(LIBUSB_SPEED_UNKNOWN),
+	capable_speed_(-1),
+	dev_handle_(NULL),
+	usb_dev_(NULL),
+	monitor_(NULL),
+	cur_config_(0),
+	cur_endpoint_(NULL),
+	ctx_(NULL)
 {
 }
 
@@ -43,6 +60,24 @@ UsbDevice::~UsbDevice()
 	//	libusb_close(dev_handle_);
 }
 
+/*
+ * Devices are copied around by value, so the handle can't be closed by
+ * the destructor; whoever drops a device for good calls Close().
+ */
+void UsbDevice::Close()
+{
+	StopPortWatch();
+	if (dev_handle_) {
+		DescriptorCache::Get().Detach(dev_handle_);
+		libusb_close(dev_handle_);
+		dev_handle_ = NULL;
+	}
+	if (usb_dev_) {
+		libusb_unref_device(usb_dev_);
+		usb_dev_ = NULL;
+	}
+}
+
 void UsbDevice::FillDeviceInfo(libusb_device *dev)
 {
 	int r = libusb_get_device_descriptor(dev, &descriptor_);
@@ -51,12 +86,18 @@ void UsbDevice::FillDeviceInfo(libusb_device *dev)
 		return;
 	}
 	
-	usb_dev_ = dev;
+	/* keep the device alive once the context frees its device list */
+	usb_dev_ = libusb_ref_device(dev);
 
 	id_vendor_ = descriptor_.idVendor;
 	id_product_ = descriptor_.idProduct;
 	bus_num_ = libusb_get_bus_number(dev);
 	device_addr_ = libusb_get_device_address(dev);
+	speed_ = libusb_get_device_speed(dev);
+
+	char sysfs_name[32];
+	if (get_sysfs_name(sysfs_name, sizeof(sysfs_name), dev) >= 0)
+		sysfs_name_ = sysfs_name;
 
 	char vendor[128], product[128];
 
@@ -70,9 +111,51 @@ void UsbDevice::FillDeviceInfo(libusb_device *dev)
 	r = libusb_open(dev, &dev_handle_);
 	if (r) {
 		dev_handle_ = NULL;
+		return;
 	}
+	DescriptorCache::Get().Attach(dev_handle_, sysfs_name_, descriptor_);
 }
  
+/*
+ * bConfigurationValue of the active configuration, 0 if unconfigured or
+ * unknown. Read from sysfs so that no request goes to the device.
+ */
+int UsbDevice::getActiveConfig()
+{
+	char value[16];
+
+	if (sysfs_name_.empty()
+			|| read_sysfs_prop(value, sizeof(value), sysfs_name_.c_str(),
+				"bConfigurationValue") <= 0)
+		return 0;
+
+	return atoi(value);
+}
+
+string UsbDevice::getString(uint8_t index)
+{
+	char *str;
+	string s;
+
+	if (!dev_handle_ || !index)
+		return s;
+	str = get_dev_string(dev_handle_, index);
+	if (strcmp(str, "(error)"))
+		s = str;
+	free(str);
+	return s;
+}
+
+/* what is known without reading anything: shown until the summary is ready */
+string UsbDevice::getInfoBrief()
+{
+	char deviceInfoBuf[64];
+
+	snprintf(deviceInfoBuf, sizeof(deviceInfoBuf), "Bus %03d Device %03d: ID %04x:%04x",
+			getBusNumber(), getDeviceAddr(), getIdVendor(), getIdProduct());
+	return deviceInfoBuf;
+}
+
 string UsbDevice::getInfoSummary()
 {
 	char deviceInfoBuf[128];
@@ -85,6 +168,15 @@ string UsbDevice::getInfoSummary()
 			getProductName().c_str() );
 
 	string info = deviceInfoBuf;
+	vector<string> uas;
+	string hop;
+
+	if (getSpeedDowngrade(hop))
+		info += string("  [") + getSpeedName(getCapableSpeed()) + " at "
+			+ getSpeedName(speed_) + ": " + hop + "]";
+	getUasIssues(uas);
+	if (!uas.empty())
+		info += "  [UAS unused]";
 	return info;
 }
 
@@ -112,7 +204,12 @@ void UsbDevice::getInfoDetails(vector<string> &info)
 		}
 
 		dump_configs(info);
+		dump_video_bandwidth(info);
+		dump_audio_bandwidth(info);
+		dump_storage_info(info);
 	}
+
+	dump_speed_info(info);
 	
 	if (!dev_handle_)
 		return;
@@ -270,36 +367,25 @@ int UsbDevice::do_otg(struct libusb_config_descriptor *config, vector<string> &o
 	return 1;
 }
 
-void UsbDevice::dump_bytes(
-		const unsigned char *buf,
-		unsigned int len,
-		char **bytes_str,
-		unsigned int max_str_len)
+/* appends " xx" for each byte to line */
+void UsbDevice::dump_bytes(const unsigned char *buf, unsigned int len, string &line)
 {
-	char new_byte[10];
-	for (int i = 0; i < len; i++) {
-		snprintf(new_byte, 10, " %02x", buf[i]);
-		strncat(*bytes_str, new_byte, max_str_len);
-	}
+	hex_append(line, buf, len);
 }
 
-void UsbDevice::dump_junk(
-	const unsigned char *buf,
-	const char *indent,
-	unsigned int len,
-	char **junk_str,
-	unsigned int max_str_len)
+/* adds a line with the bytes of buf past len, if bLength says there are any */
+void UsbDevice::dump_junk(const unsigned char *buf, const char *indent,
+		unsigned int len, vector<string> &info)
 {
+	string junk;
+
 	if (buf[0] <= len)
 		return;
 
-	snprintf(*junk_str, max_str_len, "%sjunk at descriptor end:", indent);
-
-	char new_byte[10];
-	for (int i = len; i < buf[0]; i++) {
-		snprintf(new_byte, 10, " %02x", buf[i]);
-		strncat(*junk_str, new_byte, max_str_len);
-	}
+	junk = indent;
+	junk += "junk at descriptor end:";
+	hex_append(junk, buf + len, buf[0] - len);
+	info.push_back(junk);
 }
 
 void UsbDevice::do_dualspeed(vector<string> &info)
@@ -543,9 +629,9 @@ void UsbDevice::dump_device_status(int otg, int wireless, int super_speed, vecto
 		status_info.push_back(line);
 		return;
 	}
-	snprintf(line, 128, "MAS Availability:    ");
-	dump_bytes(status, 8, (char **)&line, 128);
-	status_info.push_back(line);
+	string mas = "MAS Availability:    ";
+	dump_bytes(status, 8, mas);
+	status_info.push_back(mas);
 
 	ret = usb_control_msg(dev_handle_, LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD
 				| LIBUSB_RECIPIENT_DEVICE,
@@ -0,0 +1,193 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+/*
+ * Returns the altsetting the kernel currently has selected for an
+ * interface of the active configuration. sysfs only exposes interfaces
+ * of the active configuration, so anything else reads as altsetting 0.
+ */
+int UsbDevice::get_current_altsetting(uint8_t config_value,
+		uint8_t interface_number)
+{
+	char intf_name[64];
+	char value[16];
+
+	snprintf(intf_name, sizeof(intf_name), "%s:%u.%u",
+			sysfs_name_.c_str(), config_value, interface_number);
+	if (read_sysfs_prop(value, sizeof(value), intf_name,
+				"bAlternateSetting") <= 0)
+		return 0;
+
+	return atoi(value);
+}
+
+const unsigned char *find_ss_companion(
+		const struct libusb_endpoint_descriptor *ep)
+{
+	const unsigned char *buf = ep->extra;
+	int size = ep->extra_length;
+
+	while (buf && size >= 2 && buf[0] >= 2 && buf[0] <= size) {
+		if (buf[1] == USB_DT_SS_ENDPOINT_COMP && buf[0] >= 6)
+			return buf;
+		size -= buf[0];
+		buf += buf[0];
+	}
+	return NULL;
+}
+
+/*
+ * Service interval of an interrupt or isochronous endpoint, in
+ * microseconds, at the speed the device is running.
+ */
+unsigned int UsbDevice::getEndpointPeriod(const struct libusb_endpoint_descriptor *ep)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	unsigned int interval = ep->bInterval;
+
+	if (interval < 1)
+		interval = 1;
+	if (speed_ >= LIBUSB_SPEED_HIGH) {
+		/* 2^(bInterval-1) microframes */
+		if (interval > 16)
+			interval = 16;
+		return 125 << (interval - 1);
+	} else if (type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS) {
+		/* 2^(bInterval-1) frames */
+		if (interval > 16)
+			interval = 16;
+		return 1000 << (interval - 1);
+	}
+
+	/* bInterval frames */
+	return 1000 * interval;
+}
+
+/* bandwidth needs of one interrupt or isochronous endpoint */
+void UsbDevice::get_periodic_endpoint(const struct libusb_interface_descriptor *alt,
+		const struct libusb_endpoint_descriptor *ep, PeriodicEndpoint &pep)
+{
+	unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	unsigned int wmax = le16_to_cpu(ep->wMaxPacketSize);
+
+	pep.interface = alt->bInterfaceNumber;
+	pep.altsetting = alt->bAlternateSetting;
+	pep.address = ep->bEndpointAddress;
+	pep.type = type;
+	pep.maxp = wmax & 0x7ff;
+	pep.packets = 1;
+
+	switch (speed_) {
+	case LIBUSB_SPEED_SUPER:
+	case LIBUSB_SPEED_SUPER_PLUS: {
+		const unsigned char *comp = find_ss_companion(ep);
+		unsigned int burst = comp ? comp[2] + 1 : 1;
+		unsigned int mult = 1;
+
+		if (comp && type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+			mult = (comp[3] & 0x3) + 1;
+		pep.packets = burst * mult;
+		pep.bytes = comp ? convert_le_u16(comp + 4) : 0;
+		if (!pep.bytes)
+			pep.bytes = pep.maxp * pep.packets;
+		break;
+	}
+	case LIBUSB_SPEED_HIGH:
+		pep.packets = ((wmax >> 11) & 0x3) + 1;
+		pep.bytes = pep.maxp * pep.packets;
+		break;
+	default:
+		pep.bytes = pep.maxp;
+		break;
+	}
+
+	pep.period_us = getEndpointPeriod(ep);
+}
+
+void UsbDevice::getCurrentAltsettings(vector<pair<int, int> > &alts)
+{
+	struct libusb_config_descriptor *config;
+
+	if (!usb_dev_ || libusb_get_active_config_descriptor(usb_dev_, &config))
+		return;
+
+	for (int i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+		int number;
+
+		if (!intf->num_altsetting)
+			continue;
+		number = intf->altsetting[0].bInterfaceNumber;
+		alts.push_back(make_pair(number, get_current_altsetting(
+				config->bConfigurationValue, number)));
+	}
+
+	libusb_free_config_descriptor(config);
+}
+
+void UsbDevice::getPeriodicEndpoints(vector<PeriodicEndpoint> &eps)
+{
+	struct libusb_config_descriptor *config;
+
+	if (!usb_dev_ || libusb_get_active_config_descriptor(usb_dev_, &config))
+		return;
+
+	for (int i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+		const struct libusb_interface_descriptor *alt = NULL;
+		int cur_alt;
+
+		if (!intf->num_altsetting)
+			continue;
+
+		cur_alt = get_current_altsetting(config->bConfigurationValue,
+				intf->altsetting[0].bInterfaceNumber);
+		for (int j = 0; j < intf->num_altsetting; j++) {
+			if (intf->altsetting[j].bAlternateSetting == cur_alt) {
+				alt = &intf->altsetting[j];
+				break;
+			}
+		}
+		if (!alt)
+			alt = &intf->altsetting[0];
+
+		for (int k = 0; k < alt->bNumEndpoints; k++) {
+			const struct libusb_endpoint_descriptor *ep = &alt->endpoint[k];
+			unsigned int type = ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+			PeriodicEndpoint pep;
+
+			if (type != LIBUSB_TRANSFER_TYPE_ISOCHRONOUS
+					&& type != LIBUSB_TRANSFER_TYPE_INTERRUPT)
+				continue;
+
+			get_periodic_endpoint(alt, ep, pep);
+			eps.push_back(pep);
+		}
+	}
+
+	libusb_free_config_descriptor(config);
+}
@@ -0,0 +1,197 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+/* AudioStreaming interface descriptor subtypes */
+#define UAC_AS_GENERAL		0x01
+#define UAC_FORMAT_TYPE		0x02
+
+#define UAC_FORMAT_TYPE_I	0x01
+#define UAC_FORMAT_TYPE_III	0x03
+
+/*
+ * UAC2 streaming interfaces get their sample rates from a clock entity
+ * at run time; size them for the usual rates instead.
+ */
+static const uint32_t uac2_rates[] = {
+	44100, 48000, 88200, 96000, 176400, 192000
+};
+
+static void get_format_type(const unsigned char *buf, int protocol,
+		AudioAltsetting &as)
+{
+	unsigned int n;
+
+	if (buf[3] != UAC_FORMAT_TYPE_I && buf[3] != UAC_FORMAT_TYPE_III)
+		return;
+
+	if (protocol == USB_AUDIO_CLASS_2) {
+		if (buf[0] < 6)
+			return;
+		as.subslot = buf[4];
+		as.bits = buf[5];
+		as.rates.assign(uac2_rates, uac2_rates
+				+ sizeof(uac2_rates) / sizeof(uac2_rates[0]));
+		as.rates_assumed = true;
+		return;
+	}
+
+	if (buf[0] < 8)
+		return;
+	as.channels = buf[4];
+	as.subslot = buf[5];
+	as.bits = buf[6];
+	n = buf[7];
+	if (!n) {
+		/* continuous: both ends of the range */
+		if (buf[0] < 14)
+			return;
+		as.rates.push_back(buf[8] | (buf[9] << 8) | (buf[10] << 16));
+		as.rates.push_back(buf[11] | (buf[12] << 8) | (buf[13] << 16));
+		return;
+	}
+	for (unsigned int i = 0; i < n && 11 + 3 * i <= buf[0]; i++)
+		as.rates.push_back(buf[8 + 3 * i] | (buf[9 + 3 * i] << 8)
+				| (buf[10 + 3 * i] << 16));
+}
+
+/*
+ * Bytes a PCM stream puts in one service interval of its endpoint. The
+ * packet must hold one sample more than the nominal rate, which lets an
+ * asynchronous or adaptive endpoint follow its clock.
+ */
+unsigned int AudioAltsetting::getBytes(uint32_t rate) const
+{
+	uint64_t samples = ((uint64_t)rate * ep.period_us + 999999) / 1000000 + 1;
+
+	return samples * channels * subslot;
+}
+
+void UsbDevice::getAudioAltsettings(vector<AudioAltsetting> &alts)
+{
+	struct libusb_config_descriptor *config;
+
+	if (!usb_dev_ || libusb_get_active_config_descriptor(usb_dev_, &config))
+		return;
+
+	for (int i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		for (int j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+			const unsigned char *buf = alt->extra;
+			int size = alt->extra_length;
+			AudioAltsetting as;
+			int k;
+
+			if (alt->bInterfaceClass != LIBUSB_CLASS_AUDIO
+					|| alt->bInterfaceSubClass != 2)
+				continue;
+
+			/* the data endpoint, not the feedback one */
+			for (k = 0; k < alt->bNumEndpoints; k++) {
+				const struct libusb_endpoint_descriptor *ep = &alt->endpoint[k];
+
+				if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK)
+						== LIBUSB_TRANSFER_TYPE_ISOCHRONOUS
+						&& ((ep->bmAttributes >> 4) & 3) != 1)
+					break;
+			}
+			if (k == alt->bNumEndpoints)
+				continue;
+
+			as.protocol = alt->bInterfaceProtocol;
+			as.channels = 0;
+			as.subslot = 0;
+			as.bits = 0;
+			as.rates_assumed = false;
+			get_periodic_endpoint(alt, &alt->endpoint[k], as.ep);
+
+			while (buf && size >= 4 && buf[0] >= 4 && buf[0] <= size) {
+				if (buf[1] == USB_DT_CS_INTERFACE) {
+					if (buf[2] == UAC_AS_GENERAL
+							&& as.protocol == USB_AUDIO_CLASS_2
+							&& buf[0] >= 11)
+						as.channels = buf[10];
+					else if (buf[2] == UAC_FORMAT_TYPE)
+						get_format_type(buf, as.protocol, as);
+				}
+				size -= buf[0];
+				buf += buf[0];
+			}
+
+			/* only linear PCM has a size known from the descriptors */
+			if (!as.channels || !as.subslot || as.rates.empty())
+				continue;
+			alts.push_back(as);
+		}
+	}
+
+	libusb_free_config_descriptor(config);
+}
+
+void UsbDevice::dump_audio_bandwidth(vector<string> &info)
+{
+	vector<AudioAltsetting> alts;
+	bool assumed = false;
+	char line[128];
+
+	getAudioAltsettings(alts);
+	if (alts.empty())
+		return;
+
+	info.push_back(" ");
+	info.push_back("Audio Streaming Bandwidth:");
+
+	for (unsigned int i = 0; i < alts.size(); i++) {
+		const AudioAltsetting &as = alts[i];
+
+		snprintf(line, 128, "  Interface %u Alt %u: %u ch x %u B (%u bit), EP 0x%02x %s, %u B every %u us",
+				as.ep.interface, as.ep.altsetting, as.channels,
+				as.subslot, as.bits, as.ep.address,
+				(as.ep.address & LIBUSB_ENDPOINT_IN) ? "IN" : "OUT",
+				as.ep.bytes, as.ep.period_us);
+		info.push_back(line);
+
+		for (unsigned int j = 0; j < as.rates.size(); j++) {
+			unsigned int bytes = as.getBytes(as.rates[j]);
+
+			if (bytes <= as.ep.bytes)
+				snprintf(line, 128, "    %6u Hz%s %5u B  headroom %5u B (%u%%)",
+						as.rates[j], as.rates_assumed ? "*" : " ",
+						bytes, as.ep.bytes - bytes,
+						(as.ep.bytes - bytes) * 100 / as.ep.bytes);
+			else
+				snprintf(line, 128, "    %6u Hz%s %5u B  OVERSUBSCRIBED by %u B",
+						as.rates[j], as.rates_assumed ? "*" : " ",
+						bytes, bytes - as.ep.bytes);
+			info.push_back(line);
+		}
+		assumed |= as.rates_assumed;
+	}
+
+	if (assumed)
+		info.push_back("  * UAC2 rates come from the clock source, common rates shown");
+}
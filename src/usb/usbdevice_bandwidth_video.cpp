@@ -0,0 +1,250 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+/* largest UVC payload header, sent once per service interval */
+#define UVC_PAYLOAD_HEADER	12
+
+/* VideoStreaming interface descriptor subtypes */
+#define UVC_VS_FORMAT_UNCOMPRESSED	0x04
+#define UVC_VS_FRAME_UNCOMPRESSED	0x05
+#define UVC_VS_FORMAT_MJPEG		0x06
+#define UVC_VS_FRAME_MJPEG		0x07
+#define UVC_VS_FORMAT_FRAME_BASED	0x10
+#define UVC_VS_FRAME_FRAME_BASED	0x11
+
+static bool capacity_cmp(const PeriodicEndpoint &a, const PeriodicEndpoint &b)
+{
+	return (uint64_t)a.bytes * b.period_us < (uint64_t)b.bytes * a.period_us;
+}
+
+/*
+ * Picks the altsetting the driver has to select for a mode: the one
+ * with the smallest capacity still carrying a service interval worth of
+ * video plus its payload header. Modes that fit nowhere are left with
+ * the largest altsetting.
+ */
+static void fit_mode(VideoMode &mode, const vector<PeriodicEndpoint> &alts)
+{
+	mode.fits = false;
+	for (unsigned int i = 0; i < alts.size(); i++) {
+		const PeriodicEndpoint &ep = alts[i];
+
+		mode.ep = ep;
+		mode.payload = (mode.bytes_per_sec * ep.period_us + 999999) / 1000000
+				+ UVC_PAYLOAD_HEADER;
+		if (mode.payload <= ep.bytes) {
+			mode.fits = true;
+			return;
+		}
+	}
+}
+
+/* the first four bytes of the format GUID are its FOURCC */
+static void get_fourcc(char *fourcc, const unsigned char *guid)
+{
+	for (int i = 0; i < 4; i++)
+		fourcc[i] = isprint(guid[i]) ? guid[i] : '?';
+	fourcc[4] = '\0';
+}
+
+static void add_frame_modes(const unsigned char *buf, const VideoMode &format,
+		unsigned int bpp, const vector<PeriodicEndpoint> &alts,
+		vector<VideoMode> &modes)
+{
+	unsigned int n = buf[2] == UVC_VS_FRAME_FRAME_BASED ? 21 : 25;
+	vector<uint32_t> intervals;
+	uint32_t shortest = 0, max_bitrate;
+
+	if (buf[0] < 26)
+		return;
+
+	if (buf[n] == 0) {
+		/* continuous: the two ends of the range are enough */
+		if (buf[0] < 38)
+			return;
+		intervals.push_back(convert_le_u32(buf + 26));
+		intervals.push_back(convert_le_u32(buf + 30));
+	} else {
+		for (unsigned int i = 0; i < buf[n] && 30 + 4 * i <= buf[0]; i++)
+			intervals.push_back(convert_le_u32(buf + 26 + 4 * i));
+	}
+
+	for (unsigned int i = 0; i < intervals.size(); i++) {
+		if (intervals[i] && (!shortest || intervals[i] < shortest))
+			shortest = intervals[i];
+	}
+	max_bitrate = convert_le_u32(buf + 13);
+
+	for (unsigned int i = 0; i < intervals.size(); i++) {
+		VideoMode mode = format;
+
+		if (!intervals[i])
+			continue;
+
+		mode.frame_index = buf[3];
+		mode.width = convert_le_u16(buf + 5);
+		mode.height = convert_le_u16(buf + 7);
+		mode.interval = intervals[i];
+		if (mode.compressed)
+			/* dwMaxBitRate is given for the shortest interval */
+			mode.bytes_per_sec = (uint64_t)max_bitrate / 8
+					* shortest / intervals[i];
+		else
+			mode.bytes_per_sec = (uint64_t)mode.width * mode.height
+					* bpp / 8 * 10000000 / intervals[i];
+
+		fit_mode(mode, alts);
+		modes.push_back(mode);
+	}
+}
+
+void UsbDevice::getVideoModes(vector<VideoMode> &modes)
+{
+	struct libusb_config_descriptor *config;
+
+	if (!usb_dev_ || libusb_get_active_config_descriptor(usb_dev_, &config))
+		return;
+
+	for (int i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+		const struct libusb_interface_descriptor *alt;
+		vector<PeriodicEndpoint> alts;
+		const unsigned char *buf;
+		unsigned int bpp = 0;
+		VideoMode format;
+		int size;
+
+		if (!intf->num_altsetting)
+			continue;
+		alt = &intf->altsetting[0];
+		if (alt->bInterfaceClass != USB_CLASS_VIDEO
+				|| alt->bInterfaceSubClass != 2)
+			continue;
+
+		for (int j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *a = &intf->altsetting[j];
+
+			for (int k = 0; k < a->bNumEndpoints; k++) {
+				const struct libusb_endpoint_descriptor *ep = &a->endpoint[k];
+				PeriodicEndpoint pep;
+
+				if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK)
+						!= LIBUSB_TRANSFER_TYPE_ISOCHRONOUS)
+					continue;
+				get_periodic_endpoint(a, ep, pep);
+				alts.push_back(pep);
+			}
+		}
+		sort(alts.begin(), alts.end(), capacity_cmp);
+
+		/* formats and their frames all live in altsetting 0 */
+		memset(&format, 0, sizeof(format));
+		format.interface = alt->bInterfaceNumber;
+		buf = alt->extra;
+		size = alt->extra_length;
+		while (buf && size >= 3 && buf[0] >= 3 && buf[0] <= size) {
+			if (buf[1] == USB_DT_CS_INTERFACE) {
+				switch (buf[2]) {
+				case UVC_VS_FORMAT_UNCOMPRESSED:
+				case UVC_VS_FORMAT_FRAME_BASED:
+					if (buf[0] < 22)
+						break;
+					format.format_index = buf[3];
+					get_fourcc(format.format, buf + 5);
+					/* frame based formats are carried compressed */
+					format.compressed = buf[2] == UVC_VS_FORMAT_FRAME_BASED;
+					bpp = buf[21];
+					break;
+				case UVC_VS_FORMAT_MJPEG:
+					if (buf[0] < 11)
+						break;
+					format.format_index = buf[3];
+					strcpy(format.format, "MJPG");
+					format.compressed = true;
+					bpp = 0;
+					break;
+				case UVC_VS_FRAME_UNCOMPRESSED:
+				case UVC_VS_FRAME_MJPEG:
+				case UVC_VS_FRAME_FRAME_BASED:
+					if (format.format_index)
+						add_frame_modes(buf, format, bpp, alts, modes);
+					break;
+				}
+			}
+			size -= buf[0];
+			buf += buf[0];
+		}
+	}
+
+	libusb_free_config_descriptor(config);
+}
+
+void UsbDevice::dump_video_bandwidth(vector<string> &info)
+{
+	vector<VideoMode> modes;
+	int interface = -1;
+	bool compressed = false;
+	char line[128];
+
+	getVideoModes(modes);
+	if (modes.empty())
+		return;
+
+	info.push_back(" ");
+	info.push_back("Video Streaming Bandwidth:");
+
+	for (unsigned int i = 0; i < modes.size(); i++) {
+		const VideoMode &m = modes[i];
+		double fps = 10000000.0 / m.interval;
+		int len;
+
+		if (m.interface != interface) {
+			interface = m.interface;
+			snprintf(line, 128, "  Interface %u%s", interface,
+					m.ep.bytes ? "" : " (bulk streaming, nothing reserved)");
+			info.push_back(line);
+		}
+
+		len = snprintf(line, 128, "    %-4s %4ux%-4u %6.2f fps %11llu B/s%s",
+				m.format, m.width, m.height, fps,
+				(unsigned long long)m.bytes_per_sec,
+				m.compressed ? "*" : " ");
+		compressed |= m.compressed;
+		if (m.fits)
+			snprintf(line + len, 128 - len, "  alt %u, %u of %u B every %u us",
+					m.ep.altsetting, m.payload, m.ep.bytes,
+					m.ep.period_us);
+		else if (m.ep.bytes)
+			snprintf(line + len, 128 - len, "  DOES NOT FIT, alt %u carries %u B every %u us",
+					m.ep.altsetting, m.ep.bytes, m.ep.period_us);
+		info.push_back(line);
+	}
+
+	if (compressed)
+		info.push_back("  * compressed, estimated from dwMaxBitRate");
+}
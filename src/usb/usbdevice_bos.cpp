@@ -18,6 +18,7 @@
 */
 
 #include "usbdevice.h"
+#include "hexdump.h"
 #include "names.h"
 #include "usbmisc.h"
 
@@ -150,12 +151,14 @@ void UsbDevice::dump_bos_descriptor(vector<string> &bos_info)
 					buf, DESC_BUF_LEN_FROM_BUF, 2);
 			break;
 #endif
-		default:
-			snprintf(line, 128, "  ** UNRECOGNIZED: ");
-			dump_bytes(buf, buf[0], (char **)&line, 128);
-			bos_info.push_back(line);
+		default: {
+			string unrecognized = "  ** UNRECOGNIZED: ";
+
+			dump_bytes(buf, buf[0], unrecognized);
+			bos_info.push_back(unrecognized);
 			break;
 		}
+		}
 		size -= buf[0];
 		buf += buf[0];
 	}
@@ -510,14 +513,9 @@ static void dump_billboard_device_capability_desc(libusb_device_handle *dev, uns
 
 	bmConfigured = &buf[8];
 
-#if 0
-	//TODO: how to invoke dump_bytes from here?
-	snprintf(line, 128, "    bmConfigured               ");
-	char bm_config_bytes[64];
-	dump_bytes(bmConfigured, 32, (char **)&bm_config_bytes, 64);
-	strncat(line, bm_config_bytes, 128);
-	bos_info.push_back(line);
-#endif
+	string bm_configured = "    bmConfigured            ";
+	hex_append(bm_configured, bmConfigured, 32);
+	bos_info.push_back(bm_configured);
 
 	snprintf(line, 128, "    bcdVersion              %2x.%02x\n", (buf[41] == 0) ? 1 : buf[41], buf[40]);
 	bos_info.push_back(line);
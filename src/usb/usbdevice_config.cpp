@@ -53,6 +53,7 @@ void UsbDevice::dump_config(struct libusb_config_descriptor *config, vector<stri
 
 	unsigned int speed = descriptor_.bcdUSB;
 
+	cur_config_ = config->bConfigurationValue;
 	cfg = get_dev_string(dev_handle_, config->iConfiguration);
 
 	char line[128];
@@ -107,8 +108,7 @@ void UsbDevice::dump_config(struct libusb_config_descriptor *config, vector<stri
 
 		while (size >= 2) {
 			if (buf[0] < 2) {
-				dump_junk(buf, "        ", size, (char **)&line, 128);
-				config_info.push_back(line);
+				dump_junk(buf, "        ", size, config_info);
 				break;
 			}
 			switch (buf[1]) {
@@ -116,7 +116,7 @@ void UsbDevice::dump_config(struct libusb_config_descriptor *config, vector<stri
 				/* handled separately */
 				break;
 			case USB_DT_INTERFACE_ASSOCIATION:
-				dump_association(buf, config_info);
+				dump_association(NULL, buf, config_info);
 				break;
 			case USB_DT_SECURITY:
 				dump_security(buf, config_info);
@@ -124,14 +124,15 @@ void UsbDevice::dump_config(struct libusb_config_descriptor *config, vector<stri
 			case USB_DT_ENCRYPTION_TYPE:
 				dump_encryption_type(buf, config_info);
 				break;
-			default:
+			default: {
 				/* often a misplaced class descriptor */
-				snprintf(line, 128, "  ** UNRECOGNIZED: ");
-				dump_bytes(buf, buf[0], (char **)&line, 128);
-				config_info.push_back(line);
+				string unrecognized = "  ** UNRECOGNIZED: ";
 
+				dump_bytes(buf, buf[0], unrecognized);
+				config_info.push_back(unrecognized);
 				break;
 			}
+			}
 			size -= buf[0];
 			buf += buf[0];
 		}
@@ -184,7 +185,8 @@ void UsbDevice::dump_encryption_type(const unsigned char *buf, vector<string> &c
 	config_info.push_back(line);
 }
 
-void UsbDevice::dump_association(const unsigned char *buf, vector<string> &config_info)
+void UsbDevice::dump_association(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &config_info)
 {
 	char cls[128], subcls[128], proto[128];
 	char *func;
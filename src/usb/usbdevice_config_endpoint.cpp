@@ -0,0 +1,215 @@
+/*
+    Copyright (C) 1999-2001, 2003 Thomas Sailer (t.sailer@alumni.ethz.ch)
+    Copyright (C) 2003-2005 David Brownell
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "usbmon.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+#define LATENCY_BAR_WIDTH	20
+
+/* class specific descriptors following an endpoint descriptor */
+const UsbDevice::ClassDispatch UsbDevice::endpoint_dispatch_[] = {
+	{ -1, -1, USB_DT_SS_ENDPOINT_COMP, 6, &UsbDevice::dump_ss_endpoint_companion },
+	{ LIBUSB_CLASS_AUDIO, 2, USB_DT_CS_ENDPOINT, 3, &UsbDevice::dump_audiostreaming_endpoint },
+	{ LIBUSB_CLASS_AUDIO, 3, USB_DT_CS_ENDPOINT, 4, &UsbDevice::dump_midistreaming_endpoint },
+	/* misplaced, belong to the interface */
+	{ -1, -1, USB_DT_CS_INTERFACE, 3, &UsbDevice::dump_comm_descriptor },
+	{ USB_CLASS_CCID, -1, USB_DT_CS_DEVICE, 2, &UsbDevice::dump_ccid_device },
+	{ -1, -1, USB_DT_OTG, 2, NULL },
+	{ -1, -1, USB_DT_INTERFACE_ASSOCIATION, 8, &UsbDevice::dump_association },
+	{ 0, 0, 0, 0, NULL }
+};
+
+
+void UsbDevice::dump_endpoint_latency(const struct libusb_endpoint_descriptor *endpoint,
+		vector<string> &ep_info)
+{
+	const EndpointTraffic *ep;
+	uint64_t groups[33];
+	uint64_t group_max = 0;
+	int first = -1, last = -1;
+	char line[128];
+
+	if (!monitor_)
+		return;
+	ep = monitor_->getEndpoint(bus_num_, device_addr_, endpoint->bEndpointAddress);
+	if (!ep)
+		return;
+
+	const LatencyHistogram &h = ep->latency;
+
+	snprintf(line, 128, "        URB Latency:        %llu completions, %llu timeouts, %llu unlinks",
+			(unsigned long long)h.total, (unsigned long long)ep->timeouts,
+			(unsigned long long)ep->unlinks);
+	ep_info.push_back(line);
+	if (!h.total)
+		return;
+
+	snprintf(line, 128, "          p50 %u us  p99 %u us  p99.9 %u us  max %u us",
+			h.Percentile(0.50), h.Percentile(0.99),
+			h.Percentile(0.999), h.max_us);
+	ep_info.push_back(line);
+
+	/* fold the histogram into power of two groups for display */
+	memset(groups, 0, sizeof(groups));
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+		uint32_t hi = LatencyHistogram::BucketHighest(i);
+		int g = hi ? 32 - __builtin_clz(hi) : 0;
+
+		groups[g] += h.counts[i];
+	}
+	for (int g = 0; g < 33; g++) {
+		if (!groups[g])
+			continue;
+		if (first < 0)
+			first = g;
+		last = g;
+		if (groups[g] > group_max)
+			group_max = groups[g];
+	}
+
+	for (int g = first; g <= last; g++) {
+		char bar[LATENCY_BAR_WIDTH + 1];
+		unsigned int n = groups[g] * LATENCY_BAR_WIDTH / group_max;
+
+		if (groups[g] && !n)
+			n = 1;
+		memset(bar, '#', n);
+		bar[n] = '\0';
+		snprintf(line, 128, "          < %10llu us %10llu %s",
+				1ULL << g, (unsigned long long)groups[g], bar);
+		ep_info.push_back(line);
+	}
+}
+
+void UsbDevice::dump_ss_endpoint_companion(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &ep_info)
+{
+	unsigned int type = cur_endpoint_->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK;
+	char line[128];
+
+	snprintf(line, 128, "        SuperSpeed Endpoint Companion Descriptor:");
+	ep_info.push_back(line);
+	snprintf(line, 128, "          bLength             %5u", buf[0]);
+	ep_info.push_back(line);
+	snprintf(line, 128, "          bDescriptorType     %5u", buf[1]);
+	ep_info.push_back(line);
+	snprintf(line, 128, "          bMaxBurst           %5u", buf[2]);
+	ep_info.push_back(line);
+	snprintf(line, 128, "          bmAttributes         0x%02x", buf[3]);
+	ep_info.push_back(line);
+
+	switch (type) {
+	case LIBUSB_TRANSFER_TYPE_BULK:
+		/* MaxStreams is a power of two, 0 for no streams */
+		if (buf[3] & 0x1f) {
+			snprintf(line, 128, "            MaxStreams        %5u", 1U << (buf[3] & 0x1f));
+			ep_info.push_back(line);
+		}
+		break;
+	case LIBUSB_TRANSFER_TYPE_ISOCHRONOUS:
+		snprintf(line, 128, "            Mult              %5u", (buf[3] & 0x3) + 1);
+		ep_info.push_back(line);
+		if (buf[3] & 0x80) {
+			snprintf(line, 128, "            SSP Isochronous Companion follows");
+			ep_info.push_back(line);
+		}
+		/* fall through */
+	case LIBUSB_TRANSFER_TYPE_INTERRUPT:
+		snprintf(line, 128, "          wBytesPerInterval   %5u", convert_le_u16(buf + 4));
+		ep_info.push_back(line);
+		break;
+	}
+}
+
+void UsbDevice::dump_endpoint(const struct libusb_interface_descriptor *interface,
+		const struct libusb_endpoint_descriptor *endpoint,
+		vector<string> &ep_info)
+{
+	static const char * const typeattr[] = {
+		"Control",
+		"Isochronous",
+		"Bulk",
+		"Interrupt"
+	};
+	static const char * const syncattr[] = {
+		"None",
+		"Asynchronous",
+		"Adaptive",
+		"Synchronous"
+	};
+	static const char * const usage[] = {
+		"Data",
+		"Feedback",
+		"Implicit feedback Data",
+		"(reserved)"
+	};
+	static const char * const hb[] = { "1x", "2x", "3x", "(?\?)" };
+	unsigned wmax = le16_to_cpu(endpoint->wMaxPacketSize);
+	char line[128];
+
+	snprintf(line, 128, "      Endpoint Descriptor:\n");
+	ep_info.push_back(line);
+	snprintf(line, 128, "        bLength             %5u\n", endpoint->bLength);
+	ep_info.push_back(line);
+	snprintf(line, 128, "        bDescriptorType     %5u\n", endpoint->bDescriptorType);
+	ep_info.push_back(line);
+	snprintf(line, 128, "        bEndpointAddress     0x%02x  EP %u %s\n",
+			endpoint->bEndpointAddress,
+			endpoint->bEndpointAddress & 0x0f,
+			(endpoint->bEndpointAddress & 0x80) ? "IN" : "OUT");
+	ep_info.push_back(line);
+	snprintf(line, 128, "        bmAttributes        %5u\n", endpoint->bmAttributes);
+	ep_info.push_back(line);
+	snprintf(line, 128, "          Transfer Type            %s\n",
+			typeattr[endpoint->bmAttributes & 3]);
+	ep_info.push_back(line);
+	snprintf(line, 128, "          Synch Type               %s\n",
+			syncattr[(endpoint->bmAttributes >> 2) & 3]);
+	ep_info.push_back(line);
+	snprintf(line, 128, "          Usage Type               %s\n",
+			usage[(endpoint->bmAttributes >> 4) & 3]);
+	ep_info.push_back(line);
+	snprintf(line, 128, "        wMaxPacketSize     0x%04x  %s %d bytes\n",
+			wmax, hb[(wmax >> 11) & 3], wmax & 0x7ff);
+	ep_info.push_back(line);
+	snprintf(line, 128, "        bInterval           %5u\n", endpoint->bInterval);
+	ep_info.push_back(line);
+
+	/* only for audio endpoints */
+	if (endpoint->bLength == 9) {
+		snprintf(line, 128, "        bRefresh            %5u\n", endpoint->bRefresh);
+		ep_info.push_back(line);
+		snprintf(line, 128, "        bSynchAddress       %5u\n", endpoint->bSynchAddress);
+		ep_info.push_back(line);
+	}
+
+	cur_endpoint_ = endpoint;
+	dump_class_descriptors(endpoint_dispatch_, interface,
+			endpoint->extra, endpoint->extra_length,
+			"        ", ep_info);
+
+	dump_endpoint_latency(endpoint, ep_info);
+}
@@ -18,6 +18,7 @@
 */
 
 #include "usbdevice.h"
+#include "lineprinter.h"
 #include "names.h"
 #include "usbmisc.h"
 
@@ -26,8 +27,76 @@
 
 using namespace std;
 
+/*
+ * Class specific descriptors of an altsetting. The first matching entry
+ * wins, so specific entries go before the wildcards.
+ */
+const UsbDevice::ClassDispatch UsbDevice::altsetting_dispatch_[] = {
+	{ LIBUSB_CLASS_AUDIO, 1, USB_DT_CS_INTERFACE, 3, &UsbDevice::dump_audiocontrol_interface },
+	{ LIBUSB_CLASS_AUDIO, 2, USB_DT_CS_INTERFACE, 3, &UsbDevice::dump_audiostreaming_interface },
+	{ LIBUSB_CLASS_AUDIO, 3, USB_DT_CS_INTERFACE, 3, &UsbDevice::dump_midistreaming_interface },
+	/* misplaced, belongs to the endpoint */
+	{ LIBUSB_CLASS_AUDIO, 2, USB_DT_CS_ENDPOINT, 3, &UsbDevice::dump_audiostreaming_endpoint },
+	{ LIBUSB_CLASS_COMM, -1, USB_DT_CS_INTERFACE, 3, &UsbDevice::dump_comm_descriptor },
+	{ USB_CLASS_VIDEO, 1, USB_DT_CS_INTERFACE, 3, &UsbDevice::dump_videocontrol_interface },
+	{ USB_CLASS_VIDEO, 2, USB_DT_CS_INTERFACE, 3, &UsbDevice::dump_videostreaming_interface },
+	{ USB_CLASS_APPLICATION, 1, USB_DT_CS_DEVICE, 7, &UsbDevice::dump_dfu_interface },
+	{ LIBUSB_CLASS_HID, -1, LIBUSB_DT_HID, 9, &UsbDevice::dump_hid_device },
+	/* implicitly tagged, any type */
+	{ USB_CLASS_CCID, -1, -1, 2, &UsbDevice::dump_ccid_device },
+	/* ... not everything is class-specific */
+	{ -1, -1, USB_DT_OTG, 2, NULL },
+	{ -1, -1, USB_DT_INTERFACE_ASSOCIATION, 8, &UsbDevice::dump_association },
+	{ 0, 0, 0, 0, NULL }
+};
+
+void UsbDevice::dump_class_descriptors(const ClassDispatch *table,
+		const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, int size, const char *indent,
+		vector<string> &info)
+{
+	while (size >= 2) {
+		const ClassDispatch *d;
+
+		if (buf[0] < 2 || buf[0] > size) {
+			LinePrinter out(info);
+
+			out.Print("%sjunk at descriptor end:", indent);
+			out.Bytes(buf, size);
+			break;
+		}
+
+		for (d = table; d->type; d++) {
+			if ((d->cls < 0 || d->cls == interface->bInterfaceClass)
+					&& (d->subclass < 0
+						|| d->subclass == interface->bInterfaceSubClass)
+					&& (d->type < 0 || d->type == buf[1]))
+				break;
+		}
+
+		if (!d->type) {
+			LinePrinter out(info);
+
+			/* often a misplaced class descriptor */
+			out.Print("%s** UNRECOGNIZED: ", indent);
+			out.Bytes(buf, buf[0]);
+		} else if (buf[0] < d->min_len) {
+			LinePrinter out(info);
+
+			out.Print("%sWarning: Descriptor too short:", indent);
+			out.Bytes(buf, buf[0]);
+		} else if (d->decode) {
+			(this->*d->decode)(interface, buf, info);
+		}
+
+		size -= buf[0];
+		buf += buf[0];
+	}
+}
+
 
-void UsbDevice::dump_ccid_device(const unsigned char *buf, vector<string> &intf_info)
+void UsbDevice::dump_ccid_device(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &intf_info)
 {
 	unsigned int us;
 
@@ -186,50 +255,55 @@ void UsbDevice::dump_ccid_device(const unsigned char *buf, vector<string> &intf_
 
 	snprintf(line, 128, "        bClassGetResponse    ");
 	if (buf[48] == 0xff) {
-		strncat(line, "echo", 128);
+		strncat(line, "echo\n", 128);
 	}
 	else {
 		snprintf(extra_info, 10, "  %02X\n", buf[48]);
 		strncat(line, extra_info, 128);
 	}
+	intf_info.push_back(line);
 
-	strncat(line, "        bClassEnvelope       ", 128);
+	snprintf(line, 128, "        bClassEnvelope       ");
 	if (buf[49] == 0xff) {
-		strncat(line, "echo", 128);
+		strncat(line, "echo\n", 128);
 	}
 	else {
-		snprintf(extra_info, 10, "  %02X\n", buf[48]);
+		snprintf(extra_info, 10, "  %02X\n", buf[49]);
 		strncat(line, extra_info, 128);
 	}
+	intf_info.push_back(line);
 
-	strncat(line, "        wlcdLayout           ", 128);
+	snprintf(line, 128, "        wlcdLayout           ");
 	if (!buf[50] && !buf[51]) {
-		strncat(line, "none", 128);
+		strncat(line, "none\n", 128);
 	}
 	else {
-		snprintf(extra_info, 32, "%u cols %u lines", buf[50], buf[51]);
+		snprintf(extra_info, 32, "%u cols %u lines\n", buf[50], buf[51]);
 		strncat(line, extra_info, 128);
 	}
 	intf_info.push_back(line);
 
 	snprintf(line, 128, "        bPINSupport         %5u ", buf[52]);
 	if ((buf[52] & 1))
-		fputs(" verification", stdout);
+		strncat(line, " verification", 128);
 	if ((buf[52] & 2))
-		fputs(" modification", stdout);
-	putchar('\n');
+		strncat(line, " modification", 128);
+	strncat(line, "\n", 128);
+	intf_info.push_back(line);
 
 	snprintf(line, 128, "        bMaxCCIDBusySlots   %5u\n", buf[53]);
 	intf_info.push_back(line);
 
 	if (buf[0] > 54) {
-		snprintf(line, 128, "        junk             ");
-		dump_bytes(buf+54, buf[0]-54, (char **)&line, 128);
-		intf_info.push_back(line);
+		string junk = "        junk             ";
+
+		dump_bytes(buf+54, buf[0]-54, junk);
+		intf_info.push_back(junk);
 	}
 }
 
-void UsbDevice::dump_dfu_interface(const unsigned char *buf, vector<string> &intf_info)
+void UsbDevice::dump_dfu_interface(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &intf_info)
 {
 	char line[128];
 
@@ -279,8 +353,7 @@ void UsbDevice::dump_altsetting(const struct libusb_interface_descriptor *interf
 	char cls[128], subcls[128], proto[128];
 	char *ifstr;
 
-	const unsigned char *buf;
-	unsigned size, i;
+	unsigned int i;
 
 	get_class_string(cls, sizeof(cls), interface->bInterfaceClass);
 	get_subclass_string(subcls, sizeof(subcls), interface->bInterfaceClass, interface->bInterfaceSubClass);
@@ -311,149 +384,13 @@ void UsbDevice::dump_altsetting(const struct libusb_interface_descriptor *interf
 
 	free(ifstr);
 
-#if 0
 	/* avoid re-ordering or hiding descriptors for display */
-	if (interface->extra_length) {
-		size = interface->extra_length;
-		buf = interface->extra;
-		while (size >= 2 * sizeof(u_int8_t)) {
-			if (buf[0] < 2) {
-				dump_junk(buf, "      ", size);
-				break;
-			}
-
-			switch (buf[1]) {
-
-			/* This is the polite way to provide class specific
-			 * descriptors: explicitly tagged, using common class
-			 * spec conventions.
-			 */
-			case USB_DT_CS_DEVICE:
-			case USB_DT_CS_INTERFACE:
-				switch (interface->bInterfaceClass) {
-				case LIBUSB_CLASS_AUDIO:
-					switch (interface->bInterfaceSubClass) {
-					case 1:
-						dump_audiocontrol_interface(dev, buf, interface->bInterfaceProtocol);
-						break;
-					case 2:
-						dump_audiostreaming_interface(dev, buf, interface->bInterfaceProtocol);
-						break;
-					case 3:
-						dump_midistreaming_interface(dev, buf);
-						break;
-					default:
-						goto dump;
-					}
-					break;
-				case LIBUSB_CLASS_COMM:
-					dump_comm_descriptor(dev, buf,
-						"      ");
-					break;
-				case USB_CLASS_VIDEO:
-					switch (interface->bInterfaceSubClass) {
-					case 1:
-						dump_videocontrol_interface(dev, buf, interface->bInterfaceProtocol);
-						break;
-					case 2:
-						dump_videostreaming_interface(buf);
-						break;
-					default:
-						goto dump;
-					}
-					break;
-				case USB_CLASS_APPLICATION:
-					switch (interface->bInterfaceSubClass) {
-					case 1:
-						dump_dfu_interface(buf);
-						break;
-					default:
-						goto dump;
-					}
-					break;
-				case LIBUSB_CLASS_HID:
-					dump_hid_device(dev, interface, buf);
-					break;
-				case USB_CLASS_CCID:
-					dump_ccid_device(buf);
-					break;
-				default:
-					goto dump;
-				}
-				break;
-
-			/* This is the ugly way:  implicitly tagged,
-			 * each class could redefine the type IDs.
-			 */
-			default:
-				switch (interface->bInterfaceClass) {
-				case LIBUSB_CLASS_HID:
-					dump_hid_device(dev, interface, buf);
-					break;
-				case USB_CLASS_CCID:
-					dump_ccid_device(buf);
-					break;
-				case 0xe0:	/* wireless */
-					switch (interface->bInterfaceSubClass) {
-					case 1:
-						switch (interface->bInterfaceProtocol) {
-						case 2:
-							dump_rc_interface(buf);
-							break;
-						default:
-							goto dump;
-						}
-						break;
-					case 2:
-						dump_wire_adapter(buf);
-						break;
-					default:
-						goto dump;
-					}
-					break;
-				case LIBUSB_CLASS_AUDIO:
-					switch (buf[1]) {
-					/* MISPLACED DESCRIPTOR */
-					case USB_DT_CS_ENDPOINT:
-						switch (interface->bInterfaceSubClass) {
-						case 2:
-							dump_audiostreaming_endpoint(dev, buf, interface->bInterfaceProtocol);
-							break;
-						default:
-							goto dump;
-						}
-						break;
-					default:
-						goto dump;
-					}
-					break;
-				default:
-					/* ... not everything is class-specific */
-					switch (buf[1]) {
-					case USB_DT_OTG:
-						/* handled separately */
-						break;
-					case USB_DT_INTERFACE_ASSOCIATION:
-						dump_association(dev, buf);
-						break;
-					default:
-dump:
-						/* often a misplaced class descriptor */
-						printf("      ** UNRECOGNIZED: ");
-						dump_bytes(buf, buf[0]);
-						break;
-					}
-				}
-			}
-			size -= buf[0];
-			buf += buf[0];
-		}
-	}
+	dump_class_descriptors(altsetting_dispatch_, interface,
+			interface->extra, interface->extra_length,
+			"      ", intf_info);
 
 	for (i = 0 ; i < interface->bNumEndpoints ; i++)
-		dump_endpoint(dev, interface, &interface->endpoint[i]);
-
-#endif
+		dump_endpoint(interface, &interface->endpoint[i], intf_info);
 }
 
 void UsbDevice::dump_interface(const struct libusb_interface *interface, vector<string> &intf_info)
@@ -18,10 +18,12 @@
 */
 
 #include "usbdevice.h"
+#include "lineprinter.h"
 #include "names.h"
 #include "usbmisc.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 using namespace std;
@@ -33,32 +35,76 @@ using namespace std;
  * Audio Class descriptor dump
  */
 
-static void dump_audio_subtype(libusb_device_handle *dev,
-                               const char *name,
-                               const struct desc * const desc[3],
-                               const unsigned char *buf,
-                               int protocol,
-                               unsigned int indent)
+static const char * const fmtItag[] = {
+	"TYPE_I_UNDEFINED", "PCM", "PCM8", "IEEE_FLOAT", "ALAW", "MULAW" };
+static const char * const fmtIItag[] = { "TYPE_II_UNDEFINED", "MPEG", "AC-3" };
+static const char * const fmtIIItag[] = {
+	"TYPE_III_UNDEFINED", "IEC1937_AC-3", "IEC1937_MPEG-1_Layer1",
+	"IEC1937_MPEG-Layer2/3/NOEXT", "IEC1937_MPEG-2_EXT",
+	"IEC1937_MPEG-2_Layer1_LS", "IEC1937_MPEG-2_Layer2/3_LS" };
+
+static const char *audio_format_tag(unsigned int fmttag)
 {
-	static const char * const strings[] = { "UAC1", "UAC2", "UAC3" };
-	unsigned int idx = 0;
+	if (fmttag <= 5)
+		return fmtItag[fmttag];
+	if (fmttag >= 0x1000 && fmttag <= 0x1002)
+		return fmtIItag[fmttag & 0xfff];
+	if (fmttag >= 0x2000 && fmttag <= 0x2006)
+		return fmtIIItag[fmttag & 0xfff];
+	return "undefined";
+}
 
-	switch (protocol) {
-	case USB_AUDIO_CLASS_2: idx = 1; break;
-	case USB_AUDIO_CLASS_3: idx = 2; break;
-	}
+/*
+ * Field printers for the class specific fields, which line up with the
+ * common ones at any indent (counted in pairs of spaces).
+ */
+static void uac_num(LinePrinter &out, unsigned int indent, const char *name,
+		unsigned int val)
+{
+	out.Print("%*s%-20s%5u\n", indent * 2, "", name, val);
+}
 
-	printf("(%s)\n", name);
+static void uac_hex(LinePrinter &out, unsigned int indent, const char *name,
+		unsigned int val, int bytes)
+{
+	out.Print("%*s%-*s0x%0*x\n", indent * 2, "", 23 - 2 * bytes, name,
+			2 * bytes, val);
+}
 
-	if (desc[idx] == NULL) {
-		printf("%*sWarning: %s descriptors are illegal for %s\n",
-		       indent * 2, "", name, strings[idx]);
-		return;
-	}
+static void uac_bcd(LinePrinter &out, unsigned int indent, const char *name,
+		const unsigned char *p)
+{
+	out.Print("%*s%-20s%2x.%02x\n", indent * 2, "", name, p[1], p[0]);
+}
+
+static void uac_string(libusb_device_handle *dev, LinePrinter &out,
+		unsigned int indent, const char *name, u_int8_t id)
+{
+	char *str = get_dev_string(dev, id);
+
+	out.Print("%*s%-20s%5u %s\n", indent * 2, "", name, id, str);
+	free(str);
+}
 
-	/* Skip the first three bytes; those common fields have already
-	 * been dumped. */
-	desc_dump(dev, desc[idx], buf + 3, buf[0] - 3, indent);
+static void uac_terminal(LinePrinter &out, unsigned int indent, const char *name,
+		const unsigned char *p)
+{
+	unsigned int termt = convert_le_u16(p);
+	char term[128];
+
+	get_audioterminal_string(term, sizeof(term), termt);
+	out.Print("%*s%-19s0x%04x %s\n", indent * 2, "", name, termt, term);
+}
+
+static void uac_sources(LinePrinter &out, unsigned int indent, const char *name,
+		const unsigned char *p, unsigned int n)
+{
+	char field[32];
+
+	for (unsigned int i = 0; i < n; i++) {
+		snprintf(field, sizeof(field), "%s(%2u)", name, i);
+		uac_num(out, indent, field, p[i]);
+	}
 }
 
 /* USB Audio Class subtypes */
@@ -142,242 +188,465 @@ static enum uac_interface_subtype get_uac_interface_subtype(unsigned char c, int
 
 	/* If the protocol was unknown, or the value was not known to require
 	 * mapping, just return it unchanged. */
-	return c;
+	return (enum uac_interface_subtype)c;
 }
 
-static void dump_audiocontrol_interface(libusb_device_handle *dev, const unsigned char *buf, int protocol)
-{
-	enum uac_interface_subtype subtype;
+static const char * const uac_subtype_names[] = {
+	"AC_DESCRIPTOR_UNDEFINED", "HEADER", "INPUT_TERMINAL",
+	"OUTPUT_TERMINAL", "EXTENDED_TERMINAL", "MIXER_UNIT",
+	"SELECTOR_UNIT", "FEATURE_UNIT", "EFFECT_UNIT", "PROCESSING_UNIT",
+	"EXTENSION_UNIT", "CLOCK_SOURCE", "CLOCK_SELECTOR",
+	"CLOCK_MULTIPLIER", "SAMPLING_RATE_CONVERTER", "CONNECTORS",
+	"POWER_DOMAIN"
+};
 
-	if (buf[1] != USB_DT_CS_INTERFACE)
-		printf("      Warning: Invalid descriptor\n");
-	else if (buf[0] < 3)
-		printf("      Warning: Descriptor too short\n");
-	printf("      AudioControl Interface Descriptor:\n"
-	       "        bLength             %5u\n"
-	       "        bDescriptorType     %5u\n"
-	       "        bDescriptorSubtype  %5u ",
-	       buf[0], buf[1], buf[2]);
+#define UAC_BIT(s)	(1U << UAC_INTERFACE_SUBTYPE_##s)
+#define UAC1_SUBTYPES	(UAC_BIT(HEADER) | UAC_BIT(INPUT_TERMINAL) \
+	| UAC_BIT(OUTPUT_TERMINAL) | UAC_BIT(MIXER_UNIT) \
+	| UAC_BIT(SELECTOR_UNIT) | UAC_BIT(FEATURE_UNIT) \
+	| UAC_BIT(PROCESSING_UNIT) | UAC_BIT(EXTENSION_UNIT))
+#define UAC2_SUBTYPES	(UAC1_SUBTYPES | UAC_BIT(EFFECT_UNIT) \
+	| UAC_BIT(CLOCK_SOURCE) | UAC_BIT(CLOCK_SELECTOR) \
+	| UAC_BIT(CLOCK_MULTIPLIER) | UAC_BIT(SAMPLE_RATE_CONVERTER))
+#define UAC3_SUBTYPES	(UAC2_SUBTYPES | UAC_BIT(EXTENDED_TERMINAL) \
+	| UAC_BIT(CONNECTORS) | UAC_BIT(POWER_DOMAIN))
 
-	subtype = get_uac_interface_subtype(buf[2], protocol);
+/*
+ * Fields of the UAC1 and UAC2 AudioControl descriptors past the common
+ * ones. UAC3 only gets its header decoded, its other descriptors and
+ * the units whose layout depends on the process type are shown as bytes.
+ */
+static void dump_audiocontrol_fields(libusb_device_handle *dev, LinePrinter &out,
+		enum uac_interface_subtype subtype, const unsigned char *buf,
+		int protocol)
+{
+	unsigned int i, n, p, len = 3;
+	int uac2 = protocol == USB_AUDIO_CLASS_2;
+
+	if (protocol == USB_AUDIO_CLASS_3
+			&& subtype != UAC_INTERFACE_SUBTYPE_HEADER)
+		goto bytes;
 
 	switch (subtype) {
 	case UAC_INTERFACE_SUBTYPE_HEADER:
-		dump_audio_subtype(dev, "HEADER", desc_audio_ac_header, buf, protocol, 4);
+		if (protocol == USB_AUDIO_CLASS_3) {
+			if (out.TooShort(buf, "      ", 11))
+				return;
+			uac_hex(out, 4, "wCategory", convert_le_u16(buf + 3), 2);
+			uac_hex(out, 4, "wTotalLength", convert_le_u16(buf + 5), 2);
+			uac_hex(out, 4, "bmControls", convert_le_u32(buf + 7), 4);
+			len = 11;
+			break;
+		}
+		if (out.TooShort(buf, "      ", uac2 ? 9 : 8)
+				|| (!uac2 && out.TooShort(buf, "      ", 8 + buf[7])))
+			return;
+		uac_bcd(out, 4, "bcdADC", buf + 3);
+		if (uac2) {
+			uac_hex(out, 4, "bCategory", buf[5], 1);
+			uac_hex(out, 4, "wTotalLength", convert_le_u16(buf + 6), 2);
+			uac_hex(out, 4, "bmControls", buf[8], 1);
+			len = 9;
+			break;
+		}
+		n = buf[7];
+		uac_hex(out, 4, "wTotalLength", convert_le_u16(buf + 5), 2);
+		uac_num(out, 4, "bInCollection", n);
+		uac_sources(out, 4, "baInterfaceNr", buf + 8, n);
+		len = 8 + n;
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_INPUT_TERMINAL:
-		dump_audio_subtype(dev, "INPUT_TERMINAL", desc_audio_ac_input_terminal, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", uac2 ? 17 : 12))
+			return;
+		uac_num(out, 4, "bTerminalID", buf[3]);
+		uac_terminal(out, 4, "wTerminalType", buf + 4);
+		uac_num(out, 4, "bAssocTerminal", buf[6]);
+		if (uac2) {
+			uac_num(out, 4, "bCSourceID", buf[7]);
+			uac_num(out, 4, "bNrChannels", buf[8]);
+			uac_hex(out, 4, "bmChannelConfig", convert_le_u32(buf + 9), 4);
+			uac_string(dev, out, 4, "iChannelNames", buf[13]);
+			uac_hex(out, 4, "bmControls", convert_le_u16(buf + 14), 2);
+			uac_string(dev, out, 4, "iTerminal", buf[16]);
+			len = 17;
+		} else {
+			uac_num(out, 4, "bNrChannels", buf[7]);
+			uac_hex(out, 4, "wChannelConfig", convert_le_u16(buf + 8), 2);
+			uac_string(dev, out, 4, "iChannelNames", buf[10]);
+			uac_string(dev, out, 4, "iTerminal", buf[11]);
+			len = 12;
+		}
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_OUTPUT_TERMINAL:
-		dump_audio_subtype(dev, "OUTPUT_TERMINAL", desc_audio_ac_output_terminal, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", uac2 ? 12 : 9))
+			return;
+		uac_num(out, 4, "bTerminalID", buf[3]);
+		uac_terminal(out, 4, "wTerminalType", buf + 4);
+		uac_num(out, 4, "bAssocTerminal", buf[6]);
+		uac_num(out, 4, "bSourceID", buf[7]);
+		if (uac2) {
+			uac_num(out, 4, "bCSourceID", buf[8]);
+			uac_hex(out, 4, "bmControls", convert_le_u16(buf + 9), 2);
+			uac_string(dev, out, 4, "iTerminal", buf[11]);
+			len = 12;
+		} else {
+			uac_string(dev, out, 4, "iTerminal", buf[8]);
+			len = 9;
+		}
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_MIXER_UNIT:
-		dump_audio_subtype(dev, "MIXER_UNIT", desc_audio_ac_mixer_unit, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", 5))
+			return;
+		p = buf[4];
+		/* bmMixerControls starts at n, iMixer follows it */
+		n = (uac2 ? 11 : 9) + p;
+		if (out.TooShort(buf, "      ", n + 1))
+			return;
+		uac_num(out, 4, "bUnitID", buf[3]);
+		uac_num(out, 4, "bNrInPins", p);
+		uac_sources(out, 4, "baSourceID", buf + 5, p);
+		uac_num(out, 4, "bNrChannels", buf[5 + p]);
+		if (uac2) {
+			uac_hex(out, 4, "bmChannelConfig", convert_le_u32(buf + 6 + p), 4);
+			uac_string(dev, out, 4, "iChannelNames", buf[10 + p]);
+		} else {
+			uac_hex(out, 4, "wChannelConfig", convert_le_u16(buf + 6 + p), 2);
+			uac_string(dev, out, 4, "iChannelNames", buf[8 + p]);
+		}
+		/* bmMixerControls fills everything up to the string index */
+		if (buf[0] > n + 1) {
+			out.Print("        bmMixerControls    ");
+			out.Bytes(buf + n, buf[0] - n - 1);
+		}
+		uac_string(dev, out, 4, "iMixer", buf[buf[0] - 1]);
+		len = buf[0];
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_SELECTOR_UNIT:
-		dump_audio_subtype(dev, "SELECTOR_UNIT", desc_audio_ac_selector_unit, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", 5)
+				|| out.TooShort(buf, "      ", 6 + buf[4] + uac2))
+			return;
+		p = buf[4];
+		uac_num(out, 4, "bUnitID", buf[3]);
+		uac_num(out, 4, "bNrInPins", p);
+		uac_sources(out, 4, "baSourceID", buf + 5, p);
+		if (uac2) {
+			uac_hex(out, 4, "bmControls", buf[5 + p], 1);
+			p++;
+		}
+		uac_string(dev, out, 4, "iSelector", buf[5 + p]);
+		len = 6 + p;
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_FEATURE_UNIT:
-		dump_audio_subtype(dev, "FEATURE_UNIT", desc_audio_ac_feature_unit, buf, protocol, 4);
-		break;
-
-	case UAC_INTERFACE_SUBTYPE_PROCESSING_UNIT:
-		dump_audio_subtype(dev, "PROCESSING_UNIT", desc_audio_ac_processing_unit, buf, protocol, 4);
-		break;
-
-	case UAC_INTERFACE_SUBTYPE_EXTENSION_UNIT:
-		dump_audio_subtype(dev, "EXTENSION_UNIT", desc_audio_ac_extension_unit, buf, protocol, 4);
+		/* the controls are sized from bLength */
+		if (out.TooShort(buf, "      ", uac2 ? 6 : 7))
+			return;
+		uac_num(out, 4, "bUnitID", buf[3]);
+		uac_num(out, 4, "bSourceID", buf[4]);
+		if (uac2) {
+			n = buf[0] >= 6 ? (buf[0] - 6) / 4 : 0;
+			for (i = 0; i < n; i++) {
+				char field[32];
+
+				snprintf(field, sizeof(field), "bmaControls(%2u)", i);
+				uac_hex(out, 4, field, convert_le_u32(buf + 5 + 4 * i), 4);
+			}
+			uac_string(dev, out, 4, "iFeature", buf[5 + 4 * n]);
+			len = 6 + 4 * n;
+			break;
+		}
+		p = buf[5];
+		uac_num(out, 4, "bControlSize", p);
+		n = (p && buf[0] >= 7) ? (buf[0] - 7) / p : 0;
+		for (i = 0; i < n; i++) {
+			char field[32];
+
+			snprintf(field, sizeof(field), "bmaControls(%2u)", i);
+			out.Print("        %-20s", field);
+			out.Bytes(buf + 6 + p * i, p);
+		}
+		uac_string(dev, out, 4, "iFeature", buf[6 + p * n]);
+		len = 7 + p * n;
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_CLOCK_SOURCE:
-		dump_audio_subtype(dev, "CLOCK_SOURCE", desc_audio_ac_clock_source, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", 8))
+			return;
+		uac_num(out, 4, "bClockID", buf[3]);
+		uac_hex(out, 4, "bmAttributes", buf[4], 1);
+		uac_hex(out, 4, "bmControls", buf[5], 1);
+		uac_num(out, 4, "bAssocTerminal", buf[6]);
+		uac_string(dev, out, 4, "iClockSource", buf[7]);
+		len = 8;
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_CLOCK_SELECTOR:
-		dump_audio_subtype(dev, "CLOCK_SELECTOR", desc_audio_ac_clock_selector, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", 5)
+				|| out.TooShort(buf, "      ", 7 + buf[4]))
+			return;
+		p = buf[4];
+		uac_num(out, 4, "bClockID", buf[3]);
+		uac_num(out, 4, "bNrInPins", p);
+		uac_sources(out, 4, "baCSourceID", buf + 5, p);
+		uac_hex(out, 4, "bmControls", buf[5 + p], 1);
+		uac_string(dev, out, 4, "iClockSelector", buf[6 + p]);
+		len = 7 + p;
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_CLOCK_MULTIPLIER:
-		dump_audio_subtype(dev, "CLOCK_MULTIPLIER", desc_audio_ac_clock_multiplier, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", 7))
+			return;
+		uac_num(out, 4, "bClockID", buf[3]);
+		uac_num(out, 4, "bCSourceID", buf[4]);
+		uac_hex(out, 4, "bmControls", buf[5], 1);
+		uac_string(dev, out, 4, "iClockMultiplier", buf[6]);
+		len = 7;
 		break;
 
 	case UAC_INTERFACE_SUBTYPE_SAMPLE_RATE_CONVERTER:
-		dump_audio_subtype(dev, "SAMPLING_RATE_CONVERTER", desc_audio_ac_clock_multiplier, buf, protocol, 4);
+		if (out.TooShort(buf, "      ", 8))
+			return;
+		uac_num(out, 4, "bUnitID", buf[3]);
+		uac_num(out, 4, "bSourceID", buf[4]);
+		uac_num(out, 4, "bCSourceInID", buf[5]);
+		uac_num(out, 4, "bCSourceOutID", buf[6]);
+		uac_string(dev, out, 4, "iSRC", buf[7]);
+		len = 8;
 		break;
 
-	case UAC_INTERFACE_SUBTYPE_EFFECT_UNIT:
-		dump_audio_subtype(dev, "EFFECT_UNIT", desc_audio_ac_effect_unit, buf, protocol, 4);
-		break;
+	default:
+		goto bytes;
+	}
 
-	case UAC_INTERFACE_SUBTYPE_POWER_DOMAIN:
-		dump_audio_subtype(dev, "POWER_DOMAIN", desc_audio_ac_power_domain, buf, protocol, 4);
-		break;
+	out.Junk(buf, "        ", len);
+	return;
 
-	default:
-		printf("(unknown)\n"
-		       "        Invalid desc subtype:");
-		dump_bytes(buf+3, buf[0]-3);
-		break;
+bytes:
+	if (buf[0] > 3) {
+		out.Print("        Descriptor data:   ");
+		out.Bytes(buf + 3, buf[0] - 3);
 	}
 }
 
+void UsbDevice::dump_audiocontrol_interface(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &intf_info)
+{
+	static const char * const strings[] = { "UAC1", "UAC2", "UAC3" };
+	LinePrinter out(intf_info);
+	int protocol = interface->bInterfaceProtocol;
+	enum uac_interface_subtype subtype;
+	unsigned int legal = UAC1_SUBTYPES, idx = 0;
+
+	if (buf[1] != USB_DT_CS_INTERFACE)
+		out.Print("      Warning: Invalid descriptor\n");
+	else if (out.TooShort(buf, "      ", 3))
+		return;
+	out.Print("      AudioControl Interface Descriptor:\n"
+	          "        bLength             %5u\n"
+	          "        bDescriptorType     %5u\n"
+	          "        bDescriptorSubtype  %5u ",
+	          buf[0], buf[1], buf[2]);
+
+	subtype = get_uac_interface_subtype(buf[2], protocol);
+	if (subtype == UAC_INTERFACE_SUBTYPE_AC_DESCRIPTOR_UNDEFINED
+			|| subtype > UAC_INTERFACE_SUBTYPE_POWER_DOMAIN) {
+		out.Print("(unknown)\n"
+		          "        Invalid desc subtype:");
+		out.Bytes(buf+3, buf[0]-3);
+		return;
+	}
+
+	switch (protocol) {
+	case USB_AUDIO_CLASS_2: idx = 1; legal = UAC2_SUBTYPES; break;
+	case USB_AUDIO_CLASS_3: idx = 2; legal = UAC3_SUBTYPES; break;
+	}
+
+	out.Print("(%s)\n", uac_subtype_names[subtype]);
+	if (!(legal & (1U << subtype))) {
+		out.Print("        Warning: %s descriptors are illegal for %s\n",
+		          uac_subtype_names[subtype], strings[idx]);
+		return;
+	}
+
+	dump_audiocontrol_fields(dev_handle_, out, subtype, buf, protocol);
+}
 
-static void dump_audiostreaming_interface(libusb_device_handle *dev, const unsigned char *buf, int protocol)
+void UsbDevice::dump_audiostreaming_interface(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &intf_info)
 {
-	static const char * const fmtItag[] = {
-		"TYPE_I_UNDEFINED", "PCM", "PCM8", "IEEE_FLOAT", "ALAW", "MULAW" };
-	static const char * const fmtIItag[] = { "TYPE_II_UNDEFINED", "MPEG", "AC-3" };
-	static const char * const fmtIIItag[] = {
-		"TYPE_III_UNDEFINED", "IEC1937_AC-3", "IEC1937_MPEG-1_Layer1",
-		"IEC1937_MPEG-Layer2/3/NOEXT", "IEC1937_MPEG-2_EXT",
-		"IEC1937_MPEG-2_Layer1_LS", "IEC1937_MPEG-2_Layer2/3_LS" };
+	LinePrinter out(intf_info);
+	int protocol = interface->bInterfaceProtocol;
 	unsigned int i, j, fmttag;
-	const char *fmtptr = "undefined";
-	char *name = NULL;
 
 	if (buf[1] != USB_DT_CS_INTERFACE)
-		printf("      Warning: Invalid descriptor\n");
-	else if (buf[0] < 3)
-		printf("      Warning: Descriptor too short\n");
-	printf("      AudioStreaming Interface Descriptor:\n"
-	       "        bLength             %5u\n"
-	       "        bDescriptorType     %5u\n"
-	       "        bDescriptorSubtype  %5u ",
-	       buf[0], buf[1], buf[2]);
+		out.Print("      Warning: Invalid descriptor\n");
+	else if (out.TooShort(buf, "      ", 3))
+		return;
+	out.Print("      AudioStreaming Interface Descriptor:\n"
+	          "        bLength             %5u\n"
+	          "        bDescriptorType     %5u\n"
+	          "        bDescriptorSubtype  %5u ",
+	          buf[0], buf[1], buf[2]);
 	switch (buf[2]) {
 	case 0x01: /* AS_GENERAL */
-		dump_audio_subtype(dev, "AS_GENERAL", desc_audio_as_interface, buf, protocol, 4);
+		out.Print("(AS_GENERAL)\n");
+		if (out.TooShort(buf, "      ",
+				protocol == USB_AUDIO_CLASS_1 ? 7 :
+				protocol == USB_AUDIO_CLASS_2 ? 16 : 4))
+			return;
+		uac_num(out, 4, "bTerminalLink", buf[3]);
+		if (protocol == USB_AUDIO_CLASS_1) {
+			fmttag = convert_le_u16(buf + 5);
+			uac_num(out, 4, "bDelay", buf[4]);
+			out.Print("        wFormatTag         0x%04x %s\n",
+			          fmttag, audio_format_tag(fmttag));
+			out.Junk(buf, "        ", 7);
+		} else if (protocol == USB_AUDIO_CLASS_2) {
+			uac_hex(out, 4, "bmControls", buf[4], 1);
+			uac_num(out, 4, "bFormatType", buf[5]);
+			uac_hex(out, 4, "bmFormats", convert_le_u32(buf + 6), 4);
+			uac_num(out, 4, "bNrChannels", buf[10]);
+			uac_hex(out, 4, "bmChannelConfig", convert_le_u32(buf + 11), 4);
+			uac_string(dev_handle_, out, 4, "iChannelNames", buf[15]);
+			out.Junk(buf, "        ", 16);
+		} else if (buf[0] > 4) {
+			out.Print("        Descriptor data:   ");
+			out.Bytes(buf + 4, buf[0] - 4);
+		}
 		break;
 
 	case 0x02: /* FORMAT_TYPE */
-		printf("(FORMAT_TYPE)\n");
+		out.Print("(FORMAT_TYPE)\n");
+		if (out.TooShort(buf, "      ", 4))
+			return;
 		switch (protocol) {
 		case USB_AUDIO_CLASS_1:
-			if (buf[0] < 8)
-				printf("      Warning: Descriptor too short\n");
-			printf("        bFormatType         %5u ", buf[3]);
+			if (out.TooShort(buf, "      ", 8))
+				return;
+			out.Print("        bFormatType         %5u ", buf[3]);
 			switch (buf[3]) {
 			case 0x01: /* FORMAT_TYPE_I */
-				printf("(FORMAT_TYPE_I)\n");
+				out.Print("(FORMAT_TYPE_I)\n");
 				j = buf[7] ? (buf[7]*3+8) : 14;
-				if (buf[0] < j)
-					printf("      Warning: Descriptor too short\n");
-				printf("        bNrChannels         %5u\n"
-				       "        bSubframeSize       %5u\n"
-				       "        bBitResolution      %5u\n"
-				       "        bSamFreqType        %5u %s\n",
-				       buf[4], buf[5], buf[6], buf[7], buf[7] ? "Discrete" : "Continuous");
+				if (out.TooShort(buf, "      ", j))
+					return;
+				out.Print("        bNrChannels         %5u\n"
+				          "        bSubframeSize       %5u\n"
+				          "        bBitResolution      %5u\n"
+				          "        bSamFreqType        %5u %s\n",
+				          buf[4], buf[5], buf[6], buf[7], buf[7] ? "Discrete" : "Continuous");
 				if (!buf[7])
-					printf("        tLowerSamFreq     %7u\n"
-					       "        tUpperSamFreq     %7u\n",
-					       buf[8] | (buf[9] << 8) | (buf[10] << 16), buf[11] | (buf[12] << 8) | (buf[13] << 16));
+					out.Print("        tLowerSamFreq     %7u\n"
+					          "        tUpperSamFreq     %7u\n",
+					          buf[8] | (buf[9] << 8) | (buf[10] << 16), buf[11] | (buf[12] << 8) | (buf[13] << 16));
 				else
 					for (i = 0; i < buf[7]; i++)
-						printf("        tSamFreq[%2u]      %7u\n", i,
-						       buf[8+3*i] | (buf[9+3*i] << 8) | (buf[10+3*i] << 16));
-				dump_junk(buf, "        ", j);
+						out.Print("        tSamFreq[%2u]      %7u\n", i,
+						          buf[8+3*i] | (buf[9+3*i] << 8) | (buf[10+3*i] << 16));
+				out.Junk(buf, "        ", j);
 				break;
 
 			case 0x02: /* FORMAT_TYPE_II */
-				printf("(FORMAT_TYPE_II)\n");
-				j = buf[8] ? (buf[7]*3+9) : 15;
-				if (buf[0] < j)
-					printf("      Warning: Descriptor too short\n");
-				printf("        wMaxBitRate         %5u\n"
-				       "        wSamplesPerFrame    %5u\n"
-				       "        bSamFreqType        %5u %s\n",
-				       buf[4] | (buf[5] << 8), buf[6] | (buf[7] << 8), buf[8], buf[8] ? "Discrete" : "Continuous");
+				out.Print("(FORMAT_TYPE_II)\n");
+				if (out.TooShort(buf, "      ", 9))
+					return;
+				j = buf[8] ? (buf[8]*3+9) : 15;
+				if (out.TooShort(buf, "      ", j))
+					return;
+				out.Print("        wMaxBitRate         %5u\n"
+				          "        wSamplesPerFrame    %5u\n"
+				          "        bSamFreqType        %5u %s\n",
+				          buf[4] | (buf[5] << 8), buf[6] | (buf[7] << 8), buf[8], buf[8] ? "Discrete" : "Continuous");
 				if (!buf[8])
-					printf("        tLowerSamFreq     %7u\n"
-					       "        tUpperSamFreq     %7u\n",
-					       buf[9] | (buf[10] << 8) | (buf[11] << 16), buf[12] | (buf[13] << 8) | (buf[14] << 16));
+					out.Print("        tLowerSamFreq     %7u\n"
+					          "        tUpperSamFreq     %7u\n",
+					          buf[9] | (buf[10] << 8) | (buf[11] << 16), buf[12] | (buf[13] << 8) | (buf[14] << 16));
 				else
 					for (i = 0; i < buf[8]; i++)
-						printf("        tSamFreq[%2u]      %7u\n", i,
-						       buf[9+3*i] | (buf[10+3*i] << 8) | (buf[11+3*i] << 16));
-				dump_junk(buf, "        ", j);
+						out.Print("        tSamFreq[%2u]      %7u\n", i,
+						          buf[9+3*i] | (buf[10+3*i] << 8) | (buf[11+3*i] << 16));
+				out.Junk(buf, "        ", j);
 				break;
 
 			case 0x03: /* FORMAT_TYPE_III */
-				printf("(FORMAT_TYPE_III)\n");
+				out.Print("(FORMAT_TYPE_III)\n");
 				j = buf[7] ? (buf[7]*3+8) : 14;
-				if (buf[0] < j)
-					printf("      Warning: Descriptor too short\n");
-				printf("        bNrChannels         %5u\n"
-				       "        bSubframeSize       %5u\n"
-				       "        bBitResolution      %5u\n"
-				       "        bSamFreqType        %5u %s\n",
-				       buf[4], buf[5], buf[6], buf[7], buf[7] ? "Discrete" : "Continuous");
+				if (out.TooShort(buf, "      ", j))
+					return;
+				out.Print("        bNrChannels         %5u\n"
+				          "        bSubframeSize       %5u\n"
+				          "        bBitResolution      %5u\n"
+				          "        bSamFreqType        %5u %s\n",
+				          buf[4], buf[5], buf[6], buf[7], buf[7] ? "Discrete" : "Continuous");
 				if (!buf[7])
-					printf("        tLowerSamFreq     %7u\n"
-					       "        tUpperSamFreq     %7u\n",
-					       buf[8] | (buf[9] << 8) | (buf[10] << 16), buf[11] | (buf[12] << 8) | (buf[13] << 16));
+					out.Print("        tLowerSamFreq     %7u\n"
+					          "        tUpperSamFreq     %7u\n",
+					          buf[8] | (buf[9] << 8) | (buf[10] << 16), buf[11] | (buf[12] << 8) | (buf[13] << 16));
 				else
 					for (i = 0; i < buf[7]; i++)
-						printf("        tSamFreq[%2u]      %7u\n", i,
-						       buf[8+3*i] | (buf[9+3*i] << 8) | (buf[10+3*i] << 16));
-				dump_junk(buf, "        ", j);
+						out.Print("        tSamFreq[%2u]      %7u\n", i,
+						          buf[8+3*i] | (buf[9+3*i] << 8) | (buf[10+3*i] << 16));
+				out.Junk(buf, "        ", j);
 				break;
 
 			default:
-				printf("(unknown)\n"
-				       "        Invalid desc format type:");
-				dump_bytes(buf+4, buf[0]-4);
+				out.Print("(unknown)\n"
+				          "        Invalid desc format type:");
+				out.Bytes(buf+4, buf[0]-4);
 			}
 
 			break;
 
 		case USB_AUDIO_CLASS_2:
-			printf("        bFormatType         %5u ", buf[3]);
+			out.Print("        bFormatType         %5u ", buf[3]);
 			switch (buf[3]) {
 			case 0x01: /* FORMAT_TYPE_I */
-				printf("(FORMAT_TYPE_I)\n");
-				if (buf[0] < 6)
-					printf("      Warning: Descriptor too short\n");
-				printf("        bSubslotSize        %5u\n"
-				       "        bBitResolution      %5u\n",
-				       buf[4], buf[5]);
-				dump_junk(buf, "        ", 6);
+				out.Print("(FORMAT_TYPE_I)\n");
+				if (out.TooShort(buf, "      ", 6))
+					return;
+				out.Print("        bSubslotSize        %5u\n"
+				          "        bBitResolution      %5u\n",
+				          buf[4], buf[5]);
+				out.Junk(buf, "        ", 6);
 				break;
 
 			case 0x02: /* FORMAT_TYPE_II */
-				printf("(FORMAT_TYPE_II)\n");
-				if (buf[0] < 8)
-					printf("      Warning: Descriptor too short\n");
-				printf("        wMaxBitRate         %5u\n"
-				       "        wSlotsPerFrame      %5u\n",
-				       buf[4] | (buf[5] << 8),
-				       buf[6] | (buf[7] << 8));
-				dump_junk(buf, "        ", 8);
+				out.Print("(FORMAT_TYPE_II)\n");
+				if (out.TooShort(buf, "      ", 8))
+					return;
+				out.Print("        wMaxBitRate         %5u\n"
+				          "        wSlotsPerFrame      %5u\n",
+				          buf[4] | (buf[5] << 8),
+				          buf[6] | (buf[7] << 8));
+				out.Junk(buf, "        ", 8);
 				break;
 
 			case 0x03: /* FORMAT_TYPE_III */
-				printf("(FORMAT_TYPE_III)\n");
-				if (buf[0] < 6)
-					printf("      Warning: Descriptor too short\n");
-				printf("        bSubslotSize        %5u\n"
-				       "        bBitResolution      %5u\n",
-				       buf[4], buf[5]);
-				dump_junk(buf, "        ", 6);
+				out.Print("(FORMAT_TYPE_III)\n");
+				if (out.TooShort(buf, "      ", 6))
+					return;
+				out.Print("        bSubslotSize        %5u\n"
+				          "        bBitResolution      %5u\n",
+				          buf[4], buf[5]);
+				out.Junk(buf, "        ", 6);
 				break;
 
 			case 0x04: /* FORMAT_TYPE_IV */
-				printf("(FORMAT_TYPE_IV)\n");
-				if (buf[0] < 4)
-					printf("      Warning: Descriptor too short\n");
-				printf("        bFormatType         %5u\n", buf[3]);
-				dump_junk(buf, "        ", 4);
+				out.Print("(FORMAT_TYPE_IV)\n");
+				if (out.TooShort(buf, "      ", 4))
+					return;
+				out.Print("        bFormatType         %5u\n", buf[3]);
+				out.Junk(buf, "        ", 4);
 				break;
 
 			default:
-				printf("(unknown)\n"
-				       "        Invalid desc format type:");
-				dump_bytes(buf+4, buf[0]-4);
+				out.Print("(unknown)\n"
+				          "        Invalid desc format type:");
+				out.Bytes(buf+4, buf[0]-4);
 			}
 
 			break;
@@ -386,286 +655,320 @@ static void dump_audiostreaming_interface(libusb_device_handle *dev, const unsig
 		break;
 
 	case 0x03: /* FORMAT_SPECIFIC */
-		printf("(FORMAT_SPECIFIC)\n");
-		if (buf[0] < 5)
-			printf("      Warning: Descriptor too short\n");
+		out.Print("(FORMAT_SPECIFIC)\n");
+		if (out.TooShort(buf, "      ", 5))
+			return;
 		fmttag = buf[3] | (buf[4] << 8);
-		if (fmttag <= 5)
-			fmtptr = fmtItag[fmttag];
-		else if (fmttag >= 0x1000 && fmttag <= 0x1002)
-			fmtptr = fmtIItag[fmttag & 0xfff];
-		else if (fmttag >= 0x2000 && fmttag <= 0x2006)
-			fmtptr = fmtIIItag[fmttag & 0xfff];
-		printf("        wFormatTag          %5u %s\n", fmttag, fmtptr);
+		out.Print("        wFormatTag          %5u %s\n", fmttag,
+		          audio_format_tag(fmttag));
 		switch (fmttag) {
 		case 0x1001: /* MPEG */
-			if (buf[0] < 8)
-				printf("      Warning: Descriptor too short\n");
-			printf("        bmMPEGCapabilities 0x%04x\n",
-			       buf[5] | (buf[6] << 8));
+			if (out.TooShort(buf, "      ", 8))
+				return;
+			out.Print("        bmMPEGCapabilities 0x%04x\n",
+			          buf[5] | (buf[6] << 8));
 			if (buf[5] & 0x01)
-				printf("          Layer I\n");
+				out.Print("          Layer I\n");
 			if (buf[5] & 0x02)
-				printf("          Layer II\n");
+				out.Print("          Layer II\n");
 			if (buf[5] & 0x04)
-				printf("          Layer III\n");
+				out.Print("          Layer III\n");
 			if (buf[5] & 0x08)
-				printf("          MPEG-1 only\n");
+				out.Print("          MPEG-1 only\n");
 			if (buf[5] & 0x10)
-				printf("          MPEG-1 dual-channel\n");
+				out.Print("          MPEG-1 dual-channel\n");
 			if (buf[5] & 0x20)
-				printf("          MPEG-2 second stereo\n");
+				out.Print("          MPEG-2 second stereo\n");
 			if (buf[5] & 0x40)
-				printf("          MPEG-2 7.1 channel augmentation\n");
+				out.Print("          MPEG-2 7.1 channel augmentation\n");
 			if (buf[5] & 0x80)
-				printf("          Adaptive multi-channel prediction\n");
-			printf("          MPEG-2 multilingual support: ");
+				out.Print("          Adaptive multi-channel prediction\n");
+			out.Print("          MPEG-2 multilingual support: ");
 			switch (buf[6] & 3) {
 			case 0:
-				printf("Not supported\n");
+				out.Print("Not supported\n");
 				break;
 
 			case 1:
-				printf("Supported at Fs\n");
+				out.Print("Supported at Fs\n");
 				break;
 
 			case 2:
-				printf("Reserved\n");
+				out.Print("Reserved\n");
 				break;
 
 			default:
-				printf("Supported at Fs and 1/2Fs\n");
+				out.Print("Supported at Fs and 1/2Fs\n");
 				break;
 			}
-			printf("        bmMPEGFeatures       0x%02x\n", buf[7]);
-			printf("          Internal Dynamic Range Control: ");
+			out.Print("        bmMPEGFeatures       0x%02x\n", buf[7]);
+			out.Print("          Internal Dynamic Range Control: ");
 			switch ((buf[7] >> 4) & 3) {
 			case 0:
-				printf("not supported\n");
+				out.Print("not supported\n");
 				break;
 
 			case 1:
-				printf("supported but not scalable\n");
+				out.Print("supported but not scalable\n");
 				break;
 
 			case 2:
-				printf("scalable, common boost and cut scaling value\n");
+				out.Print("scalable, common boost and cut scaling value\n");
 				break;
 
 			default:
-				printf("scalable, separate boost and cut scaling value\n");
+				out.Print("scalable, separate boost and cut scaling value\n");
 				break;
 			}
-			dump_junk(buf, "        ", 8);
+			out.Junk(buf, "        ", 8);
 			break;
 
 		case 0x1002: /* AC-3 */
-			if (buf[0] < 10)
-				printf("      Warning: Descriptor too short\n");
-			printf("        bmBSID         0x%08x\n"
-			       "        bmAC3Features        0x%02x\n",
-			       buf[5] | (buf[6] << 8) | (buf[7] << 16) | (buf[8] << 24), buf[9]);
+			if (out.TooShort(buf, "      ", 10))
+				return;
+			out.Print("        bmBSID         0x%08x\n"
+			          "        bmAC3Features        0x%02x\n",
+			          buf[5] | (buf[6] << 8) | (buf[7] << 16) | (buf[8] << 24), buf[9]);
 			if (buf[9] & 0x01)
-				printf("          RF mode\n");
+				out.Print("          RF mode\n");
 			if (buf[9] & 0x02)
-				printf("          Line mode\n");
+				out.Print("          Line mode\n");
 			if (buf[9] & 0x04)
-				printf("          Custom0 mode\n");
+				out.Print("          Custom0 mode\n");
 			if (buf[9] & 0x08)
-				printf("          Custom1 mode\n");
-			printf("          Internal Dynamic Range Control: ");
+				out.Print("          Custom1 mode\n");
+			out.Print("          Internal Dynamic Range Control: ");
 			switch ((buf[9] >> 4) & 3) {
 			case 0:
-				printf("not supported\n");
+				out.Print("not supported\n");
 				break;
 
 			case 1:
-				printf("supported but not scalable\n");
+				out.Print("supported but not scalable\n");
 				break;
 
 			case 2:
-				printf("scalable, common boost and cut scaling value\n");
+				out.Print("scalable, common boost and cut scaling value\n");
 				break;
 
 			default:
-				printf("scalable, separate boost and cut scaling value\n");
+				out.Print("scalable, separate boost and cut scaling value\n");
 				break;
 			}
-			dump_junk(buf, "        ", 8);
+			out.Junk(buf, "        ", 8);
 			break;
 
 		default:
-			printf("(unknown)\n"
-			       "        Invalid desc format type:");
-			dump_bytes(buf+4, buf[0]-4);
+			out.Print("(unknown)\n"
+			          "        Invalid desc format type:");
+			out.Bytes(buf+4, buf[0]-4);
 		}
 		break;
 
 	default:
-		printf("        Invalid desc subtype:");
-		dump_bytes(buf+3, buf[0]-3);
+		out.Print("        Invalid desc subtype:");
+		out.Bytes(buf+3, buf[0]-3);
 		break;
 	}
-
-	free(name);
 }
 
-static void dump_audiostreaming_endpoint(libusb_device_handle *dev, const unsigned char *buf, int protocol)
+void UsbDevice::dump_audiostreaming_endpoint(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &ep_info)
 {
-	static const char * const subtype[] = { "invalid", "EP_GENERAL" };
+	LinePrinter out(ep_info);
+	int protocol = interface->bInterfaceProtocol;
 
 	if (buf[1] != USB_DT_CS_ENDPOINT)
-		printf("      Warning: Invalid descriptor\n");
+		out.Print("      Warning: Invalid descriptor\n");
 
-	printf("        AudioStreaming Endpoint Descriptor:\n"
-	       "          bLength             %5u\n"
-	       "          bDescriptorType     %5u\n"
-	       "          bDescriptorSubtype  %5u ",
-	       buf[0], buf[1], buf[2]);
+	out.Print("        AudioStreaming Endpoint Descriptor:\n"
+	          "          bLength             %5u\n"
+	          "          bDescriptorType     %5u\n"
+	          "          bDescriptorSubtype  %5u ",
+	          buf[0], buf[1], buf[2]);
 
-	dump_audio_subtype(dev, subtype[buf[2] == 1],
-			desc_audio_as_isochronous_audio_data_endpoint, buf, protocol, 5);
+	if (buf[2] != 1) {
+		out.Print("(invalid)\n");
+		return;
+	}
+	out.Print("(EP_GENERAL)\n");
+	if (out.TooShort(buf, "      ",
+			protocol == USB_AUDIO_CLASS_2 ? 8 :
+			protocol == USB_AUDIO_CLASS_3 ? 10 : 7))
+		return;
+
+	switch (protocol) {
+	case USB_AUDIO_CLASS_1:
+		uac_hex(out, 5, "bmAttributes", buf[3], 1);
+		uac_num(out, 5, "bLockDelayUnits", buf[4]);
+		uac_num(out, 5, "wLockDelay", convert_le_u16(buf + 5));
+		out.Junk(buf, "          ", 7);
+		break;
+	case USB_AUDIO_CLASS_2:
+		uac_hex(out, 5, "bmAttributes", buf[3], 1);
+		uac_hex(out, 5, "bmControls", buf[4], 1);
+		uac_num(out, 5, "bLockDelayUnits", buf[5]);
+		uac_num(out, 5, "wLockDelay", convert_le_u16(buf + 6));
+		out.Junk(buf, "          ", 8);
+		break;
+	case USB_AUDIO_CLASS_3:
+		uac_hex(out, 5, "bmControls", convert_le_u32(buf + 3), 4);
+		uac_num(out, 5, "bLockDelayUnits", buf[7]);
+		uac_num(out, 5, "wLockDelay", convert_le_u16(buf + 8));
+		out.Junk(buf, "          ", 10);
+		break;
+	}
 }
 
-static void dump_midistreaming_interface(libusb_device_handle *dev, const unsigned char *buf)
+void UsbDevice::dump_midistreaming_interface(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &intf_info)
 {
+	LinePrinter out(intf_info);
 	static const char * const jacktypes[] = {"Undefined", "Embedded", "External"};
 	char *jackstr = NULL;
 	unsigned int j, tlength, capssize;
 	unsigned long caps;
 
 	if (buf[1] != USB_DT_CS_INTERFACE)
-		printf("      Warning: Invalid descriptor\n");
-	else if (buf[0] < 3)
-		printf("      Warning: Descriptor too short\n");
-	printf("      MIDIStreaming Interface Descriptor:\n"
-	       "        bLength             %5u\n"
-	       "        bDescriptorType     %5u\n"
-	       "        bDescriptorSubtype  %5u ",
-	       buf[0], buf[1], buf[2]);
+		out.Print("      Warning: Invalid descriptor\n");
+	else if (out.TooShort(buf, "      ", 3))
+		return;
+	out.Print("      MIDIStreaming Interface Descriptor:\n"
+	          "        bLength             %5u\n"
+	          "        bDescriptorType     %5u\n"
+	          "        bDescriptorSubtype  %5u ",
+	          buf[0], buf[1], buf[2]);
 	switch (buf[2]) {
 	case 0x01:
-		printf("(HEADER)\n");
-		if (buf[0] < 7)
-			printf("      Warning: Descriptor too short\n");
+		out.Print("(HEADER)\n");
+		if (out.TooShort(buf, "      ", 7))
+			break;
 		tlength = buf[5] | (buf[6] << 8);
-		printf("        bcdADC              %2x.%02x\n"
-		       "        wTotalLength       0x%04x\n",
-		       buf[4], buf[3], tlength);
-		dump_junk(buf, "        ", 7);
+		out.Print("        bcdADC              %2x.%02x\n"
+		          "        wTotalLength       0x%04x\n",
+		          buf[4], buf[3], tlength);
+		out.Junk(buf, "        ", 7);
 		break;
 
 	case 0x02:
-		printf("(MIDI_IN_JACK)\n");
-		if (buf[0] < 6)
-			printf("      Warning: Descriptor too short\n");
-		jackstr = get_dev_string(dev, buf[5]);
-		printf("        bJackType           %5u %s\n"
-		       "        bJackID             %5u\n"
-		       "        iJack               %5u %s\n",
-		       buf[3], buf[3] < 3 ? jacktypes[buf[3]] : "Invalid",
-		       buf[4], buf[5], jackstr);
-		dump_junk(buf, "        ", 6);
+		out.Print("(MIDI_IN_JACK)\n");
+		if (out.TooShort(buf, "      ", 6))
+			break;
+		jackstr = get_dev_string(dev_handle_, buf[5]);
+		out.Print("        bJackType           %5u %s\n"
+		          "        bJackID             %5u\n"
+		          "        iJack               %5u %s\n",
+		          buf[3], buf[3] < 3 ? jacktypes[buf[3]] : "Invalid",
+		          buf[4], buf[5], jackstr);
+		out.Junk(buf, "        ", 6);
 		break;
 
 	case 0x03:
-		printf("(MIDI_OUT_JACK)\n");
-		if (buf[0] < 9)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bJackType           %5u %s\n"
-		       "        bJackID             %5u\n"
-		       "        bNrInputPins        %5u\n",
-		       buf[3], buf[3] < 3 ? jacktypes[buf[3]] : "Invalid",
-		       buf[4], buf[5]);
+		out.Print("(MIDI_OUT_JACK)\n");
+		if (out.TooShort(buf, "      ", 6)
+				|| out.TooShort(buf, "      ", 7 + 2 * buf[5]))
+			break;
+		out.Print("        bJackType           %5u %s\n"
+		          "        bJackID             %5u\n"
+		          "        bNrInputPins        %5u\n",
+		          buf[3], buf[3] < 3 ? jacktypes[buf[3]] : "Invalid",
+		          buf[4], buf[5]);
 		for (j = 0; j < buf[5]; j++) {
-			printf("        baSourceID(%2u)      %5u\n"
-			       "        BaSourcePin(%2u)     %5u\n",
-			       j, buf[2*j+6], j, buf[2*j+7]);
+			out.Print("        baSourceID(%2u)      %5u\n"
+			          "        BaSourcePin(%2u)     %5u\n",
+			          j, buf[2*j+6], j, buf[2*j+7]);
 		}
 		j = 6+buf[5]*2; /* midi10.pdf says, incorrectly: 5+2*p */
-		jackstr = get_dev_string(dev, buf[j]);
-		printf("        iJack               %5u %s\n",
-		       buf[j], jackstr);
-		dump_junk(buf, "        ", j+1);
+		jackstr = get_dev_string(dev_handle_, buf[j]);
+		out.Print("        iJack               %5u %s\n",
+		          buf[j], jackstr);
+		out.Junk(buf, "        ", j+1);
 		break;
 
 	case 0x04:
-		printf("(ELEMENT)\n");
-		if (buf[0] < 12)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bElementID          %5u\n"
-		       "        bNrInputPins        %5u\n",
-		       buf[3], buf[4]);
+		out.Print("(ELEMENT)\n");
+		/* bElCapsSize follows the pins, iElement the caps */
+		if (out.TooShort(buf, "      ", 5)
+				|| out.TooShort(buf, "      ", 9 + 2 * buf[4])
+				|| out.TooShort(buf, "      ",
+					10 + 2 * buf[4] + buf[8 + 2 * buf[4]]))
+			break;
+		out.Print("        bElementID          %5u\n"
+		          "        bNrInputPins        %5u\n",
+		          buf[3], buf[4]);
 		for (j = 0; j < buf[4]; j++) {
-			printf("        baSourceID(%2u)      %5u\n"
-			       "        BaSourcePin(%2u)     %5u\n",
-			       j, buf[2*j+5], j, buf[2*j+6]);
+			out.Print("        baSourceID(%2u)      %5u\n"
+			          "        BaSourcePin(%2u)     %5u\n",
+			          j, buf[2*j+5], j, buf[2*j+6]);
 		}
 		j = 5+buf[4]*2;
-		printf("        bNrOutputPins       %5u\n"
-		       "        bInTerminalLink     %5u\n"
-		       "        bOutTerminalLink    %5u\n"
-		       "        bElCapsSize         %5u\n",
-		       buf[j], buf[j+1], buf[j+2], buf[j+3]);
+		out.Print("        bNrOutputPins       %5u\n"
+		          "        bInTerminalLink     %5u\n"
+		          "        bOutTerminalLink    %5u\n"
+		          "        bElCapsSize         %5u\n",
+		          buf[j], buf[j+1], buf[j+2], buf[j+3]);
 		capssize = buf[j+3];
 		caps = 0;
 		for (j = 0; j < capssize; j++)
 			caps |= (buf[j+9+buf[4]*2] << (8*j));
-		printf("        bmElementCaps  0x%08lx\n", caps);
+		out.Print("        bmElementCaps  0x%08lx\n", caps);
 		if (caps & 0x01)
-			printf("          Undefined\n");
+			out.Print("          Undefined\n");
 		if (caps & 0x02)
-			printf("          MIDI Clock\n");
+			out.Print("          MIDI Clock\n");
 		if (caps & 0x04)
-			printf("          MTC (MIDI Time Code)\n");
+			out.Print("          MTC (MIDI Time Code)\n");
 		if (caps & 0x08)
-			printf("          MMC (MIDI Machine Control)\n");
+			out.Print("          MMC (MIDI Machine Control)\n");
 		if (caps & 0x10)
-			printf("          GM1 (General MIDI v.1)\n");
+			out.Print("          GM1 (General MIDI v.1)\n");
 		if (caps & 0x20)
-			printf("          GM2 (General MIDI v.2)\n");
+			out.Print("          GM2 (General MIDI v.2)\n");
 		if (caps & 0x40)
-			printf("          GS MIDI Extension\n");
+			out.Print("          GS MIDI Extension\n");
 		if (caps & 0x80)
-			printf("          XG MIDI Extension\n");
+			out.Print("          XG MIDI Extension\n");
 		if (caps & 0x100)
-			printf("          EFX\n");
+			out.Print("          EFX\n");
 		if (caps & 0x200)
-			printf("          MIDI Patch Bay\n");
+			out.Print("          MIDI Patch Bay\n");
 		if (caps & 0x400)
-			printf("          DLS1 (Downloadable Sounds Level 1)\n");
+			out.Print("          DLS1 (Downloadable Sounds Level 1)\n");
 		if (caps & 0x800)
-			printf("          DLS2 (Downloadable Sounds Level 2)\n");
+			out.Print("          DLS2 (Downloadable Sounds Level 2)\n");
 		j = 9+2*buf[4]+capssize;
-		jackstr = get_dev_string(dev, buf[j]);
-		printf("        iElement            %5u %s\n", buf[j], jackstr);
-		dump_junk(buf, "        ", j+1);
+		jackstr = get_dev_string(dev_handle_, buf[j]);
+		out.Print("        iElement            %5u %s\n", buf[j], jackstr);
+		out.Junk(buf, "        ", j+1);
 		break;
 
 	default:
-		printf("\n        Invalid desc subtype: ");
-		dump_bytes(buf+3, buf[0]-3);
+		out.Print("\n        Invalid desc subtype: ");
+		out.Bytes(buf+3, buf[0]-3);
 		break;
 	}
 
 	free(jackstr);
 }
 
-static void dump_midistreaming_endpoint(const unsigned char *buf)
+void UsbDevice::dump_midistreaming_endpoint(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &ep_info)
 {
+	LinePrinter out(ep_info);
 	unsigned int j;
 
 	if (buf[1] != USB_DT_CS_ENDPOINT)
-		printf("      Warning: Invalid descriptor\n");
-	else if (buf[0] < 5)
-		printf("      Warning: Descriptor too short\n");
-	printf("        MIDIStreaming Endpoint Descriptor:\n"
-	       "          bLength             %5u\n"
-	       "          bDescriptorType     %5u\n"
-	       "          bDescriptorSubtype  %5u (%s)\n"
-	       "          bNumEmbMIDIJack     %5u\n",
-	       buf[0], buf[1], buf[2], buf[2] == 1 ? "GENERAL" : "Invalid", buf[3]);
+		out.Print("      Warning: Invalid descriptor\n");
+	if (out.TooShort(buf, "      ", 4)
+			|| out.TooShort(buf, "      ", 4 + buf[3]))
+		return;
+	out.Print("        MIDIStreaming Endpoint Descriptor:\n"
+	          "          bLength             %5u\n"
+	          "          bDescriptorType     %5u\n"
+	          "          bDescriptorSubtype  %5u (%s)\n"
+	          "          bNumEmbMIDIJack     %5u\n",
+	          buf[0], buf[1], buf[2], buf[2] == 1 ? "GENERAL" : "Invalid", buf[3]);
 	for (j = 0; j < buf[3]; j++)
-		printf("          baAssocJackID(%2u)   %5u\n", j, buf[4+j]);
-	dump_junk(buf, "          ", 4+buf[3]);
+		out.Print("          baAssocJackID(%2u)   %5u\n", j, buf[4+j]);
+	out.Junk(buf, "          ", 4+buf[3]);
 }
\ No newline at end of file
@@ -21,8 +21,13 @@
 #include "names.h"
 #include "usbmisc.h"
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <map>
 
 using namespace std;
 
@@ -226,6 +231,332 @@ static void dump_report_desc(unsigned char *b, int l, vector<string> &intf_info)
 	}
 }
 
+/*
+ * The HID core exposes the report descriptor it parsed for each HID
+ * device bound under an interface, as
+ *   <dev>:<config>.<intf>/<bus>:<vid>:<pid>.<id>/report_descriptor
+ * Reading it costs no bus traffic and does not need the interface to be
+ * claimed from usbhid. It reflects quirk fixups applied by the kernel, if
+ * any. Returns the descriptor length, or < 0 when not available.
+ */
+static int read_sysfs_report_desc(const string &sysfs_name, int config,
+		int intf, unsigned char *buf, unsigned int size)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *dir;
+	int n = -1;
+
+	snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s:%d.%d",
+			sysfs_name.c_str(), config, intf);
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+
+	while ((de = readdir(dir)) != NULL) {
+		unsigned int bus, vid, pid, id;
+		char file[PATH_MAX];
+		int fd, r;
+
+		if (sscanf(de->d_name, "%4x:%4x:%4x.%4x", &bus, &vid, &pid, &id) != 4)
+			continue;
+
+		snprintf(file, sizeof(file), "%s/%s/report_descriptor",
+				path, de->d_name);
+		fd = open(file, O_RDONLY);
+		if (fd < 0)
+			continue;
+		n = 0;
+		while ((unsigned int)n < size
+				&& (r = read(fd, buf + n, size - n)) > 0)
+			n += r;
+		close(fd);
+		break;
+	}
+
+	closedir(dir);
+	return n;
+}
+
+/*
+ * Report layout, as the HID parser in the host sees it: the main items
+ * of the report descriptor replayed through the global and local item
+ * state, grouped by report type and ID.
+ */
+#define HID_INPUT		0
+#define HID_OUTPUT		1
+#define HID_FEATURE		2
+
+struct HidField {
+	unsigned int usage_page;
+	unsigned int usage_min;		/* extended usages, page << 16 | id */
+	unsigned int usage_max;
+	unsigned int nusages;
+	unsigned int size;
+	unsigned int count;
+	unsigned int flags;
+	unsigned int depth;
+};
+
+struct HidReport {
+	unsigned int bits;
+	vector<HidField> fields;
+};
+
+struct HidGlobals {
+	unsigned int usage_page;
+	unsigned int report_size;
+	unsigned int report_count;
+	unsigned int report_id;
+};
+
+struct HidLayout {
+	map<unsigned int, HidReport> reports[3];	/* by report ID */
+	vector<string> collections;
+	bool uses_ids;
+};
+
+static const char * const hid_report_types[] = { "Input", "Output", "Feature" };
+
+static string hid_usage_name(unsigned int usage)
+{
+	const char *name = names_hutus(usage);
+	char buf[32];
+
+	if (name)
+		return name;
+	snprintf(buf, sizeof(buf), "0x%04x:0x%04x", usage >> 16, usage & 0xffff);
+	return buf;
+}
+
+static void parse_report_layout(const unsigned char *b, int l, HidLayout &layout)
+{
+	static const char * const collection_types[] = {
+		"Physical", "Application", "Logical", "Report",
+		"Named Array", "Usage Switch", "Usage Modifier"
+	};
+	vector<HidGlobals> stack;
+	HidGlobals g;
+	vector<unsigned int> usages;
+	unsigned int usage_min = 0, usage_max = 0;
+	bool have_range = false;
+	unsigned int depth = 0;
+	int i;
+
+	memset(&g, 0, sizeof(g));
+	layout.uses_ids = false;
+
+	for (i = 0; i < l; ) {
+		unsigned int bsize = b[i] & 0x03;
+		unsigned int btag = b[i] & ~0x03;
+		unsigned int data = 0;
+
+		if (bsize == 3)
+			bsize = 4;
+		/* long items carry no layout information */
+		if (b[i] == 0xfe) {
+			i += 3 + (i + 1 < l ? b[i + 1] : 0);
+			continue;
+		}
+		if (i + 1 + (int)bsize > l)
+			break;
+		for (unsigned int j = 0; j < bsize; j++)
+			data |= b[i + 1 + j] << (8 * j);
+
+		switch (btag) {
+		/* global items */
+		case 0x04: /* Usage Page */
+			g.usage_page = data;
+			break;
+		case 0x74: /* Report Size */
+			g.report_size = data;
+			break;
+		case 0x84: /* Report ID */
+			g.report_id = data;
+			layout.uses_ids = true;
+			break;
+		case 0x94: /* Report Count */
+			g.report_count = data;
+			break;
+		case 0xa4: /* Push */
+			stack.push_back(g);
+			break;
+		case 0xb4: /* Pop */
+			if (!stack.empty()) {
+				g = stack.back();
+				stack.pop_back();
+			}
+			break;
+
+		/* local items; 4 byte usages include their page */
+		case 0x08: /* Usage */
+			usages.push_back(bsize == 4 ? data : (g.usage_page << 16) | data);
+			break;
+		case 0x18: /* Usage Minimum */
+			usage_min = bsize == 4 ? data : (g.usage_page << 16) | data;
+			have_range = true;
+			break;
+		case 0x28: /* Usage Maximum */
+			usage_max = bsize == 4 ? data : (g.usage_page << 16) | data;
+			have_range = true;
+			break;
+
+		/* main items */
+		case 0x80: /* Input */
+		case 0x90: /* Output */
+		case 0xb0: { /* Feature */
+			int type = btag == 0x80 ? HID_INPUT :
+				btag == 0x90 ? HID_OUTPUT : HID_FEATURE;
+			HidReport &r = layout.reports[type][g.report_id];
+			HidField f;
+
+			f.usage_page = g.usage_page;
+			f.size = g.report_size;
+			f.count = g.report_count;
+			f.flags = data;
+			f.depth = depth;
+			if (have_range) {
+				f.usage_min = usage_min;
+				f.usage_max = usage_max;
+				f.nusages = usage_max >= usage_min ?
+					usage_max - usage_min + 1 : 0;
+			} else if (!usages.empty()) {
+				f.usage_min = usages.front();
+				f.usage_max = usages.back();
+				f.nusages = usages.size();
+			} else {
+				f.usage_min = f.usage_max = 0;
+				f.nusages = 0;
+			}
+			r.fields.push_back(f);
+			r.bits += f.size * f.count;
+			break;
+		}
+		case 0xa0: { /* Collection */
+			char line[128];
+
+			snprintf(line, 128, "%*sCollection %s (%s)", 2 * depth, "",
+				data < 7 ? collection_types[data] :
+					(data & 0x80) ? "Vendor defined" : "Reserved",
+				usages.empty() ? "no usage" :
+					hid_usage_name(usages.front()).c_str());
+			layout.collections.push_back(line);
+			depth++;
+			break;
+		}
+		case 0xc0: /* End Collection */
+			if (depth)
+				depth--;
+			break;
+		}
+
+		/* local state only lives until the next main item */
+		if ((b[i] & 0x0c) == 0x00) {
+			usages.clear();
+			have_range = false;
+		}
+		i += 1 + bsize;
+	}
+}
+
+void UsbDevice::dump_report_layout(const unsigned char *b, int l,
+		const struct libusb_interface_descriptor *interface,
+		vector<string> &intf_info)
+{
+	const struct libusb_endpoint_descriptor *ep = NULL;
+	unsigned int largest = 0, largest_id = 0;
+	HidLayout layout;
+	char line[128];
+
+	parse_report_layout(b, l, layout);
+
+	intf_info.push_back("          Report Layout:");
+	for (unsigned int i = 0; i < layout.collections.size(); i++) {
+		snprintf(line, 128, "            %s", layout.collections[i].c_str());
+		intf_info.push_back(line);
+	}
+
+	for (int type = HID_INPUT; type <= HID_FEATURE; type++) {
+		map<unsigned int, HidReport>::iterator it;
+
+		for (it = layout.reports[type].begin();
+				it != layout.reports[type].end(); ++it) {
+			HidReport &r = it->second;
+			/* the report ID is sent as a prefix byte */
+			unsigned int bytes = (r.bits + 7) / 8 + (layout.uses_ids ? 1 : 0);
+
+			if (type == HID_INPUT && bytes > largest) {
+				largest = bytes;
+				largest_id = it->first;
+			}
+
+			snprintf(line, 128, "            %s Report %u: %u bytes (%u bits of data)",
+					hid_report_types[type], it->first, bytes, r.bits);
+			intf_info.push_back(line);
+
+			for (unsigned int j = 0; j < r.fields.size(); j++) {
+				const HidField &f = r.fields[j];
+				string usage;
+
+				if (f.flags & 0x01)
+					usage = "Padding";
+				else if (!f.nusages)
+					usage = "(no usage)";
+				else if (f.nusages == 1)
+					usage = hid_usage_name(f.usage_min);
+				else
+					usage = hid_usage_name(f.usage_min) + " .. "
+						+ hid_usage_name(f.usage_max);
+
+				snprintf(line, 128, "              %3u x %2u bits %-5s %s",
+						f.count, f.size,
+						(f.flags & 0x01) ? "Const" :
+						(f.flags & 0x02) ? "Var" : "Array",
+						usage.c_str());
+				intf_info.push_back(line);
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < interface->bNumEndpoints; i++) {
+		const struct libusb_endpoint_descriptor *e = &interface->endpoint[i];
+
+		if ((e->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == LIBUSB_TRANSFER_TYPE_INTERRUPT
+				&& (e->bEndpointAddress & LIBUSB_ENDPOINT_IN)) {
+			ep = e;
+			break;
+		}
+	}
+	if (!ep || !largest)
+		return;
+
+	unsigned int wmax = le16_to_cpu(ep->wMaxPacketSize);
+	unsigned int per_interval = (wmax & 0x7ff) *
+		(speed_ == LIBUSB_SPEED_HIGH ? ((wmax >> 11) & 0x3) + 1 : 1);
+	unsigned int period_us = getEndpointPeriod(ep);
+	unsigned int intervals;
+
+	if (!per_interval)
+		return;
+	intervals = (largest + per_interval - 1) / per_interval;
+
+	intf_info.push_back("          Report Rate:");
+	snprintf(line, 128, "            Largest Input Report  %u bytes (ID %u)",
+			largest, largest_id);
+	intf_info.push_back(line);
+	snprintf(line, 128, "            Interrupt Endpoint    0x%02x, %u bytes every %u us",
+			ep->bEndpointAddress, per_interval, period_us);
+	intf_info.push_back(line);
+	snprintf(line, 128, "            Achievable Rate       %u reports/s",
+			1000000 / (period_us * intervals));
+	intf_info.push_back(line);
+	if (intervals > 1) {
+		snprintf(line, 128, "            Warning: report split across %u intervals",
+				intervals);
+		intf_info.push_back(line);
+	}
+}
+
 void UsbDevice::dump_hid_device(
 			    const struct libusb_interface_descriptor *interface,
 			    const unsigned char *buf,
@@ -266,11 +597,21 @@ void UsbDevice::dump_hid_device(
 		intf_info.push_back(line);
 	}
 
-	dump_junk(buf, "        ", 6+3*buf[5], (char **)line, 128);
-	intf_info.push_back(line);
+	dump_junk(buf, "        ", 6+3*buf[5], intf_info);
 	if (!do_report_desc)
 		return;
 
+	/* sysfs only knows about interfaces of the active configuration */
+	if (cur_config_ == getActiveConfig()) {
+		int r = read_sysfs_report_desc(sysfs_name_, cur_config_,
+				interface->bInterfaceNumber, dbuf, sizeof(dbuf));
+		if (r > 0) {
+			dump_report_desc(dbuf, r, intf_info);
+			dump_report_layout(dbuf, r, interface, intf_info);
+			return;
+		}
+	}
+
 	if (!dev_handle_) {
 		snprintf(line, 128, "         Report Descriptors: \n");
 		intf_info.push_back(line);
@@ -308,6 +649,7 @@ void UsbDevice::dump_hid_device(
 					intf_info.push_back(line);
 				}
 				dump_report_desc(dbuf, n, intf_info);
+				dump_report_layout(dbuf, n, interface, intf_info);
 			}
 			libusb_release_interface(dev_handle_, interface->bInterfaceNumber);
 		} else {
@@ -18,6 +18,7 @@
 */
 
 #include "usbdevice.h"
+#include "lineprinter.h"
 #include "names.h"
 #include "usbmisc.h"
 
@@ -30,7 +31,8 @@ using namespace std;
  * Video Class descriptor dump
  */
 
-static void dump_videocontrol_interface(libusb_device_handle *dev, const unsigned char *buf, int protocol)
+void UsbDevice::dump_videocontrol_interface(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &intf_info)
 {
 	static const char * const ctrlnames[] = {
 		"Brightness", "Contrast", "Hue", "Saturation", "Sharpness", "Gamma",
@@ -58,200 +60,213 @@ static void dump_videocontrol_interface(libusb_device_handle *dev, const unsigne
 	static const char * const stdnames[] = {
 		"None", "NTSC - 525/60", "PAL - 625/50", "SECAM - 625/50",
 		"NTSC - 625/50", "PAL - 525/60" };
+	LinePrinter out(intf_info);
+	int protocol = interface->bInterfaceProtocol;
 	unsigned int i, ctrls, stds, n, p, termt, freq;
 	char *term = NULL, termts[128];
 
 	if (buf[1] != USB_DT_CS_INTERFACE)
-		printf("      Warning: Invalid descriptor\n");
-	else if (buf[0] < 3)
-		printf("      Warning: Descriptor too short\n");
-	printf("      VideoControl Interface Descriptor:\n"
-	       "        bLength             %5u\n"
-	       "        bDescriptorType     %5u\n"
-	       "        bDescriptorSubtype  %5u ",
-	       buf[0], buf[1], buf[2]);
+		out.Print("      Warning: Invalid descriptor\n");
+	else if (out.TooShort(buf, "      ", 3))
+		return;
+	out.Print("      VideoControl Interface Descriptor:\n"
+	          "        bLength             %5u\n"
+	          "        bDescriptorType     %5u\n"
+	          "        bDescriptorSubtype  %5u ",
+	          buf[0], buf[1], buf[2]);
 	switch (buf[2]) {
 	case 0x01:  /* HEADER */
-		printf("(HEADER)\n");
+		out.Print("(HEADER)\n");
+		if (out.TooShort(buf, "      ", 12)
+				|| out.TooShort(buf, "      ", 12+buf[11]))
+			break;
 		n = buf[11];
-		if (buf[0] < 12+n)
-			printf("      Warning: Descriptor too short\n");
 		freq = buf[7] | (buf[8] << 8) | (buf[9] << 16) | (buf[10] << 24);
-		printf("        bcdUVC              %2x.%02x\n"
-		       "        wTotalLength       0x%04x\n"
-		       "        dwClockFrequency    %5u.%06uMHz\n"
-		       "        bInCollection       %5u\n",
-		       buf[4], buf[3], buf[5] | (buf[6] << 8), freq / 1000000,
-		       freq % 1000000, n);
+		out.Print("        bcdUVC              %2x.%02x\n"
+		          "        wTotalLength       0x%04x\n"
+		          "        dwClockFrequency    %5u.%06uMHz\n"
+		          "        bInCollection       %5u\n",
+		          buf[4], buf[3], buf[5] | (buf[6] << 8), freq / 1000000,
+		          freq % 1000000, n);
 		for (i = 0; i < n; i++)
-			printf("        baInterfaceNr(%2u)   %5u\n", i, buf[12+i]);
-		dump_junk(buf, "        ", 12+n);
+			out.Print("        baInterfaceNr(%2u)   %5u\n", i, buf[12+i]);
+		out.Junk(buf, "        ", 12+n);
 		break;
 
 	case 0x02:  /* INPUT_TERMINAL */
-		printf("(INPUT_TERMINAL)\n");
-		term = get_dev_string(dev, buf[7]);
+		out.Print("(INPUT_TERMINAL)\n");
+		if (out.TooShort(buf, "      ", 8))
+			break;
 		termt = buf[4] | (buf[5] << 8);
 		n = termt == 0x0201 ? 7 : 0;
+		/* a camera's bmControls is bControlSize long */
+		if (out.TooShort(buf, "      ", 8 + n)
+				|| (n && out.TooShort(buf, "      ", 15 + buf[14])))
+			break;
+		term = get_dev_string(dev_handle_, buf[7]);
 		get_videoterminal_string(termts, sizeof(termts), termt);
-		if (buf[0] < 8 + n)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bTerminalID         %5u\n"
-		       "        wTerminalType      0x%04x %s\n"
-		       "        bAssocTerminal      %5u\n",
-		       buf[3], termt, termts, buf[6]);
-		printf("        iTerminal           %5u %s\n",
-		       buf[7], term);
+		out.Print("        bTerminalID         %5u\n"
+		          "        wTerminalType      0x%04x %s\n"
+		          "        bAssocTerminal      %5u\n",
+		          buf[3], termt, termts, buf[6]);
+		out.Print("        iTerminal           %5u %s\n",
+		          buf[7], term);
 		if (termt == 0x0201) {
 			n += buf[14];
-			printf("        wObjectiveFocalLengthMin  %5u\n"
-			       "        wObjectiveFocalLengthMax  %5u\n"
-			       "        wOcularFocalLength        %5u\n"
-			       "        bControlSize              %5u\n",
-			       buf[8] | (buf[9] << 8), buf[10] | (buf[11] << 8),
-			       buf[12] | (buf[13] << 8), buf[14]);
+			out.Print("        wObjectiveFocalLengthMin  %5u\n"
+			          "        wObjectiveFocalLengthMax  %5u\n"
+			          "        wOcularFocalLength        %5u\n"
+			          "        bControlSize              %5u\n",
+			          buf[8] | (buf[9] << 8), buf[10] | (buf[11] << 8),
+			          buf[12] | (buf[13] << 8), buf[14]);
 			ctrls = 0;
 			for (i = 0; i < 3 && i < buf[14]; i++)
 				ctrls = (ctrls << 8) | buf[8+n-i-1];
-			printf("        bmControls           0x%08x\n", ctrls);
+			out.Print("        bmControls           0x%08x\n", ctrls);
 			if (protocol == USB_VIDEO_PROTOCOL_15) {
 				for (i = 0; i < 22; i++)
 					if ((ctrls >> i) & 1)
-						printf("          %s\n", camctrlnames[i]);
+						out.Print("          %s\n", camctrlnames[i]);
 			}
 			else {
 				for (i = 0; i < 19; i++)
 					if ((ctrls >> i) & 1)
-						printf("          %s\n", camctrlnames[i]);
+						out.Print("          %s\n", camctrlnames[i]);
 			}
 		}
-		dump_junk(buf, "        ", 8+n);
+		out.Junk(buf, "        ", 8+n);
 		break;
 
 	case 0x03:  /* OUTPUT_TERMINAL */
-		printf("(OUTPUT_TERMINAL)\n");
-		term = get_dev_string(dev, buf[8]);
+		out.Print("(OUTPUT_TERMINAL)\n");
+		if (out.TooShort(buf, "      ", 9))
+			break;
+		term = get_dev_string(dev_handle_, buf[8]);
 		termt = buf[4] | (buf[5] << 8);
 		get_videoterminal_string(termts, sizeof(termts), termt);
-		if (buf[0] < 9)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bTerminalID         %5u\n"
-		       "        wTerminalType      0x%04x %s\n"
-		       "        bAssocTerminal      %5u\n"
-		       "        bSourceID           %5u\n"
-		       "        iTerminal           %5u %s\n",
-		       buf[3], termt, termts, buf[6], buf[7], buf[8], term);
-		dump_junk(buf, "        ", 9);
+		out.Print("        bTerminalID         %5u\n"
+		          "        wTerminalType      0x%04x %s\n"
+		          "        bAssocTerminal      %5u\n"
+		          "        bSourceID           %5u\n"
+		          "        iTerminal           %5u %s\n",
+		          buf[3], termt, termts, buf[6], buf[7], buf[8], term);
+		out.Junk(buf, "        ", 9);
 		break;
 
 	case 0x04:  /* SELECTOR_UNIT */
-		printf("(SELECTOR_UNIT)\n");
+		out.Print("(SELECTOR_UNIT)\n");
+		if (out.TooShort(buf, "      ", 5)
+				|| out.TooShort(buf, "      ", 6+buf[4]))
+			break;
 		p = buf[4];
-		if (buf[0] < 6+p)
-			printf("      Warning: Descriptor too short\n");
-		term = get_dev_string(dev, buf[5+p]);
+		term = get_dev_string(dev_handle_, buf[5+p]);
 
-		printf("        bUnitID             %5u\n"
-		       "        bNrInPins           %5u\n",
-		       buf[3], p);
+		out.Print("        bUnitID             %5u\n"
+		          "        bNrInPins           %5u\n",
+		          buf[3], p);
 		for (i = 0; i < p; i++)
-			printf("        baSource(%2u)        %5u\n", i, buf[5+i]);
-		printf("        iSelector           %5u %s\n",
-		       buf[5+p], term);
-		dump_junk(buf, "        ", 6+p);
+			out.Print("        baSource(%2u)        %5u\n", i, buf[5+i]);
+		out.Print("        iSelector           %5u %s\n",
+		          buf[5+p], term);
+		out.Junk(buf, "        ", 6+p);
 		break;
 
 	case 0x05:  /* PROCESSING_UNIT */
-		printf("(PROCESSING_UNIT)\n");
+		out.Print("(PROCESSING_UNIT)\n");
+		if (out.TooShort(buf, "      ", 8)
+				|| out.TooShort(buf, "      ", 10+buf[7]))
+			break;
 		n = buf[7];
-		term = get_dev_string(dev, buf[8+n]);
-		if (buf[0] < 10+n)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bUnitID             %5u\n"
-		       "        bSourceID           %5u\n"
-		       "        wMaxMultiplier      %5u\n"
-		       "        bControlSize        %5u\n",
-		       buf[3], buf[4], buf[5] | (buf[6] << 8), n);
+		term = get_dev_string(dev_handle_, buf[8+n]);
+		out.Print("        bUnitID             %5u\n"
+		          "        bSourceID           %5u\n"
+		          "        wMaxMultiplier      %5u\n"
+		          "        bControlSize        %5u\n",
+		          buf[3], buf[4], buf[5] | (buf[6] << 8), n);
 		ctrls = 0;
 		for (i = 0; i < 3 && i < n; i++)
 			ctrls = (ctrls << 8) | buf[8+n-i-1];
-		printf("        bmControls     0x%08x\n", ctrls);
+		out.Print("        bmControls     0x%08x\n", ctrls);
 		if (protocol == USB_VIDEO_PROTOCOL_15) {
 			for (i = 0; i < 19; i++)
 				if ((ctrls >> i) & 1)
-					printf("          %s\n", ctrlnames[i]);
+					out.Print("          %s\n", ctrlnames[i]);
 		}
 		else {
 			for (i = 0; i < 18; i++)
 				if ((ctrls >> i) & 1)
-					printf("          %s\n", ctrlnames[i]);
+					out.Print("          %s\n", ctrlnames[i]);
 		}
 		stds = buf[9+n];
-		printf("        iProcessing         %5u %s\n"
-		       "        bmVideoStandards     0x%02x\n", buf[8+n], term, stds);
+		out.Print("        iProcessing         %5u %s\n"
+		          "        bmVideoStandards     0x%02x\n", buf[8+n], term, stds);
 		for (i = 0; i < 6; i++)
 			if ((stds >> i) & 1)
-				printf("          %s\n", stdnames[i]);
+				out.Print("          %s\n", stdnames[i]);
 		break;
 
 	case 0x06:  /* EXTENSION_UNIT */
-		printf("(EXTENSION_UNIT)\n");
+		out.Print("(EXTENSION_UNIT)\n");
+		if (out.TooShort(buf, "      ", 22)
+				|| out.TooShort(buf, "      ", 23+buf[21]))
+			break;
 		p = buf[21];
 		n = buf[22+p];
-		term = get_dev_string(dev, buf[23+p+n]);
-		if (buf[0] < 24+p+n)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bUnitID             %5u\n"
-		       "        guidExtensionCode         %s\n"
-		       "        bNumControl         %5u\n"
-		       "        bNrPins             %5u\n",
-		       buf[3], get_guid(&buf[4]), buf[20], buf[21]);
+		if (out.TooShort(buf, "      ", 24+p+n))
+			break;
+		term = get_dev_string(dev_handle_, buf[23+p+n]);
+		out.Print("        bUnitID             %5u\n"
+		          "        guidExtensionCode         %s\n"
+		          "        bNumControl         %5u\n"
+		          "        bNrPins             %5u\n",
+		          buf[3], get_guid(&buf[4]), buf[20], buf[21]);
 		for (i = 0; i < p; i++)
-			printf("        baSourceID(%2u)      %5u\n", i, buf[22+i]);
-		printf("        bControlSize        %5u\n", buf[22+p]);
+			out.Print("        baSourceID(%2u)      %5u\n", i, buf[22+i]);
+		out.Print("        bControlSize        %5u\n", buf[22+p]);
 		for (i = 0; i < n; i++)
-			printf("        bmControls(%2u)       0x%02x\n", i, buf[23+p+i]);
-		printf("        iExtension          %5u %s\n",
-		       buf[23+p+n], term);
-		dump_junk(buf, "        ", 24+p+n);
+			out.Print("        bmControls(%2u)       0x%02x\n", i, buf[23+p+i]);
+		out.Print("        iExtension          %5u %s\n",
+		          buf[23+p+n], term);
+		out.Junk(buf, "        ", 24+p+n);
 		break;
 
 	case 0x07: /* ENCODING UNIT */
-		printf("(ENCODING UNIT)\n");
-		term = get_dev_string(dev, buf[5]);
-		if (buf[0] < 13)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bUnitID             %5u\n"
-		       "        bSourceID           %5u\n"
-		       "        iEncoding           %5u %s\n"
-		       "        bControlSize        %5u\n",
-		       buf[3], buf[4], buf[5], term, buf[6]);
+		out.Print("(ENCODING UNIT)\n");
+		if (out.TooShort(buf, "      ", 13))
+			break;
+		term = get_dev_string(dev_handle_, buf[5]);
+		out.Print("        bUnitID             %5u\n"
+		          "        bSourceID           %5u\n"
+		          "        iEncoding           %5u %s\n"
+		          "        bControlSize        %5u\n",
+		          buf[3], buf[4], buf[5], term, buf[6]);
 		ctrls = 0;
 		for (i = 0; i < 3; i++)
 			ctrls = (ctrls << 8) | buf[9-i];
-		printf("        bmControls              0x%08x\n", ctrls);
+		out.Print("        bmControls              0x%08x\n", ctrls);
 		for (i = 0; i < 20;  i++)
 			if ((ctrls >> i) & 1)
-				printf("          %s\n", enctrlnames[i]);
+				out.Print("          %s\n", enctrlnames[i]);
 		for (i = 0; i< 3; i++)
 			ctrls = (ctrls << 8) | buf[12-i];
-		printf("        bmControlsRuntime       0x%08x\n", ctrls);
+		out.Print("        bmControlsRuntime       0x%08x\n", ctrls);
 		for (i = 0; i < 20; i++)
 			if ((ctrls >> i) & 1)
-				printf("          %s\n", enctrlnames[i]);
+				out.Print("          %s\n", enctrlnames[i]);
 		break;
 
 	default:
-		printf("(unknown)\n"
-		       "        Invalid desc subtype:");
-		dump_bytes(buf+3, buf[0]-3);
+		out.Print("(unknown)\n"
+		          "        Invalid desc subtype:");
+		out.Bytes(buf+3, buf[0]-3);
 		break;
 	}
 
 	free(term);
 }
 
-static void dump_videostreaming_interface(const unsigned char *buf)
+void UsbDevice::dump_videostreaming_interface(const struct libusb_interface_descriptor *interface,
+		const unsigned char *buf, vector<string> &intf_info)
 {
 	static const char * const colorPrims[] = { "Unspecified", "BT.709,sRGB",
 		"BT.470-2 (M)", "BT.470-2 (B,G)", "SMPTE 170M", "SMPTE 240M" };
@@ -260,305 +275,287 @@ static void dump_videostreaming_interface(const unsigned char *buf)
 		"Linear", "sRGB"};
 	static const char * const matrixCoeffs[] = { "Unspecified", "BT.709",
 		"FCC", "BT.470-2 (B,G)", "SMPTE 170M (BT.601)", "SMPTE 240M" };
+	LinePrinter out(intf_info);
 	unsigned int i, m, n, p, flags, len;
 
 	if (buf[1] != USB_DT_CS_INTERFACE)
-		printf("      Warning: Invalid descriptor\n");
-	else if (buf[0] < 3)
-		printf("      Warning: Descriptor too short\n");
-	printf("      VideoStreaming Interface Descriptor:\n"
-	       "        bLength                         %5u\n"
-	       "        bDescriptorType                 %5u\n"
-	       "        bDescriptorSubtype              %5u ",
-	       buf[0], buf[1], buf[2]);
+		out.Print("      Warning: Invalid descriptor\n");
+	else if (out.TooShort(buf, "      ", 3))
+		return;
+	out.Print("      VideoStreaming Interface Descriptor:\n"
+	          "        bLength                         %5u\n"
+	          "        bDescriptorType                 %5u\n"
+	          "        bDescriptorSubtype              %5u ",
+	          buf[0], buf[1], buf[2]);
 	switch (buf[2]) {
 	case 0x01: /* INPUT_HEADER */
-		printf("(INPUT_HEADER)\n");
+		out.Print("(INPUT_HEADER)\n");
+		if (out.TooShort(buf, "      ", 13)
+				|| out.TooShort(buf, "      ", 13+buf[3]*buf[12]))
+			return;
 		p = buf[3];
 		n = buf[12];
-		if (buf[0] < 13+p*n)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bNumFormats                     %5u\n"
-		       "        wTotalLength                   0x%04x\n"
-		       "        bEndPointAddress                %5u\n"
-		       "        bmInfo                          %5u\n"
-		       "        bTerminalLink                   %5u\n"
-		       "        bStillCaptureMethod             %5u\n"
-		       "        bTriggerSupport                 %5u\n"
-		       "        bTriggerUsage                   %5u\n"
-		       "        bControlSize                    %5u\n",
-		       p, buf[4] | (buf[5] << 8), buf[6], buf[7], buf[8],
-		       buf[9], buf[10], buf[11], n);
+		out.Print("        bNumFormats                     %5u\n"
+		          "        wTotalLength                   0x%04x\n"
+		          "        bEndPointAddress                %5u\n"
+		          "        bmInfo                          %5u\n"
+		          "        bTerminalLink                   %5u\n"
+		          "        bStillCaptureMethod             %5u\n"
+		          "        bTriggerSupport                 %5u\n"
+		          "        bTriggerUsage                   %5u\n"
+		          "        bControlSize                    %5u\n",
+		          p, buf[4] | (buf[5] << 8), buf[6], buf[7], buf[8],
+		          buf[9], buf[10], buf[11], n);
 		for (i = 0; i < p; i++)
-			printf(
+			out.Print(
 			"        bmaControls(%2u)                 %5u\n",
 				i, buf[13+i*n]);
-		dump_junk(buf, "        ", 13+p*n);
+		out.Junk(buf, "        ", 13+p*n);
 		break;
 
 	case 0x02: /* OUTPUT_HEADER */
-		printf("(OUTPUT_HEADER)\n");
+		out.Print("(OUTPUT_HEADER)\n");
+		if (out.TooShort(buf, "      ", 9)
+				|| out.TooShort(buf, "      ", 9+buf[3]*buf[8]))
+			return;
 		p = buf[3];
 		n = buf[8];
-		if (buf[0] < 9+p*n)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bNumFormats                 %5u\n"
-		       "        wTotalLength               0x%04x\n"
-		       "        bEndpointAddress            %5u\n"
-		       "        bTerminalLink               %5u\n"
-		       "        bControlSize                %5u\n",
-		       p, buf[4] | (buf[5] << 8), buf[6], buf[7], n);
+		out.Print("        bNumFormats                 %5u\n"
+		          "        wTotalLength               0x%04x\n"
+		          "        bEndpointAddress            %5u\n"
+		          "        bTerminalLink               %5u\n"
+		          "        bControlSize                %5u\n",
+		          p, buf[4] | (buf[5] << 8), buf[6], buf[7], n);
 		for (i = 0; i < p; i++)
-			printf(
+			out.Print(
 			"        bmaControls(%2u)             %5u\n",
 				i, buf[9+i*n]);
-		dump_junk(buf, "        ", 9+p*n);
+		out.Junk(buf, "        ", 9+p*n);
 		break;
 
 	case 0x03: /* STILL_IMAGE_FRAME */
-		printf("(STILL_IMAGE_FRAME)\n");
+		out.Print("(STILL_IMAGE_FRAME)\n");
+		if (out.TooShort(buf, "      ", 5)
+				|| out.TooShort(buf, "      ", 6+4*buf[4]))
+			return;
 		n = buf[4];
 		m = buf[5+4*n];
-		if (buf[0] < 6+4*n+m)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bEndpointAddress                %5u\n"
-		       "        bNumImageSizePatterns             %3u\n",
-		       buf[3], n);
+		if (out.TooShort(buf, "      ", 6+4*n+m))
+			return;
+		out.Print("        bEndpointAddress                %5u\n"
+		          "        bNumImageSizePatterns             %3u\n",
+		          buf[3], n);
 		for (i = 0; i < n; i++)
-			printf("        wWidth(%2u)                      %5u\n"
-			       "        wHeight(%2u)                     %5u\n",
-			       i, buf[5+4*i] | (buf[6+4*i] << 8),
-			       i, buf[7+4*i] | (buf[8+4*i] << 8));
-		printf("        bNumCompressionPatterns           %3u\n", m);
+			out.Print("        wWidth(%2u)                      %5u\n"
+			          "        wHeight(%2u)                     %5u\n",
+			          i, buf[5+4*i] | (buf[6+4*i] << 8),
+			          i, buf[7+4*i] | (buf[8+4*i] << 8));
+		out.Print("        bNumCompressionPatterns           %3u\n", m);
 		for (i = 0; i < m; i++)
-			printf("        bCompression(%2u)                %5u\n",
-			       i, buf[6+4*n+i]);
-		dump_junk(buf, "        ", 6+4*n+m);
+			out.Print("        bCompression(%2u)                %5u\n",
+			          i, buf[6+4*n+i]);
+		out.Junk(buf, "        ", 6+4*n+m);
 		break;
 
 	case 0x04: /* FORMAT_UNCOMPRESSED */
 	case 0x10: /* FORMAT_FRAME_BASED */
 		if (buf[2] == 0x04) {
-			printf("(FORMAT_UNCOMPRESSED)\n");
+			out.Print("(FORMAT_UNCOMPRESSED)\n");
 			len = 27;
 		} else {
-			printf("(FORMAT_FRAME_BASED)\n");
+			out.Print("(FORMAT_FRAME_BASED)\n");
 			len = 28;
 		}
-		if (buf[0] < len)
-			printf("      Warning: Descriptor too short\n");
+		if (out.TooShort(buf, "      ", len))
+			return;
 		flags = buf[25];
-		printf("        bFormatIndex                    %5u\n"
-		       "        bNumFrameDescriptors            %5u\n"
-		       "        guidFormat                            %s\n"
-		       "        bBitsPerPixel                   %5u\n"
-		       "        bDefaultFrameIndex              %5u\n"
-		       "        bAspectRatioX                   %5u\n"
-		       "        bAspectRatioY                   %5u\n"
-		       "        bmInterlaceFlags                 0x%02x\n",
-		       buf[3], buf[4], get_guid(&buf[5]), buf[21], buf[22],
-		       buf[23], buf[24], flags);
-		printf("          Interlaced stream or variable: %s\n",
-		       (flags & (1 << 0)) ? "Yes" : "No");
-		printf("          Fields per frame: %u fields\n",
-		       (flags & (1 << 1)) ? 1 : 2);
-		printf("          Field 1 first: %s\n",
-		       (flags & (1 << 2)) ? "Yes" : "No");
-		printf("          Field pattern: ");
+		out.Print("        bFormatIndex                    %5u\n"
+		          "        bNumFrameDescriptors            %5u\n"
+		          "        guidFormat                            %s\n"
+		          "        bBitsPerPixel                   %5u\n"
+		          "        bDefaultFrameIndex              %5u\n"
+		          "        bAspectRatioX                   %5u\n"
+		          "        bAspectRatioY                   %5u\n"
+		          "        bmInterlaceFlags                 0x%02x\n",
+		          buf[3], buf[4], get_guid(&buf[5]), buf[21], buf[22],
+		          buf[23], buf[24], flags);
+		out.Print("          Interlaced stream or variable: %s\n",
+		          (flags & (1 << 0)) ? "Yes" : "No");
+		out.Print("          Fields per frame: %u fields\n",
+		          (flags & (1 << 1)) ? 1 : 2);
+		out.Print("          Field 1 first: %s\n",
+		          (flags & (1 << 2)) ? "Yes" : "No");
+		out.Print("          Field pattern: ");
 		switch ((flags >> 4) & 0x03) {
 		case 0:
-			printf("Field 1 only\n");
+			out.Print("Field 1 only\n");
 			break;
 		case 1:
-			printf("Field 2 only\n");
+			out.Print("Field 2 only\n");
 			break;
 		case 2:
-			printf("Regular pattern of fields 1 and 2\n");
+			out.Print("Regular pattern of fields 1 and 2\n");
 			break;
 		case 3:
-			printf("Random pattern of fields 1 and 2\n");
+			out.Print("Random pattern of fields 1 and 2\n");
 			break;
 		}
-		printf("        bCopyProtect                    %5u\n", buf[26]);
+		out.Print("        bCopyProtect                    %5u\n", buf[26]);
 		if (buf[2] == 0x10)
-			printf("        bVariableSize                 %5u\n", buf[27]);
-		dump_junk(buf, "        ", len);
+			out.Print("        bVariableSize                 %5u\n", buf[27]);
+		out.Junk(buf, "        ", len);
 		break;
 
 	case 0x05: /* FRAME UNCOMPRESSED */
 	case 0x07: /* FRAME_MJPEG */
 	case 0x11: /* FRAME_FRAME_BASED */
 		if (buf[2] == 0x05) {
-			printf("(FRAME_UNCOMPRESSED)\n");
+			out.Print("(FRAME_UNCOMPRESSED)\n");
 			n = 25;
 		} else if (buf[2] == 0x07) {
-			printf("(FRAME_MJPEG)\n");
+			out.Print("(FRAME_MJPEG)\n");
 			n = 25;
 		} else {
-			printf("(FRAME_FRAME_BASED)\n");
+			out.Print("(FRAME_FRAME_BASED)\n");
 			n = 21;
 		}
+		if (out.TooShort(buf, "      ", n+1))
+			return;
 		len = (buf[n] != 0) ? (26+buf[n]*4) : 38;
-		if (buf[0] < len)
-			printf("      Warning: Descriptor too short\n");
+		if (out.TooShort(buf, "      ", len))
+			return;
 		flags = buf[4];
-		printf("        bFrameIndex                     %5u\n"
-		       "        bmCapabilities                   0x%02x\n",
-		       buf[3], flags);
-		printf("          Still image %ssupported\n",
-		       (flags & (1 << 0)) ? "" : "un");
+		out.Print("        bFrameIndex                     %5u\n"
+		          "        bmCapabilities                   0x%02x\n",
+		          buf[3], flags);
+		out.Print("          Still image %ssupported\n",
+		          (flags & (1 << 0)) ? "" : "un");
 		if (flags & (1 << 1))
-			printf("          Fixed frame-rate\n");
-		printf("        wWidth                          %5u\n"
-		       "        wHeight                         %5u\n"
-		       "        dwMinBitRate                %9u\n"
-		       "        dwMaxBitRate                %9u\n",
-		       buf[5] | (buf[6] <<  8), buf[7] | (buf[8] << 8),
-		       buf[9] | (buf[10] << 8) | (buf[11] << 16) | (buf[12] << 24),
-		       buf[13] | (buf[14] << 8) | (buf[15] << 16) | (buf[16] << 24));
+			out.Print("          Fixed frame-rate\n");
+		out.Print("        wWidth                          %5u\n"
+		          "        wHeight                         %5u\n"
+		          "        dwMinBitRate                %9u\n"
+		          "        dwMaxBitRate                %9u\n",
+		          buf[5] | (buf[6] <<  8), buf[7] | (buf[8] << 8),
+		          buf[9] | (buf[10] << 8) | (buf[11] << 16) | (buf[12] << 24),
+		          buf[13] | (buf[14] << 8) | (buf[15] << 16) | (buf[16] << 24));
 		if (buf[2] == 0x11)
-			printf("        dwDefaultFrameInterval      %9u\n"
-			       "        bFrameIntervalType              %5u\n"
-			       "        dwBytesPerLine              %9u\n",
-			       buf[17] | (buf[18] << 8) | (buf[19] << 16) | (buf[20] << 24),
-			       buf[21],
-			       buf[22] | (buf[23] << 8) | (buf[24] << 16) | (buf[25] << 24));
+			out.Print("        dwDefaultFrameInterval      %9u\n"
+			          "        bFrameIntervalType              %5u\n"
+			          "        dwBytesPerLine              %9u\n",
+			          buf[17] | (buf[18] << 8) | (buf[19] << 16) | (buf[20] << 24),
+			          buf[21],
+			          buf[22] | (buf[23] << 8) | (buf[24] << 16) | (buf[25] << 24));
 		else
-			printf("        dwMaxVideoFrameBufferSize   %9u\n"
-			       "        dwDefaultFrameInterval      %9u\n"
-			       "        bFrameIntervalType              %5u\n",
-			       buf[17] | (buf[18] << 8) | (buf[19] << 16) | (buf[20] << 24),
-			       buf[21] | (buf[22] << 8) | (buf[23] << 16) | (buf[24] << 24),
-			       buf[25]);
+			out.Print("        dwMaxVideoFrameBufferSize   %9u\n"
+			          "        dwDefaultFrameInterval      %9u\n"
+			          "        bFrameIntervalType              %5u\n",
+			          buf[17] | (buf[18] << 8) | (buf[19] << 16) | (buf[20] << 24),
+			          buf[21] | (buf[22] << 8) | (buf[23] << 16) | (buf[24] << 24),
+			          buf[25]);
 		if (buf[n] == 0)
-			printf("        dwMinFrameInterval          %9u\n"
-			       "        dwMaxFrameInterval          %9u\n"
-			       "        dwFrameIntervalStep         %9u\n",
-			       buf[26] | (buf[27] << 8) | (buf[28] << 16) | (buf[29] << 24),
-			       buf[30] | (buf[31] << 8) | (buf[32] << 16) | (buf[33] << 24),
-			       buf[34] | (buf[35] << 8) | (buf[36] << 16) | (buf[37] << 24));
+			out.Print("        dwMinFrameInterval          %9u\n"
+			          "        dwMaxFrameInterval          %9u\n"
+			          "        dwFrameIntervalStep         %9u\n",
+			          buf[26] | (buf[27] << 8) | (buf[28] << 16) | (buf[29] << 24),
+			          buf[30] | (buf[31] << 8) | (buf[32] << 16) | (buf[33] << 24),
+			          buf[34] | (buf[35] << 8) | (buf[36] << 16) | (buf[37] << 24));
 		else
 			for (i = 0; i < buf[n]; i++)
-				printf("        dwFrameInterval(%2u)         %9u\n",
-				       i, buf[26+4*i] | (buf[27+4*i] << 8) |
-				       (buf[28+4*i] << 16) | (buf[29+4*i] << 24));
-		dump_junk(buf, "        ", len);
+				out.Print("        dwFrameInterval(%2u)         %9u\n",
+				          i, buf[26+4*i] | (buf[27+4*i] << 8) |
+				          (buf[28+4*i] << 16) | (buf[29+4*i] << 24));
+		out.Junk(buf, "        ", len);
 		break;
 
 	case 0x06: /* FORMAT_MJPEG */
-		printf("(FORMAT_MJPEG)\n");
-		if (buf[0] < 11)
-			printf("      Warning: Descriptor too short\n");
+		out.Print("(FORMAT_MJPEG)\n");
+		if (out.TooShort(buf, "      ", 11))
+			return;
 		flags = buf[5];
-		printf("        bFormatIndex                    %5u\n"
-		       "        bNumFrameDescriptors            %5u\n"
-		       "        bFlags                          %5u\n",
-		       buf[3], buf[4], flags);
-		printf("          Fixed-size samples: %s\n",
-		       (flags & (1 << 0)) ? "Yes" : "No");
+		out.Print("        bFormatIndex                    %5u\n"
+		          "        bNumFrameDescriptors            %5u\n"
+		          "        bFlags                          %5u\n",
+		          buf[3], buf[4], flags);
+		out.Print("          Fixed-size samples: %s\n",
+		          (flags & (1 << 0)) ? "Yes" : "No");
 		flags = buf[9];
-		printf("        bDefaultFrameIndex              %5u\n"
-		       "        bAspectRatioX                   %5u\n"
-		       "        bAspectRatioY                   %5u\n"
-		       "        bmInterlaceFlags                 0x%02x\n",
-		       buf[6], buf[7], buf[8], flags);
-		printf("          Interlaced stream or variable: %s\n",
-		       (flags & (1 << 0)) ? "Yes" : "No");
-		printf("          Fields per frame: %u fields\n",
-		       (flags & (1 << 1)) ? 2 : 1);
-		printf("          Field 1 first: %s\n",
-		       (flags & (1 << 2)) ? "Yes" : "No");
-		printf("          Field pattern: ");
+		out.Print("        bDefaultFrameIndex              %5u\n"
+		          "        bAspectRatioX                   %5u\n"
+		          "        bAspectRatioY                   %5u\n"
+		          "        bmInterlaceFlags                 0x%02x\n",
+		          buf[6], buf[7], buf[8], flags);
+		out.Print("          Interlaced stream or variable: %s\n",
+		          (flags & (1 << 0)) ? "Yes" : "No");
+		out.Print("          Fields per frame: %u fields\n",
+		          (flags & (1 << 1)) ? 2 : 1);
+		out.Print("          Field 1 first: %s\n",
+		          (flags & (1 << 2)) ? "Yes" : "No");
+		out.Print("          Field pattern: ");
 		switch ((flags >> 4) & 0x03) {
 		case 0:
-			printf("Field 1 only\n");
+			out.Print("Field 1 only\n");
 			break;
 		case 1:
-			printf("Field 2 only\n");
+			out.Print("Field 2 only\n");
 			break;
 		case 2:
-			printf("Regular pattern of fields 1 and 2\n");
+			out.Print("Regular pattern of fields 1 and 2\n");
 			break;
 		case 3:
-			printf("Random pattern of fields 1 and 2\n");
+			out.Print("Random pattern of fields 1 and 2\n");
 			break;
 		}
-		printf("        bCopyProtect                    %5u\n", buf[10]);
-		dump_junk(buf, "        ", 11);
+		out.Print("        bCopyProtect                    %5u\n", buf[10]);
+		out.Junk(buf, "        ", 11);
 		break;
 
 	case 0x0a: /* FORMAT_MPEG2TS */
-		printf("(FORMAT_MPEG2TS)\n");
+		out.Print("(FORMAT_MPEG2TS)\n");
 		len = buf[0] < 23 ? 7 : 23;
-		if (buf[0] < len)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bFormatIndex                    %5u\n"
-		       "        bDataOffset                     %5u\n"
-		       "        bPacketLength                   %5u\n"
-		       "        bStrideLength                   %5u\n",
-		       buf[3], buf[4], buf[5], buf[6]);
+		if (out.TooShort(buf, "      ", len))
+			return;
+		out.Print("        bFormatIndex                    %5u\n"
+		          "        bDataOffset                     %5u\n"
+		          "        bPacketLength                   %5u\n"
+		          "        bStrideLength                   %5u\n",
+		          buf[3], buf[4], buf[5], buf[6]);
 		if (len > 7)
-			printf("        guidStrideFormat                      %s\n",
-			       get_guid(&buf[7]));
-		dump_junk(buf, "        ", len);
+			out.Print("        guidStrideFormat                      %s\n",
+			          get_guid(&buf[7]));
+		out.Junk(buf, "        ", len);
 		break;
 
 	case 0x0d: /* COLORFORMAT */
-		printf("(COLORFORMAT)\n");
-		if (buf[0] < 6)
-			printf("      Warning: Descriptor too short\n");
-		printf("        bColorPrimaries                 %5u (%s)\n",
-		       buf[3], (buf[3] <= 5) ? colorPrims[buf[3]] : "Unknown");
-		printf("        bTransferCharacteristics        %5u (%s)\n",
-		       buf[4], (buf[4] <= 7) ? transferChars[buf[4]] : "Unknown");
-		printf("        bMatrixCoefficients             %5u (%s)\n",
-		       buf[5], (buf[5] <= 5) ? matrixCoeffs[buf[5]] : "Unknown");
-		dump_junk(buf, "        ", 6);
+		out.Print("(COLORFORMAT)\n");
+		if (out.TooShort(buf, "      ", 6))
+			return;
+		out.Print("        bColorPrimaries                 %5u (%s)\n",
+		          buf[3], (buf[3] <= 5) ? colorPrims[buf[3]] : "Unknown");
+		out.Print("        bTransferCharacteristics        %5u (%s)\n",
+		          buf[4], (buf[4] <= 7) ? transferChars[buf[4]] : "Unknown");
+		out.Print("        bMatrixCoefficients             %5u (%s)\n",
+		          buf[5], (buf[5] <= 5) ? matrixCoeffs[buf[5]] : "Unknown");
+		out.Junk(buf, "        ", 6);
 		break;
 
 	case 0x12: /* FORMAT_STREAM_BASED */
-		printf("(FORMAT_STREAM_BASED)\n");
+		out.Print("(FORMAT_STREAM_BASED)\n");
+		if (out.TooShort(buf, "      ", 24))
+			return;
 		if (buf[0] != 24)
-			printf("      Warning: Incorrect descriptor length\n");
+			out.Print("      Warning: Incorrect descriptor length\n");
 
-		printf("        bFormatIndex                    %5u\n"
-		       "        guidFormat                            %s\n"
-		       "        dwPacketLength                %7u\n",
-		       buf[3], get_guid(&buf[4]), buf[20]);
-		dump_junk(buf, "        ", 24);
+		out.Print("        bFormatIndex                    %5u\n"
+		          "        guidFormat                            %s\n"
+		          "        dwPacketLength                %7u\n",
+		          buf[3], get_guid(&buf[4]), buf[20]);
+		out.Junk(buf, "        ", 24);
 		break;
 
 	default:
-		printf("        Invalid desc subtype:");
-		dump_bytes(buf+3, buf[0]-3);
+		out.Print("        Invalid desc subtype:");
+		out.Bytes(buf+3, buf[0]-3);
 		break;
 	}
 }
-
-static void dump_dfu_interface(const unsigned char *buf)
-{
-	if (buf[1] != USB_DT_CS_DEVICE)
-		printf("      Warning: Invalid descriptor\n");
-	else if (buf[0] < 7)
-		printf("      Warning: Descriptor too short\n");
-	printf("      Device Firmware Upgrade Interface Descriptor:\n"
-	       "        bLength                         %5u\n"
-	       "        bDescriptorType                 %5u\n"
-	       "        bmAttributes                    %5u\n",
-	       buf[0], buf[1], buf[2]);
-	if (buf[2] & 0xf0)
-		printf("          (unknown attributes!)\n");
-	printf("          Will %sDetach\n", (buf[2] & 0x08) ? "" : "Not ");
-	printf("          Manifestation %s\n", (buf[2] & 0x04) ? "Tolerant" : "Intolerant");
-	printf("          Upload %s\n", (buf[2] & 0x02) ? "Supported" : "Unsupported");
-	printf("          Download %s\n", (buf[2] & 0x01) ? "Supported" : "Unsupported");
-	printf("        wDetachTimeout                  %5u milliseconds\n"
-	       "        wTransferSize                   %5u bytes\n",
-	       buf[3] | (buf[4] << 8), buf[5] | (buf[6] << 8));
-
-	/* DFU 1.0 defines no version code, DFU 1.1 does */
-	if (buf[0] < 9)
-		return;
-	printf("        bcdDFUVersion                   %x.%02x\n",
-			buf[8], buf[7]);
-}
\ No newline at end of file
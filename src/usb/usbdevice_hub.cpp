@@ -21,51 +21,273 @@
 #include "names.h"
 #include "usbmisc.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
 using namespace std;
 
 #define CTRL_TIMEOUT	(5*1000)	/* milliseconds */
-#define	HUB_STATUS_BYTELEN	3	/* max 3 bytes status = hub + 23 ports */
 
-void UsbDevice::do_hub(vector<string> &hub_info)
-{
-	unsigned char buf[7 /* base descriptor */
-			+ 2 /* bitmasks */ * HUB_STATUS_BYTELEN];
-	int i, ret, value;
-	unsigned int link_state;
-
-	char hub_info_line[128];
-	const char * const link_state_descriptions[] = {
-		"U0",
-		"U1",
-		"U2",
-		"suspend",
-		"SS.disabled",
-		"Rx.Detect",
-		"SS.Inactive",
-		"Polling",
-		"Recovery",
-		"Hot Reset",
-		"Compliance",
-		"Loopback",
-	};
+static const char * const link_state_descriptions[] = {
+	"U0",
+	"U1",
+	"U2",
+	"suspend",
+	"SS.disabled",
+	"Rx.Detect",
+	"SS.Inactive",
+	"Polling",
+	"Recovery",
+	"Hot Reset",
+	"Compliance",
+	"Loopback",
+};
 
-	unsigned int speed = descriptor_.bcdUSB;
-	unsigned int tt_type = descriptor_.bDeviceProtocol;
+int UsbDevice::get_hub_descriptor(unsigned char *buf, int size)
+{
+	int value;
 
 	/* USB 3.x hubs have a slightly different descriptor */
-	if (speed >= 0x0300)
+	if (descriptor_.bcdUSB >= 0x0300)
 		value = 0x2A;
 	else
 		value = 0x29;
 
-	ret = usb_control_msg(dev_handle_,
+	return usb_control_msg(dev_handle_,
 			LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_DEVICE,
 			LIBUSB_REQUEST_GET_DESCRIPTOR,
 			value << 8, 0,
-			buf, sizeof buf, CTRL_TIMEOUT);
+			buf, size, CTRL_TIMEOUT);
+}
+
+/*
+ * Reads the status of one port (1-based) into the port status cache.
+ */
+int UsbDevice::read_port_status(int port)
+{
+	HubPort &p = hub_ports_[port - 1];
+	int ret;
+
+	ret = usb_control_msg(dev_handle_,
+			LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS
+				| LIBUSB_RECIPIENT_OTHER,
+			LIBUSB_REQUEST_GET_STATUS,
+			0, port,
+			p.status, sizeof p.status,
+			CTRL_TIMEOUT);
+	if (ret < 0) {
+		p.valid = false;
+		p.error = errno ? errno : EIO;
+		return ret;
+	}
+
+	p.valid = true;
+	p.error = 0;
+	return 0;
+}
+
+static void LIBUSB_CALL port_status_cb(struct libusb_transfer *transfer)
+{
+	int *pending = (int *)transfer->user_data;
+
+	(*pending)--;
+}
+
+static int transfer_errno(enum libusb_transfer_status status)
+{
+	switch (status) {
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return ETIMEDOUT;
+	case LIBUSB_TRANSFER_STALL:
+		return EPIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return ENODEV;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		return EOVERFLOW;
+	default:
+		return EIO;
+	}
+}
+
+/*
+ * Reads the status of every port, with all GET_STATUS requests in flight
+ * at once rather than one round trip per port. A port that fails only
+ * has its own cache entry marked as such.
+ */
+void UsbDevice::read_all_port_status()
+{
+	const int len = LIBUSB_CONTROL_SETUP_SIZE + 4;
+	unsigned int nports = hub_ports_.size();
+	vector<struct libusb_transfer *> xfers(nports, (struct libusb_transfer *)NULL);
+	vector<unsigned char> bufs(nports * len);
+	int pending = 0;
+
+	if (!ctx_) {
+		for (unsigned int i = 0; i < nports; i++)
+			read_port_status(i + 1);
+		return;
+	}
+
+	for (unsigned int i = 0; i < nports; i++) {
+		unsigned char *buf = &bufs[i * len];
+		struct libusb_transfer *xfer = libusb_alloc_transfer(0);
+		int r;
+
+		if (!xfer) {
+			hub_ports_[i].error = ENOMEM;
+			continue;
+		}
+
+		libusb_fill_control_setup(buf,
+				LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS
+					| LIBUSB_RECIPIENT_OTHER,
+				LIBUSB_REQUEST_GET_STATUS,
+				0, i + 1, 4);
+		libusb_fill_control_transfer(xfer, dev_handle_, buf,
+				port_status_cb, &pending, CTRL_TIMEOUT);
+
+		r = libusb_submit_transfer(xfer);
+		if (r < 0) {
+			hub_ports_[i].error = r == LIBUSB_ERROR_NO_DEVICE ? ENODEV : EIO;
+			libusb_free_transfer(xfer);
+			continue;
+		}
+		xfers[i] = xfer;
+		pending++;
+	}
+
+	while (pending > 0) {
+		struct timeval tv = { 1, 0 };
+
+		if (libusb_handle_events_timeout_completed(ctx_, &tv, NULL) < 0) {
+			/* the callbacks reference this stack frame: cancel
+			 * and keep reaping until every transfer is back */
+			for (unsigned int i = 0; i < nports; i++) {
+				if (xfers[i])
+					libusb_cancel_transfer(xfers[i]);
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < nports; i++) {
+		struct libusb_transfer *xfer = xfers[i];
+		HubPort &p = hub_ports_[i];
+
+		if (!xfer)
+			continue;
+
+		if (xfer->status == LIBUSB_TRANSFER_COMPLETED
+				&& xfer->actual_length >= 4) {
+			memcpy(p.status, libusb_control_transfer_get_data(xfer), 4);
+			p.valid = true;
+			p.error = 0;
+		} else {
+			p.valid = false;
+			p.error = xfer->status == LIBUSB_TRANSFER_COMPLETED ?
+				EPROTO : transfer_errno(xfer->status);
+		}
+		libusb_free_transfer(xfer);
+	}
+}
+
+void UsbDevice::format_port_status(int port, const unsigned char *status,
+		char *port_status, size_t size)
+{
+	unsigned int speed = descriptor_.bcdUSB;
+	unsigned int link_state;
+	char hub_info_line[128];
+
+	snprintf(port_status, size, "   Port %d: %02x%02x.%02x%02x", port,
+		status[3], status[2],
+		status[1], status[0]);
+
+	/* CAPS are used to highlight "transient" states */
+	if (speed != 0x0300) {
+		snprintf(hub_info_line, 128,"%s%s%s%s%s",
+				(status[2] & 0x10) ? " C_RESET" : "",
+				(status[2] & 0x08) ? " C_OC" : "",
+				(status[2] & 0x04) ? " C_SUSPEND" : "",
+				(status[2] & 0x02) ? " C_ENABLE" : "",
+				(status[2] & 0x01) ? " C_CONNECT" : "");
+		strncat(port_status, hub_info_line, size - strlen(port_status) - 1);
+
+		snprintf(hub_info_line, 128,"%s%s%s%s%s%s%s%s%s%s%s",
+				(status[1] & 0x10) ? " indicator" : "",
+				(status[1] & 0x08) ? " test" : "",
+				(status[1] & 0x04) ? " highspeed" : "",
+				(status[1] & 0x02) ? " lowspeed" : "",
+				(status[1] & 0x01) ? " power" : "",
+				(status[0] & 0x20) ? " L1" : "",
+				(status[0] & 0x10) ? " RESET" : "",
+				(status[0] & 0x08) ? " oc" : "",
+				(status[0] & 0x04) ? " suspend" : "",
+				(status[0] & 0x02) ? " enable" : "",
+				(status[0] & 0x01) ? " connect" : "");
+		strncat(port_status, hub_info_line, size - strlen(port_status) - 1);
+	} else {
+		link_state = ((status[0] & 0xe0) >> 5) +
+			((status[1] & 0x1) << 3);
+		snprintf(hub_info_line, 128,"%s%s%s%s%s%s",
+				(status[2] & 0x80) ? " C_CONFIG_ERROR" : "",
+				(status[2] & 0x40) ? " C_LINK_STATE" : "",
+				(status[2] & 0x20) ? " C_BH_RESET" : "",
+				(status[2] & 0x10) ? " C_RESET" : "",
+				(status[2] & 0x08) ? " C_OC" : "",
+				(status[2] & 0x01) ? " C_CONNECT" : "");
+		strncat(port_status, hub_info_line, size - strlen(port_status) - 1);
+		snprintf(hub_info_line, 128,"%s%s",
+				((status[1] & 0x1C) == 0) ? " 5Gbps" : " Unknown Speed",
+				(status[1] & 0x02) ? " power" : "");
+		strncat(port_status, hub_info_line, size - strlen(port_status) - 1);
+
+		/* Link state is bits 8:5 */
+		if (link_state < (sizeof(link_state_descriptions) /
+					sizeof(*link_state_descriptions))) {
+			snprintf(hub_info_line, 128, " %s", link_state_descriptions[link_state]);
+			strncat(port_status, hub_info_line, size - strlen(port_status) - 1);
+		}
+		snprintf(hub_info_line, 128,"%s%s%s%s",
+				(status[0] & 0x10) ? " RESET" : "",
+				(status[0] & 0x08) ? " oc" : "",
+				(status[0] & 0x02) ? " enable" : "",
+				(status[0] & 0x01) ? " connect" : "");
+		strncat(port_status, hub_info_line, size - strlen(port_status) - 1);
+	}
+}
+
+void UsbDevice::dump_port_status(vector<string> &hub_info)
+{
+	char port_status[256];
+
+	hub_info.push_back(" Hub Port Status:\n");
+	for (unsigned int i = 0; i < hub_ports_.size(); i++) {
+		const HubPort &p = hub_ports_[i];
+
+		if (p.error) {
+			snprintf(port_status, 128,
+				"   Port %d: cannot read status, %s (%d)\n",
+				i + 1, strerror(p.error), p.error);
+			hub_info.push_back(port_status);
+			continue;
+		}
+		if (!p.valid)
+			continue;
+
+		format_port_status(i + 1, p.status, port_status, sizeof(port_status));
+		hub_info.push_back(port_status);
+	}
+}
+
+void UsbDevice::do_hub(vector<string> &hub_info)
+{
+	unsigned char buf[7 /* base descriptor */
+			+ 2 /* bitmasks */ * HUB_STATUS_BYTELEN];
+	int ret;
+
+	char hub_info_line[128];
+
+	ret = get_hub_descriptor(buf, sizeof buf);
 	if (ret < 0) {
 		/* Linux returns EHOSTUNREACH for suspended devices */
 		if (errno != EHOSTUNREACH) {
@@ -84,89 +306,13 @@ void UsbDevice::do_hub(vector<string> &hub_info)
 	}
 	dump_hub("", buf, hub_info);
 
-	hub_info.push_back(" Hub Port Status:\n");
-	for (i = 0; i < buf[2]; i++) {
-		unsigned char status[4];
-
-		ret = usb_control_msg(dev_handle_,
-				LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS
-					| LIBUSB_RECIPIENT_OTHER,
-				LIBUSB_REQUEST_GET_STATUS,
-				0, i + 1,
-				status, sizeof status,
-				CTRL_TIMEOUT);
-		if (ret < 0) {
-			snprintf(hub_info_line, 128,
-				"cannot read port %d status, %s (%d)\n",
-				i + 1, strerror(errno), errno);
-			hub_info.push_back(hub_info_line);
-			break;
-		}
-
-		char port_status[128];
-		snprintf(port_status, 128,"   Port %d: %02x%02x.%02x%02x", i + 1,
-			status[3], status[2],
-			status[1], status[0]);
-
-		/* CAPS are used to highlight "transient" states */
-		if (speed != 0x0300) {
-			char port_state[128];
-			snprintf(hub_info_line, 128,"%s%s%s%s%s",
-					(status[2] & 0x10) ? " C_RESET" : "",
-					(status[2] & 0x08) ? " C_OC" : "",
-					(status[2] & 0x04) ? " C_SUSPEND" : "",
-					(status[2] & 0x02) ? " C_ENABLE" : "",
-					(status[2] & 0x01) ? " C_CONNECT" : "");
-			strncat(port_status, hub_info_line, 128);
-
-			char port_state2[128];
-			snprintf(hub_info_line, 128,"%s%s%s%s%s%s%s%s%s%s%s",
-					(status[1] & 0x10) ? " indicator" : "",
-					(status[1] & 0x08) ? " test" : "",
-					(status[1] & 0x04) ? " highspeed" : "",
-					(status[1] & 0x02) ? " lowspeed" : "",
-					(status[1] & 0x01) ? " power" : "",
-					(status[0] & 0x20) ? " L1" : "",
-					(status[0] & 0x10) ? " RESET" : "",
-					(status[0] & 0x08) ? " oc" : "",
-					(status[0] & 0x04) ? " suspend" : "",
-					(status[0] & 0x02) ? " enable" : "",
-					(status[0] & 0x01) ? " connect" : "");
-			strncat(port_status, hub_info_line, 128);
-			hub_info.push_back(port_status);
-		} else {
-			char c_link_state[128];
-			link_state = ((status[0] & 0xe0) >> 5) +
-				((status[1] & 0x1) << 3);
-			snprintf(hub_info_line, 128,"%s%s%s%s%s%s",
-					(status[2] & 0x80) ? " C_CONFIG_ERROR" : "",
-					(status[2] & 0x40) ? " C_LINK_STATE" : "",
-					(status[2] & 0x20) ? " C_BH_RESET" : "",
-					(status[2] & 0x10) ? " C_RESET" : "",
-					(status[2] & 0x08) ? " C_OC" : "",
-					(status[2] & 0x01) ? " C_CONNECT" : "");
-			strncat(port_status, hub_info_line, 128);
-			char c_link_speed[128];
-			snprintf(hub_info_line, 128,"%s%s",
-					((status[1] & 0x1C) == 0) ? " 5Gbps" : " Unknown Speed",
-					(status[1] & 0x02) ? " power" : "");
-			strncat(port_status, hub_info_line, 128);
-
-			/* Link state is bits 8:5 */
-			if (link_state < (sizeof(link_state_descriptions) /
-						sizeof(*link_state_descriptions))) {
-				snprintf(hub_info_line, 128, " %s", link_state_descriptions[link_state]);
-				strncat(port_status, hub_info_line, 128);
-			}
-			snprintf(hub_info_line, 128,"%s%s%s%s",
-					(status[0] & 0x10) ? " RESET" : "",
-					(status[0] & 0x08) ? " oc" : "",
-					(status[0] & 0x02) ? " enable" : "",
-					(status[0] & 0x01) ? " connect" : "");
-			strncat(port_status, hub_info_line, 128);
-			hub_info.push_back(port_status);
-		}
+	/* a watched hub keeps its port status cache up to date by itself */
+	if (!isWatchingPorts()) {
+		hub_ports_.assign(buf[2], HubPort());
+		read_all_port_status();
 	}
+
+	dump_port_status(hub_info);
 }
 
 void UsbDevice::dump_hub(const char *prefix, const unsigned char *p, vector<string> &hub_info)
@@ -0,0 +1,291 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+ * Hub port status changes are reported on the hub's status change
+ * interrupt endpoint: bit 0 of the bitmap is the hub itself, bit N is
+ * port N. Listening there (or, when the hub driver owns the interface,
+ * on the sysfs port "state" attributes which the kernel notifies on
+ * every change) costs no bus traffic while nothing happens, and only
+ * the ports that changed get a GET_STATUS.
+ */
+
+void LIBUSB_CALL UsbDevice::status_change_cb(struct libusb_transfer *transfer)
+{
+	PortWatch *watch = (PortWatch *)transfer->user_data;
+
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+		for (int i = 0; i < transfer->actual_length; i++)
+			watch->changed_ports |= (uint32_t)transfer->buffer[i] << (8 * i);
+		/* hub status changes are not port changes */
+		watch->changed_ports &= ~1U;
+		if (libusb_submit_transfer(transfer) == 0)
+			return;
+	} else if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
+		if (libusb_submit_transfer(transfer) == 0)
+			return;
+	}
+
+	/* cancelled, device gone, or resubmission failed */
+	libusb_free_transfer(transfer);
+	watch->status_xfer = NULL;
+}
+
+int UsbDevice::start_status_endpoint()
+{
+	struct libusb_config_descriptor *config;
+	const struct libusb_endpoint_descriptor *ep = NULL;
+	int r;
+
+	if (libusb_get_active_config_descriptor(usb_dev_, &config))
+		return -ENOENT;
+	if (config->bNumInterfaces && config->interface[0].num_altsetting
+			&& config->interface[0].altsetting[0].bNumEndpoints)
+		ep = &config->interface[0].altsetting[0].endpoint[0];
+	if (!ep || (ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK)
+				!= LIBUSB_TRANSFER_TYPE_INTERRUPT
+			|| !(ep->bEndpointAddress & LIBUSB_ENDPOINT_IN)) {
+		libusb_free_config_descriptor(config);
+		return -ENOENT;
+	}
+
+	/* fails with LIBUSB_ERROR_BUSY as long as the hub driver is bound */
+	r = libusb_claim_interface(dev_handle_, 0);
+	if (r < 0) {
+		libusb_free_config_descriptor(config);
+		return r;
+	}
+
+	watch_->status_xfer = libusb_alloc_transfer(0);
+	if (!watch_->status_xfer) {
+		libusb_release_interface(dev_handle_, 0);
+		libusb_free_config_descriptor(config);
+		return -ENOMEM;
+	}
+
+	libusb_fill_interrupt_transfer(watch_->status_xfer, dev_handle_,
+			ep->bEndpointAddress, watch_->status_buf,
+			(hub_ports_.size() + 1 + 7) / 8,
+			status_change_cb, watch_.get(), 0);
+	libusb_free_config_descriptor(config);
+
+	r = libusb_submit_transfer(watch_->status_xfer);
+	if (r < 0) {
+		libusb_free_transfer(watch_->status_xfer);
+		watch_->status_xfer = NULL;
+		libusb_release_interface(dev_handle_, 0);
+		return r;
+	}
+
+	return 0;
+}
+
+int UsbDevice::start_sysfs_port_watch()
+{
+	char intf[64], path[256], state[32];
+	int watched = 0;
+
+	/* root hubs are "usbN" but their interface is "N-0:1.0" */
+	if (isRootHub())
+		snprintf(intf, sizeof(intf), "%d-0:1.0", bus_num_);
+	else
+		snprintf(intf, sizeof(intf), "%s:1.0", sysfs_name_.c_str());
+
+	watch_->port_state_fds.assign(hub_ports_.size(), -1);
+	for (unsigned int i = 0; i < hub_ports_.size(); i++) {
+		int fd;
+
+		snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s/%s-port%u/state",
+				intf, sysfs_name_.c_str(), i + 1);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			continue;
+		/* sysfs only notifies attributes that have been read */
+		if (read(fd, state, sizeof(state)) < 0) {
+			close(fd);
+			continue;
+		}
+		watch_->port_state_fds[i] = fd;
+		watched++;
+	}
+
+	return watched ? 0 : -ENOENT;
+}
+
+int UsbDevice::StartPortWatch()
+{
+	unsigned char buf[7 + 2 * HUB_STATUS_BYTELEN];
+	int ret;
+
+	if (isWatchingPorts())
+		return 0;
+	if (!isHub())
+		return -ENOTSUP;
+	if (!dev_handle_)
+		return -EACCES;
+
+	ret = get_hub_descriptor(buf, sizeof buf);
+	if (ret < 0)
+		return errno ? -errno : -EIO;
+	if (ret < 9 || buf[2] == 0)
+		return -EPROTO;
+
+	watch_.reset(new PortWatch());
+	hub_ports_.assign(buf[2] < 8 * HUB_STATUS_BYTELEN ? buf[2]
+			: 8 * HUB_STATUS_BYTELEN - 1, HubPort());
+	read_all_port_status();
+
+	if (start_status_endpoint() == 0) {
+		watch_->mode = PORT_WATCH_INTERRUPT;
+		return 0;
+	}
+	if (start_sysfs_port_watch() == 0) {
+		watch_->mode = PORT_WATCH_SYSFS;
+		return 0;
+	}
+
+	watch_.reset();
+	return -ENOTSUP;
+}
+
+void UsbDevice::StopPortWatch()
+{
+	if (!watch_)
+		return;
+
+	switch (watch_->mode) {
+	case PORT_WATCH_INTERRUPT:
+		if (watch_->status_xfer
+				&& libusb_cancel_transfer(watch_->status_xfer) == 0) {
+			while (watch_->status_xfer) {
+				struct timeval tv = { 0, 100000 };
+
+				if (libusb_handle_events_timeout_completed(ctx_, &tv, NULL) < 0)
+					break;
+			}
+		}
+		libusb_release_interface(dev_handle_, 0);
+		break;
+	case PORT_WATCH_SYSFS:
+		for (unsigned int i = 0; i < watch_->port_state_fds.size(); i++) {
+			if (watch_->port_state_fds[i] >= 0)
+				close(watch_->port_state_fds[i]);
+		}
+		watch_->port_state_fds.clear();
+		break;
+	case PORT_WATCH_NONE:
+		break;
+	}
+
+	/* other copies of the device may still hold the watch */
+	watch_->mode = PORT_WATCH_NONE;
+	watch_.reset();
+}
+
+/*
+ * Waits up to timeout_ms for port change notifications, then re-reads
+ * the ports that changed. Returns the number of ports re-read.
+ */
+int UsbDevice::PollPortWatch(int timeout_ms)
+{
+	int count = 0;
+
+	if (!isWatchingPorts())
+		return 0;
+
+	if (watch_->mode == PORT_WATCH_INTERRUPT) {
+		struct timeval tv;
+
+		tv.tv_sec = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+		libusb_handle_events_timeout_completed(ctx_, &tv, NULL);
+		if (!watch_->status_xfer) {
+			/* the hub went away */
+			StopPortWatch();
+			return 0;
+		}
+	} else {
+		vector<struct pollfd> fds;
+		vector<int> ports;
+		char state[32];
+
+		for (unsigned int i = 0; i < watch_->port_state_fds.size(); i++) {
+			struct pollfd pfd;
+
+			if (watch_->port_state_fds[i] < 0)
+				continue;
+			pfd.fd = watch_->port_state_fds[i];
+			pfd.events = POLLPRI | POLLERR;
+			pfd.revents = 0;
+			fds.push_back(pfd);
+			ports.push_back(i + 1);
+		}
+
+		if (poll(&fds[0], fds.size(), timeout_ms) > 0) {
+			for (unsigned int i = 0; i < fds.size(); i++) {
+				if (!(fds[i].revents & (POLLPRI | POLLERR)))
+					continue;
+				/* re-arm the notification */
+				lseek(fds[i].fd, 0, SEEK_SET);
+				if (read(fds[i].fd, state, sizeof(state)) < 0)
+					continue;
+				watch_->changed_ports |= 1U << ports[i];
+			}
+		}
+	}
+
+	for (unsigned int port = 1; port <= hub_ports_.size(); port++) {
+		if (!(watch_->changed_ports & (1U << port)))
+			continue;
+		watch_->changed_ports &= ~(1U << port);
+		read_port_status(port);
+		count++;
+	}
+
+	return count;
+}
+
+void UsbDevice::getPortWatchInfo(vector<string> &info)
+{
+	char line[128];
+
+	snprintf(line, 128, "Hub %s, Bus %03d Device %03d: watching %u ports",
+			sysfs_name_.c_str(), bus_num_, device_addr_,
+			(unsigned int)hub_ports_.size());
+	info.push_back(line);
+	snprintf(line, 128, "  notified through %s",
+			watch_ && watch_->mode == PORT_WATCH_INTERRUPT ?
+				"the hub status change endpoint" :
+				"sysfs port state attributes");
+	info.push_back(line);
+	info.push_back(" ");
+
+	dump_port_status(info);
+}
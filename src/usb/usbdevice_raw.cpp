@@ -0,0 +1,131 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "desccache.h"
+#include "hexdump.h"
+#include "usbmisc.h"
+
+#include <stdio.h>
+
+using namespace std;
+
+/* the descriptors file holds the device and every configuration */
+#define SYSFS_DESCRIPTORS_MAX	(18 + 8 * 65535)
+
+static const char *desc_type_name(unsigned int type)
+{
+	switch (type) {
+	case LIBUSB_DT_DEVICE:
+		return "Device";
+	case LIBUSB_DT_CONFIG:
+		return "Configuration";
+	case LIBUSB_DT_STRING:
+		return "String";
+	case LIBUSB_DT_INTERFACE:
+		return "Interface";
+	case LIBUSB_DT_ENDPOINT:
+		return "Endpoint";
+	case USB_DT_DEVICE_QUALIFIER:
+		return "Device Qualifier";
+	case USB_DT_OTHER_SPEED_CONFIG:
+		return "Other Speed Configuration";
+	case USB_DT_OTG:
+		return "OTG";
+	case USB_DT_DEBUG:
+		return "Debug";
+	case USB_DT_INTERFACE_ASSOCIATION:
+		return "Interface Association";
+	case USB_DT_BOS:
+		return "Binary Object Store";
+	case LIBUSB_DT_HID:
+		return "HID";
+	case LIBUSB_DT_REPORT:
+		return "HID Report";
+	case LIBUSB_DT_HUB:
+		return "Hub";
+	case LIBUSB_DT_SUPERSPEED_HUB:
+		return "SuperSpeed Hub";
+	case USB_DT_CS_INTERFACE:
+		return "Class Specific Interface";
+	case USB_DT_CS_ENDPOINT:
+		return "Class Specific Endpoint";
+	case USB_DT_SS_ENDPOINT_COMP:
+		return "SuperSpeed Endpoint Companion";
+	default:
+		return "Unknown";
+	}
+}
+
+/*
+ * Every descriptor as bytes: those the kernel read at enumeration, split
+ * on their bLength, then those read from the device since (strings, BOS,
+ * hub, report descriptors...), wrapped at width bytes per line.
+ */
+void UsbDevice::getRawDescriptors(vector<string> &info, unsigned int width)
+{
+	vector<unsigned char> blob(SYSFS_DESCRIPTORS_MAX);
+	vector<DescriptorCache::Descriptor> descs;
+	char line[128];
+	int size;
+
+	snprintf(line, 128, "Bus %03d Device %03d: ID %04x:%04x raw descriptors",
+			bus_num_, device_addr_, id_vendor_, id_product_);
+	info.push_back(line);
+	info.push_back(" ");
+
+	size = sysfs_name_.empty() ? 0 : read_sysfs_raw(&blob[0], blob.size(),
+			sysfs_name_.c_str(), "descriptors");
+	if (size > 0) {
+		const unsigned char *buf = &blob[0];
+
+		info.push_back("Read by the kernel at enumeration:");
+		while (size >= 2 && buf[0] >= 2 && buf[0] <= size) {
+			snprintf(line, 128, "  %s (0x%02x), %u bytes",
+					desc_type_name(buf[1]), buf[1], buf[0]);
+			info.push_back(line);
+			hex_dump(info, "    ", buf, buf[0], width);
+			size -= buf[0];
+			buf += buf[0];
+		}
+		if (size > 0) {
+			snprintf(line, 128, "  %d trailing bytes", size);
+			info.push_back(line);
+			hex_dump(info, "    ", buf, size, width);
+		}
+	} else {
+		info.push_back("sysfs descriptors not available");
+	}
+
+	if (dev_handle_)
+		DescriptorCache::Get().getDescriptors(dev_handle_, descs);
+	if (descs.empty())
+		return;
+
+	info.push_back(" ");
+	info.push_back("Read from the device:");
+	for (unsigned int i = 0; i < descs.size(); i++) {
+		const DescriptorCache::Descriptor &d = descs[i];
+		unsigned int type = d.value >> 8;
+
+		snprintf(line, 128, "  %s (0x%02x) index %u, wIndex 0x%04x, %u bytes",
+				desc_type_name(type), type, d.value & 0xff, d.index,
+				(unsigned int)d.data.size());
+		info.push_back(line);
+		hex_dump(info, "    ", d.data.data(), d.data.size(), width);
+	}
+}
@@ -0,0 +1,287 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "names.h"
+#include "usbmisc.h"
+#include "desccache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char *UsbDevice::getSpeedName(int speed)
+{
+	switch (speed) {
+	case LIBUSB_SPEED_LOW:
+		return "1.5M";
+	case LIBUSB_SPEED_FULL:
+		return "12M";
+	case LIBUSB_SPEED_HIGH:
+		return "480M";
+	case LIBUSB_SPEED_SUPER:
+		return "5G";
+	case LIBUSB_SPEED_SUPER_PLUS:
+		return "10G";
+	default:
+		return "unknown speed";
+	}
+}
+
+/* negotiated speed of a device, from its sysfs "speed" attribute (Mbit/s) */
+static int read_sysfs_speed(const string &name)
+{
+	char value[16];
+	double mbps;
+
+	if (read_sysfs_prop(value, sizeof(value), name.c_str(), "speed") <= 0)
+		return LIBUSB_SPEED_UNKNOWN;
+
+	mbps = atof(value);
+	if (mbps >= 10000)
+		return LIBUSB_SPEED_SUPER_PLUS;
+	if (mbps >= 5000)
+		return LIBUSB_SPEED_SUPER;
+	if (mbps >= 480)
+		return LIBUSB_SPEED_HIGH;
+	if (mbps >= 12)
+		return LIBUSB_SPEED_FULL;
+	if (mbps > 0)
+		return LIBUSB_SPEED_LOW;
+	return LIBUSB_SPEED_UNKNOWN;
+}
+
+static string parent_name(const string &name)
+{
+	size_t dot = name.rfind('.');
+	size_t dash = name.find('-');
+
+	if (dot != string::npos)
+		return name.substr(0, dot);
+	return "usb" + name.substr(0, dash);
+}
+
+static int port_number(const string &name)
+{
+	return atoi(name.c_str() + name.find_last_of(".-") + 1);
+}
+
+/*
+ * A hub port able to run SuperSpeed has a "peer" link to its twin on
+ * the SuperSpeed half of the hub (or root hub).
+ */
+static bool port_has_peer(const string &name)
+{
+	string up = parent_name(name);
+	char path[256];
+
+	if (up.compare(0, 3, "usb") == 0)
+		snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s-0:1.0/%s-port%d/peer",
+				up.c_str() + 3, up.c_str(), port_number(name));
+	else
+		snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s:1.0/%s-port%d/peer",
+				up.c_str(), up.c_str(), port_number(name));
+	return access(path, F_OK) == 0;
+}
+
+/*
+ * Highest speed the SuperSpeed and SuperSpeedPlus capabilities of the
+ * BOS descriptor announce. A USB 3 device running at high speed reports
+ * bcdUSB 2.10, so this is the only place its SuperSpeed support shows.
+ */
+int UsbDevice::get_bos_speed()
+{
+	unsigned char head[5], *bos, *buf;
+	int size, ret, speed = LIBUSB_SPEED_UNKNOWN;
+
+	ret = usb_control_msg(dev_handle_,
+			LIBUSB_ENDPOINT_IN | LIBUSB_RECIPIENT_DEVICE,
+			LIBUSB_REQUEST_GET_DESCRIPTOR,
+			USB_DT_BOS << 8, 0, head, sizeof(head), CTRL_TIMEOUT);
+	if (ret < 5 || head[0] != 5 || head[1] != USB_DT_BOS)
+		return speed;
+
+	size = head[2] | (head[3] << 8);
+	bos = (unsigned char *)malloc(size);
+	if (!bos)
+		return speed;
+	ret = usb_control_msg(dev_handle_,
+			LIBUSB_ENDPOINT_IN | LIBUSB_RECIPIENT_DEVICE,
+			LIBUSB_REQUEST_GET_DESCRIPTOR,
+			USB_DT_BOS << 8, 0, bos, size, CTRL_TIMEOUT);
+	if (ret < size) {
+		free(bos);
+		return speed;
+	}
+
+	size -= 5;
+	buf = bos + 5;
+	while (size >= 3 && buf[0] >= 3 && buf[0] <= size) {
+		if (buf[2] == USB_DC_SUPERSPEED && buf[0] >= 10
+				&& (convert_le_u16(buf + 4) & 0x8)
+				&& speed < LIBUSB_SPEED_SUPER)
+			speed = LIBUSB_SPEED_SUPER;
+		if (buf[2] == USB_DC_SUPERSPEEDPLUS && buf[0] >= 12) {
+			unsigned int count = (buf[4] & 0x1f) + 1;
+
+			if (speed < LIBUSB_SPEED_SUPER)
+				speed = LIBUSB_SPEED_SUPER;
+			for (unsigned int i = 0; i < count && 16 + 4 * i <= buf[0]; i++) {
+				uint32_t attr = convert_le_u32(buf + 12 + 4 * i);
+
+				/* lane speed exponent 3 is Gb/s */
+				if (((attr >> 4) & 3) == 3 && (attr >> 16) >= 10)
+					speed = LIBUSB_SPEED_SUPER_PLUS;
+			}
+		}
+		size -= buf[0];
+		buf += buf[0];
+	}
+
+	free(bos);
+	return speed;
+}
+
+void UsbDevice::Reprobe()
+{
+	DescriptorCache::Get().Forget(dev_handle_);
+	capable_speed_ = -1;
+}
+
+/*
+ * Highest speed the device claims to support. The descriptors that tell
+ * are only fetched when they could show more than the negotiated speed,
+ * and the result is kept.
+ */
+int UsbDevice::getCapableSpeed()
+{
+	int speed;
+
+	if (capable_speed_ >= 0)
+		return capable_speed_;
+
+	capable_speed_ = speed_;
+	if (descriptor_.bcdUSB >= 0x0300 && capable_speed_ < LIBUSB_SPEED_SUPER)
+		capable_speed_ = LIBUSB_SPEED_SUPER;
+	if (!dev_handle_)
+		return capable_speed_;
+
+	if ((speed_ <= LIBUSB_SPEED_HIGH && descriptor_.bcdUSB >= 0x0210)
+			|| (speed_ == LIBUSB_SPEED_SUPER && descriptor_.bcdUSB >= 0x0310)) {
+		speed = get_bos_speed();
+		if (speed > capable_speed_)
+			capable_speed_ = speed;
+	}
+
+	/* a high speed device running at full speed still has a qualifier */
+	if (capable_speed_ == LIBUSB_SPEED_FULL && descriptor_.bcdUSB >= 0x0200) {
+		unsigned char buf[10];
+
+		if (usb_control_msg(dev_handle_,
+				LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD | LIBUSB_RECIPIENT_DEVICE,
+				LIBUSB_REQUEST_GET_DESCRIPTOR,
+				USB_DT_DEVICE_QUALIFIER << 8, 0,
+				buf, sizeof buf, CTRL_TIMEOUT) == sizeof buf
+				&& buf[1] == USB_DT_DEVICE_QUALIFIER)
+			capable_speed_ = LIBUSB_SPEED_HIGH;
+	}
+
+	return capable_speed_;
+}
+
+/*
+ * Tells whether the device runs below the speed it supports and, if so,
+ * the hop holding it back: the link to its port when the hub above runs
+ * fast enough, otherwise the slowest hub on the way to the root, or the
+ * port itself when it has no SuperSpeed pins.
+ */
+bool UsbDevice::getSpeedDowngrade(string &hop)
+{
+	int cap = getCapableSpeed();
+	string node = sysfs_name_, up;
+	char text[128];
+
+	if (isRootHub() || sysfs_name_.empty() || speed_ == LIBUSB_SPEED_UNKNOWN
+			|| cap <= speed_)
+		return false;
+
+	/* SuperSpeed runs on a bus of its own, the port peer tells if it exists */
+	if (cap >= LIBUSB_SPEED_SUPER && speed_ < LIBUSB_SPEED_SUPER) {
+		up = parent_name(node);
+		if (port_has_peer(node))
+			snprintf(text, sizeof(text), "%s port %d, no SuperSpeed link",
+					up.c_str(), port_number(node));
+		else
+			snprintf(text, sizeof(text), "%s port %d is USB 2 only",
+					up.c_str(), port_number(node));
+		hop = text;
+		return true;
+	}
+
+	for (;;) {
+		int up_speed;
+
+		up = parent_name(node);
+		up_speed = read_sysfs_speed(up);
+		if (up_speed >= cap || up_speed == LIBUSB_SPEED_UNKNOWN) {
+			if (node == sysfs_name_)
+				snprintf(text, sizeof(text), "%s port %d link",
+						up.c_str(), port_number(node));
+			else
+				snprintf(text, sizeof(text), "hub %s at %s",
+						node.c_str(),
+						getSpeedName(read_sysfs_speed(node)));
+			break;
+		}
+		if (up.compare(0, 3, "usb") == 0) {
+			snprintf(text, sizeof(text), "bus %s at %s", up.c_str(),
+					getSpeedName(up_speed));
+			break;
+		}
+		node = up;
+	}
+	hop = text;
+	return true;
+}
+
+void UsbDevice::dump_speed_info(vector<string> &info)
+{
+	string up = parent_name(sysfs_name_), hop;
+	char line[128];
+
+	if (isRootHub() || sysfs_name_.empty())
+		return;
+
+	info.push_back(" ");
+	info.push_back("Link Speed:");
+	snprintf(line, 128, "  Negotiated          %s", getSpeedName(speed_));
+	info.push_back(line);
+	snprintf(line, 128, "  Supported           %s (bcdUSB %x.%02x)",
+			getSpeedName(getCapableSpeed()), descriptor_.bcdUSB >> 8,
+			descriptor_.bcdUSB & 0xff);
+	info.push_back(line);
+	snprintf(line, 128, "  Upstream            %s at %s", up.c_str(),
+			getSpeedName(read_sysfs_speed(up)));
+	info.push_back(line);
+	if (getSpeedDowngrade(hop)) {
+		snprintf(line, 128, "  DOWNGRADED, limited by %s", hop.c_str());
+		info.push_back(line);
+	}
+}
@@ -0,0 +1,165 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbdevice.h"
+#include "names.h"
+#include "usbmisc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+/* mass storage transport protocols */
+#define USB_PR_BULK	0x50	/* bulk-only (BOT) */
+#define USB_PR_UAS	0x62	/* USB Attached SCSI */
+
+/*
+ * Streams a UAS altsetting gets: the smallest MaxStreams of its bulk
+ * endpoints, since the command, status and data pipes all need them.
+ * Returns 0 if any of them has no companion or no streams.
+ */
+static unsigned int get_uas_streams(const struct libusb_interface_descriptor *alt)
+{
+	unsigned int streams = 0;
+
+	for (int k = 0; k < alt->bNumEndpoints; k++) {
+		const struct libusb_endpoint_descriptor *ep = &alt->endpoint[k];
+		const unsigned char *comp;
+		unsigned int n;
+
+		if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK)
+				!= LIBUSB_TRANSFER_TYPE_BULK)
+			continue;
+		comp = find_ss_companion(ep);
+		if (!comp || !(comp[3] & 0x1f))
+			return 0;
+		n = 1U << (comp[3] & 0x1f);
+		if (!streams || n < streams)
+			streams = n;
+	}
+	return streams;
+}
+
+/*
+ * Walks the mass storage interfaces of the active configuration. Each
+ * one yields a status line; interfaces offering a usable UAS altsetting
+ * while the kernel runs them over bulk-only also yield an issue line.
+ */
+void UsbDevice::check_storage(const struct libusb_config_descriptor *config,
+		vector<string> *status, vector<string> *issues)
+{
+	char line[128], intf_name[64], driver[64];
+
+	for (int i = 0; i < config->bNumInterfaces; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+		const struct libusb_interface_descriptor *bot = NULL, *uas = NULL;
+		const struct libusb_interface_descriptor *cur = NULL;
+		unsigned int streams = 0;
+		int cur_num;
+
+		for (int j = 0; j < intf->num_altsetting; j++) {
+			const struct libusb_interface_descriptor *alt = &intf->altsetting[j];
+
+			if (alt->bInterfaceClass != LIBUSB_CLASS_MASS_STORAGE)
+				continue;
+			if (alt->bInterfaceProtocol == USB_PR_BULK && !bot)
+				bot = alt;
+			else if (alt->bInterfaceProtocol == USB_PR_UAS && !uas)
+				uas = alt;
+		}
+		if (!bot && !uas)
+			continue;
+
+		cur_num = get_current_altsetting(config->bConfigurationValue,
+				intf->altsetting[0].bInterfaceNumber);
+		for (int j = 0; j < intf->num_altsetting; j++) {
+			if (intf->altsetting[j].bAlternateSetting == cur_num)
+				cur = &intf->altsetting[j];
+		}
+
+		snprintf(intf_name, sizeof(intf_name), "%s:%u.%u", sysfs_name_.c_str(),
+				config->bConfigurationValue,
+				intf->altsetting[0].bInterfaceNumber);
+		if (read_sysfs_driver(driver, sizeof(driver), intf_name) <= 0)
+			strcpy(driver, "no driver");
+		if (uas)
+			streams = get_uas_streams(uas);
+
+		if (status) {
+			snprintf(line, 128, "  Interface %u: %s, altsetting %u (%s)",
+					intf->altsetting[0].bInterfaceNumber, driver, cur_num,
+					!cur ? "unknown" :
+					cur->bInterfaceProtocol == USB_PR_UAS ? "UAS" :
+					cur->bInterfaceProtocol == USB_PR_BULK ? "bulk-only" :
+					"other transport");
+			status->push_back(line);
+			if (uas && speed_ >= LIBUSB_SPEED_SUPER)
+				snprintf(line, 128, "    UAS altsetting %u, %u streams",
+						uas->bAlternateSetting, streams);
+			else if (uas)
+				snprintf(line, 128, "    UAS altsetting %u, no streams below SuperSpeed",
+						uas->bAlternateSetting);
+			else
+				snprintf(line, 128, "    no UAS altsetting");
+			status->push_back(line);
+		}
+
+		/* the uas driver refuses SuperSpeed devices without streams */
+		if (!issues || !uas || (speed_ >= LIBUSB_SPEED_SUPER && !streams))
+			continue;
+		if (!strcmp(driver, "uas")
+				|| (cur && cur->bInterfaceProtocol == USB_PR_UAS))
+			continue;
+		snprintf(line, 128, "Interface %u supports UAS but runs bulk-only through %s",
+				intf->altsetting[0].bInterfaceNumber, driver);
+		issues->push_back(line);
+	}
+}
+
+void UsbDevice::getUasIssues(vector<string> &issues)
+{
+	struct libusb_config_descriptor *config;
+
+	if (!usb_dev_ || libusb_get_active_config_descriptor(usb_dev_, &config))
+		return;
+
+	check_storage(config, NULL, &issues);
+	libusb_free_config_descriptor(config);
+}
+
+void UsbDevice::dump_storage_info(vector<string> &info)
+{
+	struct libusb_config_descriptor *config;
+	vector<string> status, issues;
+
+	if (!usb_dev_ || libusb_get_active_config_descriptor(usb_dev_, &config))
+		return;
+
+	check_storage(config, &status, &issues);
+	libusb_free_config_descriptor(config);
+	if (status.empty())
+		return;
+
+	info.push_back(" ");
+	info.push_back("Mass Storage Transport:");
+	info.insert(info.end(), status.begin(), status.end());
+	for (unsigned int i = 0; i < issues.size(); i++)
+		info.push_back("  " + issues[i]);
+	if (!issues.empty())
+		info.push_back("  check for a usb-storage quirk with the 'u' flag disabling UAS");
+}
@@ -0,0 +1,263 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbexporter.h"
+#include "usbcontext.h"
+#include "usbmisc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+static double speed_bps(int speed)
+{
+	switch (speed) {
+	case LIBUSB_SPEED_LOW:		return 1.5e6;
+	case LIBUSB_SPEED_FULL:		return 12e6;
+	case LIBUSB_SPEED_HIGH:		return 480e6;
+	case LIBUSB_SPEED_SUPER:	return 5e9;
+	case LIBUSB_SPEED_SUPER_PLUS:	return 10e9;
+	default:			return 0;
+	}
+}
+
+/* a label value, with \, " and newlines escaped */
+static string label(const string &value)
+{
+	string out = "\"";
+
+	for (size_t i = 0; i < value.size(); i++) {
+		if (value[i] == '\\' || value[i] == '"')
+			out += '\\';
+		if (value[i] == '\n')
+			out += "\\n";
+		else
+			out += value[i];
+	}
+	return out + "\"";
+}
+
+static void header(FILE *f, const char *name, const char *type,
+		const char *help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void UsbExporter::update(UsbContext &ctx, vector<DeviceMetrics *> &list)
+{
+	map<string, DeviceMetrics> devices;
+	char key[64], ids[128];
+
+	for (unsigned int i = 0; i < ctx.getUsbDevicesCount(); i++) {
+		UsbDevice &dev = ctx.getUsbDevice(i);
+		struct libusb_config_descriptor *config;
+		map<string, DeviceMetrics>::iterator it;
+
+		snprintf(key, sizeof(key), "%s %d:%d", dev.getSysfsName().c_str(),
+				dev.getBusNumber(), dev.getDeviceAddr());
+		it = devices_.find(key);
+		if (it != devices_.end()) {
+			devices[key] = it->second;
+			continue;
+		}
+
+		/* plugged since the last write */
+		DeviceMetrics &m = devices[key];
+
+		m.sysfs_name = dev.getSysfsName();
+		m.bus = dev.getBusNumber();
+		m.addr = dev.getDeviceAddr();
+		m.labels = "path=" + label(m.sysfs_name);
+		snprintf(ids, sizeof(ids), ",bus=\"%d\",device=\"%d\",vid=\"%04x\",pid=\"%04x\",",
+				m.bus, m.addr, dev.getIdVendor(), dev.getIdProduct());
+		m.info = m.labels + ids + "vendor=" + label(dev.getVendorName())
+			+ ",product=" + label(dev.getProductName());
+		m.speed = speed_bps(dev.getSpeed());
+		m.capable_speed = speed_bps(dev.getCapableSpeed());
+		m.alert = ctx.getUsbDeviceAlert(i);
+		m.hub = dev.isHub();
+		m.max_power = -1;
+		if (dev.getLibusbDevice() && libusb_get_active_config_descriptor(
+					dev.getLibusbDevice(), &config) == 0) {
+			m.max_power = config->MaxPower
+				* (dev.getDescriptor().bcdUSB >= 0x0300 ? 8 : 2);
+			libusb_free_config_descriptor(config);
+		}
+	}
+
+	/* drops the devices unplugged since */
+	devices_.swap(devices);
+	for (map<string, DeviceMetrics>::iterator it = devices_.begin();
+			it != devices_.end(); it++)
+		list.push_back(&it->second);
+}
+
+/*
+ * Port states come from the sysfs port attributes, which cost no bus
+ * traffic: "state" needs Linux 6.6, "over_current_count" 4.x.
+ */
+void UsbExporter::write_ports(FILE *f, const vector<DeviceMetrics *> &list)
+{
+	vector<string> states;
+	vector<pair<string, unsigned long> > counts;
+	char buf[64];
+
+	for (unsigned int i = 0; i < list.size(); i++) {
+		const DeviceMetrics &m = *list[i];
+		const char *hub = m.sysfs_name.c_str();
+
+		if (!m.hub)
+			continue;
+
+		for (int port = 1; port <= SYSFS_MAX_PORTS; port++) {
+			string labels = m.labels + ",port=\"" + to_string(port) + "\"";
+			bool found = false;
+
+			if (read_sysfs_port_prop(buf, sizeof(buf), hub, port, "state") > 0) {
+				states.push_back(labels + ",state=" + label(buf));
+				found = true;
+			}
+			if (read_sysfs_port_prop(buf, sizeof(buf), hub, port,
+						"over_current_count") > 0) {
+				counts.push_back(make_pair(labels,
+						strtoul(buf, NULL, 10)));
+				found = true;
+			}
+			if (!found)
+				break;
+		}
+	}
+
+	if (!states.empty()) {
+		header(f, "nlsusb_hub_port_state", "gauge",
+				"Hub port state from sysfs, 1 for the current state.");
+		for (unsigned int i = 0; i < states.size(); i++)
+			fprintf(f, "nlsusb_hub_port_state{%s} 1\n", states[i].c_str());
+	}
+	if (!counts.empty()) {
+		header(f, "nlsusb_hub_port_over_current_total", "counter",
+				"Over-current conditions seen on the hub port.");
+		for (unsigned int i = 0; i < counts.size(); i++)
+			fprintf(f, "nlsusb_hub_port_over_current_total{%s} %lu\n",
+					counts[i].first.c_str(), counts[i].second);
+	}
+}
+
+void UsbExporter::write_traffic(FILE *f, const vector<DeviceMetrics *> &list,
+		UsbContext &ctx)
+{
+	static const char *names[] = {
+		"nlsusb_device_transferred_bytes_total",
+		"nlsusb_device_urbs_total",
+		"nlsusb_device_urb_errors_total",
+	};
+	static const char *helps[] = {
+		"Bytes completed, seen by usbmon since the exporter started.",
+		"URBs completed, seen by usbmon since the exporter started.",
+		"URBs completed with an error, seen by usbmon since the exporter started.",
+	};
+	uint64_t totals[3];
+
+	if (!ctx.isMonitoring())
+		return;
+
+	for (unsigned int n = 0; n < 3; n++) {
+		header(f, names[n], "counter", helps[n]);
+		for (unsigned int i = 0; i < list.size(); i++) {
+			const DeviceMetrics &m = *list[i];
+
+			if (!ctx.getMonitor().getDeviceTotals(m.bus, m.addr,
+						totals[0], totals[1], totals[2]))
+				continue;
+			fprintf(f, "%s{%s} %llu\n", names[n], m.labels.c_str(),
+					(unsigned long long)totals[n]);
+		}
+	}
+}
+
+/*
+ * The textfile collector may read at any time, so the metrics go to a
+ * temporary file in the same directory that is then renamed over.
+ */
+int UsbExporter::Write(UsbContext &ctx)
+{
+	vector<DeviceMetrics *> list;
+	string tmp = path_ + ".tmp";
+	FILE *f;
+	int r = 0;
+
+	update(ctx, list);
+
+	f = fopen(tmp.c_str(), "w");
+	if (!f)
+		return -errno;
+
+	header(f, "nlsusb_devices", "gauge", "USB devices present.");
+	fprintf(f, "nlsusb_devices %u\n", (unsigned int)list.size());
+
+	header(f, "nlsusb_device_info", "gauge", "USB device identity.");
+	for (unsigned int i = 0; i < list.size(); i++)
+		fprintf(f, "nlsusb_device_info{%s} 1\n", list[i]->info.c_str());
+
+	header(f, "nlsusb_device_speed_bits_per_second", "gauge",
+			"Negotiated link speed.");
+	for (unsigned int i = 0; i < list.size(); i++) {
+		if (list[i]->speed)
+			fprintf(f, "nlsusb_device_speed_bits_per_second{%s} %g\n",
+					list[i]->labels.c_str(), list[i]->speed);
+	}
+
+	header(f, "nlsusb_device_capable_speed_bits_per_second", "gauge",
+			"Highest speed the device supports.");
+	for (unsigned int i = 0; i < list.size(); i++) {
+		if (list[i]->capable_speed)
+			fprintf(f, "nlsusb_device_capable_speed_bits_per_second{%s} %g\n",
+					list[i]->labels.c_str(), list[i]->capable_speed);
+	}
+
+	header(f, "nlsusb_device_max_power_milliamps", "gauge",
+			"MaxPower of the active configuration.");
+	for (unsigned int i = 0; i < list.size(); i++) {
+		if (list[i]->max_power >= 0)
+			fprintf(f, "nlsusb_device_max_power_milliamps{%s} %d\n",
+					list[i]->labels.c_str(), list[i]->max_power);
+	}
+
+	header(f, "nlsusb_device_alert", "gauge",
+			"1 if the device runs below its speed or has UAS unused.");
+	for (unsigned int i = 0; i < list.size(); i++)
+		fprintf(f, "nlsusb_device_alert{%s} %d\n",
+				list[i]->labels.c_str(), list[i]->alert);
+
+	write_ports(f, list);
+	write_traffic(f, list, ctx);
+
+	if (ferror(f))
+		r = -EIO;
+	if (fclose(f) && !r)
+		r = -errno;
+	if (!r && rename(tmp.c_str(), path_.c_str()) < 0)
+		r = -errno;
+	if (r)
+		unlink(tmp.c_str());
+	return r;
+}
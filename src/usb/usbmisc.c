@@ -14,6 +14,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 #ifdef HAVE_ICONV
 #include <iconv.h>
@@ -27,7 +30,11 @@
 
 /* ---------------------------------------------------------------------- */
 
+/* character major of the usbfs nodes */
+#define USB_DEVICE_MAJOR	189
+
 static const char *devbususb = "/dev/bus/usb";
+static const char *sysfsdevices = "/sys/bus/usb/devices";
 
 /* ---------------------------------------------------------------------- */
 
@@ -111,6 +118,34 @@ static char *get_absolute_path(const char *path, char *result,
 	return result;
 }
 
+/*
+ * Bus and device numbers of a usbfs node. The minor number of the node
+ * gives them without looking at any other device; the path itself is
+ * only parsed when the node can't be stat'ed.
+ */
+int get_usbfs_busdev(const char *path, unsigned int *busnum,
+		     unsigned int *devnum)
+{
+	char device_path[PATH_MAX + 1];
+	char absolute_path[PATH_MAX + 1];
+	struct stat st;
+	size_t len = strlen(devbususb);
+
+	if (stat(path, &st) == 0 && S_ISCHR(st.st_mode)
+			&& major(st.st_rdev) == USB_DEVICE_MAJOR) {
+		*busnum = minor(st.st_rdev) / 128 + 1;
+		*devnum = minor(st.st_rdev) % 128 + 1;
+		return 0;
+	}
+
+	readlink_recursive(path, device_path, sizeof(device_path));
+	get_absolute_path(device_path, absolute_path, sizeof(absolute_path));
+	if (strncmp(absolute_path, devbususb, len)
+			|| sscanf(absolute_path + len, "/%u/%u", busnum, devnum) != 2)
+		return -1;
+	return 0;
+}
+
 libusb_device *get_usb_device(libusb_context *ctx, const char *path)
 {
 	libusb_device **list;
@@ -141,31 +176,150 @@ libusb_device *get_usb_device(libusb_context *ctx, const char *path)
 	return dev;
 }
 
-static char *get_dev_string_ascii(libusb_device_handle *dev, size_t size,
-                                  u_int8_t id)
+int get_sysfs_name(char *buf, size_t size, libusb_device *dev)
 {
-	char *buf = malloc(size);
-	int ret = libusb_get_string_descriptor_ascii(dev, id,
-	                                             (unsigned char *) buf,
-	                                             size);
-
-	if (ret < 0) {
-		free(buf);
-		return strdup("(error)");
+	int len = 0;
+	uint8_t bnum = libusb_get_bus_number(dev);
+	uint8_t pnums[7];
+	int num_pnums;
+	int i;
+
+	buf[0] = '\0';
+
+	num_pnums = libusb_get_port_numbers(dev, pnums, sizeof(pnums));
+	if (num_pnums == LIBUSB_ERROR_OVERFLOW) {
+		return -1;
+	} else if (num_pnums == 0) {
+		/* Special-case root devices */
+		return snprintf(buf, size, "usb%d", bnum);
 	}
 
-	return buf;
+	len += snprintf(buf, size, "%d-", bnum);
+	for (i = 0; i < num_pnums; i++)
+		len += snprintf(buf + len, size - len, i ? ".%d" : "%d", pnums[i]);
+
+	return len;
+}
+
+int read_sysfs_prop(char *buf, size_t size, const char *sysfs_name,
+		    const char *propname)
+{
+	int n, fd;
+	char path[PATH_MAX];
+
+	buf[0] = '\0';
+	snprintf(path, sizeof(path), "%s/%s/%s", sysfsdevices, sysfs_name,
+		 propname);
+	fd = open(path, O_RDONLY);
+
+	if (fd == -1)
+		return 0;
+
+	n = read(fd, buf, size);
+
+	if (n > 0)
+		buf[n-1] = '\0';  /* Turn newline into null terminator */
+
+	close(fd);
+	return n;
+}
+
+int read_sysfs_port_prop(char *buf, size_t size, const char *hub_name,
+			 int port, const char *propname)
+{
+	char prop[PATH_MAX];
+
+	/* root hubs are "usbN" but their interface is "N-0:1.0" */
+	if (!strncmp(hub_name, "usb", 3))
+		snprintf(prop, sizeof(prop), "%s-0:1.0/%s-port%d/%s",
+			 hub_name + 3, hub_name, port, propname);
+	else
+		snprintf(prop, sizeof(prop), "%s:1.0/%s-port%d/%s",
+			 hub_name, hub_name, port, propname);
+	return read_sysfs_prop(buf, size, hub_name, prop);
+}
+
+/* a binary attribute, such as "descriptors", as is */
+int read_sysfs_raw(unsigned char *buf, size_t size, const char *sysfs_name,
+		   const char *propname)
+{
+	char path[PATH_MAX];
+	size_t len = 0;
+	int n, fd;
+
+	snprintf(path, sizeof(path), "%s/%s/%s", sysfsdevices, sysfs_name,
+		 propname);
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	while (len < size && (n = read(fd, buf + len, size - len)) > 0)
+		len += n;
+
+	close(fd);
+	return len;
+}
+
+/* name of the driver bound to a device or interface, empty if none */
+int read_sysfs_driver(char *buf, size_t size, const char *sysfs_name)
+{
+	char path[PATH_MAX], target[PATH_MAX];
+	const char *name;
+	int n;
+
+	buf[0] = '\0';
+	snprintf(path, sizeof(path), "%s/%s/driver", sysfsdevices, sysfs_name);
+	n = readlink(path, target, sizeof(target) - 1);
+	if (n <= 0)
+		return 0;
+	target[n] = '\0';
+
+	name = strrchr(target, '/');
+	return snprintf(buf, size, "%s", name ? name + 1 : target);
+}
+
+static int get_string_descriptor(libusb_device_handle *dev, u_int8_t id,
+				 u_int16_t langid, unsigned char *buf, int size)
+{
+	return desc_cache_control(dev, LIBUSB_ENDPOINT_IN,
+				  LIBUSB_REQUEST_GET_DESCRIPTOR,
+				  (LIBUSB_DT_STRING << 8) | id, langid,
+				  buf, size, 1000);
 }
 
-#if defined(HAVE_NL_LANGINFO) && defined(HAVE_ICONV)
 static u_int16_t get_any_langid(libusb_device_handle *dev)
 {
 	unsigned char buf[4];
-	int ret = libusb_get_string_descriptor(dev, 0, 0, buf, sizeof buf);
+	int ret = get_string_descriptor(dev, 0, 0, buf, sizeof buf);
 	if (ret != sizeof buf) return 0;
 	return buf[2] | (buf[3] << 8);
 }
 
+/* as libusb_get_string_descriptor_ascii(), through the descriptor cache */
+static char *get_dev_string_ascii(libusb_device_handle *dev, size_t size,
+                                  u_int8_t id)
+{
+	unsigned char tbuf[255];
+	u_int16_t langid = get_any_langid(dev);
+	char *buf;
+	int ret, di, si;
+
+	if (!langid)
+		return strdup("(error)");
+	ret = get_string_descriptor(dev, id, langid, tbuf, sizeof tbuf);
+	if (ret < 2 || tbuf[1] != LIBUSB_DT_STRING || tbuf[0] > ret)
+		return strdup("(error)");
+
+	buf = malloc(size);
+	for (di = 0, si = 2; si + 1 < tbuf[0] && di < (int)size - 1; si += 2)
+		buf[di++] = tbuf[si + 1] || (tbuf[si] & 0x80) ? '?' : tbuf[si];
+	buf[di] = '\0';
+
+	return buf;
+}
+
+#if defined(HAVE_NL_LANGINFO) && defined(HAVE_ICONV)
+
 static char *usb_string_to_native(char * str, size_t len)
 {
 	size_t num_converted;
@@ -210,9 +364,9 @@ char *get_dev_string(libusb_device_handle *dev, u_int8_t id)
 	langid = get_any_langid(dev);
 	if (!langid) return strdup("(error)");
 
-	ret = libusb_get_string_descriptor(dev, id, langid,
-	                                   (unsigned char *) unicode_buf,
-	                                   sizeof unicode_buf);
+	ret = get_string_descriptor(dev, id, langid,
+	                            (unsigned char *) unicode_buf,
+	                            sizeof unicode_buf);
 	if (ret < 2) return strdup("(error)");
 
 	if ((unsigned char)unicode_buf[0] < 2 || unicode_buf[1] != LIBUSB_DT_STRING)
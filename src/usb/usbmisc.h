@@ -18,9 +18,27 @@ extern "C" {
 /* ---------------------------------------------------------------------- */
 
 extern libusb_device *get_usb_device(libusb_context *ctx, const char *path);
+extern int get_usbfs_busdev(const char *path, unsigned int *busnum,
+			    unsigned int *devnum);
 
 char *get_dev_string(libusb_device_handle *dev, u_int8_t id);
 
+/* control transfer, GET_DESCRIPTOR answered from the descriptor cache */
+int desc_cache_control(libusb_device_handle *dev, uint8_t requesttype,
+		       uint8_t request, uint16_t value, uint16_t index,
+		       unsigned char *data, uint16_t size, unsigned int timeout);
+
+/* sysfs device name ("usb1", "1-2.3") and attribute helpers */
+int get_sysfs_name(char *buf, size_t size, libusb_device *dev);
+int read_sysfs_prop(char *buf, size_t size, const char *sysfs_name,
+		    const char *propname);
+int read_sysfs_driver(char *buf, size_t size, const char *sysfs_name);
+/* attribute of a hub port, e.g. "state" (Linux 6.6) or "over_current_count" */
+int read_sysfs_port_prop(char *buf, size_t size, const char *hub_name,
+			 int port, const char *propname);
+int read_sysfs_raw(unsigned char *buf, size_t size, const char *sysfs_name,
+		   const char *propname);
+
 #ifdef __cplusplus
 }
 #endif
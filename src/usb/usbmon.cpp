@@ -0,0 +1,780 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbmon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+using namespace std;
+
+/*
+ * Binary usbmon interface, see Documentation/usb/usbmon.rst
+ */
+struct mon_bin_hdr {
+	uint64_t id;
+	unsigned char type;
+	unsigned char xfer_type;
+	unsigned char epnum;
+	unsigned char devnum;
+	unsigned short busnum;
+	char flag_setup;
+	char flag_data;
+	int64_t ts_sec;
+	int32_t ts_usec;
+	int32_t status;
+	uint32_t len_urb;
+	uint32_t len_cap;
+	union {
+		unsigned char setup[8];
+		struct {
+			int32_t error_count;
+			int32_t numdesc;
+		} iso;
+	} s;
+	/* the fields below are only present in the 64 byte header */
+	int32_t interval;
+	int32_t start_frame;
+	uint32_t xfer_flags;
+	uint32_t ndesc;
+};
+
+#define MON_HDR_LEN_48		48
+#define MON_HDR_LEN_64		64
+
+struct mon_bin_get {
+	struct mon_bin_hdr *hdr;
+	void *data;
+	size_t alloc;
+};
+
+struct mon_bin_mfetch {
+	uint32_t *offvec;
+	uint32_t nfetch;
+	uint32_t nflush;
+};
+
+#define MON_IOC_MAGIC		0x92
+#define MON_IOCQ_RING_SIZE	_IO(MON_IOC_MAGIC, 5)
+#define MON_IOCX_MFETCH		_IOWR(MON_IOC_MAGIC, 7, struct mon_bin_mfetch)
+#define MON_IOCX_GETX		_IOW(MON_IOC_MAGIC, 10, struct mon_bin_get)
+
+#define MON_FETCH_MAX		256
+#define MON_TYPE_FILLER		'@'
+
+/* pcap link types carrying a usbmon header */
+#define LINKTYPE_USB_LINUX		189
+#define LINKTYPE_USB_LINUX_MMAPPED	220
+
+#define FILE_READ_MAX		4096
+#define PENDING_MAX		65536
+
+static void decode_mon_hdr(const struct mon_bin_hdr *hdr, UsbMonEvent &ev)
+{
+	ev.id = hdr->id;
+	ev.type = hdr->type;
+	ev.xfer_type = hdr->xfer_type;
+	ev.epnum = hdr->epnum;
+	ev.devnum = hdr->devnum;
+	ev.busnum = hdr->busnum;
+	ev.status = hdr->status;
+	ev.length = hdr->len_urb;
+	ev.ts_us = hdr->ts_sec * 1000000ULL + hdr->ts_usec;
+}
+
+/* ---------------------------------------------------------------------- */
+
+UsbMonBinSource::UsbMonBinSource()
+	: fd_(-1),
+	ring_(NULL),
+	ring_size_(0),
+	nflush_(0)
+{
+}
+
+UsbMonBinSource::~UsbMonBinSource()
+{
+	if (ring_)
+		munmap(ring_, ring_size_);
+	if (fd_ >= 0)
+		close(fd_);
+}
+
+int UsbMonBinSource::Open(const string &path)
+{
+	int size;
+
+	fd_ = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+	if (fd_ < 0)
+		return -errno;
+	path_ = path;
+
+	/* mapping the ring lets us fetch events without copying them */
+	size = ioctl(fd_, MON_IOCQ_RING_SIZE);
+	if (size > 0) {
+		void *ring = mmap(NULL, size, PROT_READ, MAP_SHARED, fd_, 0);
+		if (ring != MAP_FAILED) {
+			ring_ = (unsigned char *)ring;
+			ring_size_ = size;
+		}
+	}
+
+	return 0;
+}
+
+int UsbMonBinSource::ReadRing(vector<UsbMonEvent> &events)
+{
+	uint32_t offvec[MON_FETCH_MAX];
+	struct mon_bin_mfetch mfetch;
+	int count = 0;
+
+	mfetch.offvec = offvec;
+	mfetch.nfetch = MON_FETCH_MAX;
+	mfetch.nflush = nflush_;
+	nflush_ = 0;
+
+	if (ioctl(fd_, MON_IOCX_MFETCH, &mfetch) < 0)
+		return errno == EAGAIN ? 0 : -errno;
+
+	for (uint32_t i = 0; i < mfetch.nfetch; i++) {
+		const struct mon_bin_hdr *hdr;
+		UsbMonEvent ev;
+
+		if (offvec[i] + sizeof(*hdr) > ring_size_)
+			continue;
+		hdr = (const struct mon_bin_hdr *)(ring_ + offvec[i]);
+		if (hdr->type == MON_TYPE_FILLER)
+			continue;
+		decode_mon_hdr(hdr, ev);
+		events.push_back(ev);
+		count++;
+	}
+
+	/* released on the next fetch */
+	nflush_ = mfetch.nfetch;
+	return count;
+}
+
+int UsbMonBinSource::ReadCopy(vector<UsbMonEvent> &events)
+{
+	struct mon_bin_hdr hdr;
+	struct mon_bin_get get;
+	int count = 0;
+
+	get.hdr = &hdr;
+	get.data = NULL;
+	get.alloc = 0;
+
+	while (count < MON_FETCH_MAX) {
+		UsbMonEvent ev;
+
+		if (ioctl(fd_, MON_IOCX_GETX, &get) < 0) {
+			if (errno == EAGAIN)
+				break;
+			return count ? count : -errno;
+		}
+		decode_mon_hdr(&hdr, ev);
+		events.push_back(ev);
+		count++;
+	}
+
+	return count;
+}
+
+int UsbMonBinSource::Read(vector<UsbMonEvent> &events)
+{
+	if (fd_ < 0)
+		return -EBADF;
+
+	return ring_ ? ReadRing(events) : ReadCopy(events);
+}
+
+/* ---------------------------------------------------------------------- */
+
+UsbMonFileSource::UsbMonFileSource()
+	: file_(NULL),
+	pcap_(false),
+	swapped_(false),
+	hdr_len_(MON_HDR_LEN_64)
+{
+}
+
+UsbMonFileSource::~UsbMonFileSource()
+{
+	if (file_)
+		fclose(file_);
+}
+
+static uint32_t swap32(uint32_t v)
+{
+	return ((v & 0xff) << 24) | ((v & 0xff00) << 8)
+		| ((v >> 8) & 0xff00) | (v >> 24);
+}
+
+int UsbMonFileSource::Open(const string &path)
+{
+	uint32_t ghdr[6];
+
+	file_ = fopen(path.c_str(), "rb");
+	if (!file_)
+		return -errno;
+	path_ = path;
+
+	if (fread(ghdr, sizeof(ghdr), 1, file_) == 1) {
+		switch (ghdr[0]) {
+		/* micro and nanosecond resolution captures; event times
+		 * are taken from the usbmon header either way */
+		case 0xa1b2c3d4:
+		case 0xa1b23c4d:
+			pcap_ = true;
+			break;
+		case 0xd4c3b2a1:
+		case 0x4d3cb2a1:
+			pcap_ = swapped_ = true;
+			break;
+		}
+	}
+
+	if (!pcap_) {
+		/* anything else is read as usbmon text */
+		rewind(file_);
+		return 0;
+	}
+
+	switch (swapped_ ? swap32(ghdr[5]) : ghdr[5]) {
+	case LINKTYPE_USB_LINUX:
+		hdr_len_ = MON_HDR_LEN_48;
+		break;
+	case LINKTYPE_USB_LINUX_MMAPPED:
+		hdr_len_ = MON_HDR_LEN_64;
+		break;
+	default:
+		fclose(file_);
+		file_ = NULL;
+		return -EPROTONOSUPPORT;
+	}
+
+	return 0;
+}
+
+int UsbMonFileSource::ReadPcap(vector<UsbMonEvent> &events)
+{
+	int count = 0;
+
+	while (count < FILE_READ_MAX) {
+		uint32_t rec[4];
+		unsigned char pkt[MON_HDR_LEN_64];
+		struct mon_bin_hdr hdr;
+		uint32_t incl_len;
+		UsbMonEvent ev;
+
+		if (fread(rec, sizeof(rec), 1, file_) != 1)
+			break;
+		incl_len = swapped_ ? swap32(rec[2]) : rec[2];
+		if (incl_len < hdr_len_) {
+			fseek(file_, incl_len, SEEK_CUR);
+			continue;
+		}
+		if (fread(pkt, hdr_len_, 1, file_) != 1)
+			break;
+		fseek(file_, incl_len - hdr_len_, SEEK_CUR);
+
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(&hdr, pkt, hdr_len_);
+		decode_mon_hdr(&hdr, ev);
+		events.push_back(ev);
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * usbmon text format, e.g.
+ *   ffff88003b4d8b40 1863734713 S Bi:2:004:1 -115 64 <
+ *   ffff88003b4d8b40 1863734998 C Bi:2:004:1 0 13 = 00000000 ...
+ * Addresses without a bus number ("Bi:004:1", 't' format) read as bus 0.
+ */
+static bool parse_text_event(char *line, UsbMonEvent &ev)
+{
+	char *tok[16];
+	int n = 0;
+	char *save = NULL;
+	unsigned int a, b, c;
+	int i;
+
+	for (char *t = strtok_r(line, " \t\n", &save); t && n < 16;
+			t = strtok_r(NULL, " \t\n", &save))
+		tok[n++] = t;
+	if (n < 5 || strlen(tok[2]) != 1 || strlen(tok[3]) < 4)
+		return false;
+
+	ev.id = strtoull(tok[0], NULL, 16);
+	ev.ts_us = strtoull(tok[1], NULL, 10);
+	ev.type = tok[2][0];
+
+	switch (tok[3][0]) {
+	case 'Z': ev.xfer_type = USBMON_XFER_ISO; break;
+	case 'I': ev.xfer_type = USBMON_XFER_INTR; break;
+	case 'C': ev.xfer_type = USBMON_XFER_CTRL; break;
+	case 'B': ev.xfer_type = USBMON_XFER_BULK; break;
+	default: return false;
+	}
+	if (sscanf(tok[3] + 3, "%u:%u:%u", &a, &b, &c) == 3) {
+		ev.busnum = a;
+		ev.devnum = b;
+		ev.epnum = c;
+	} else if (sscanf(tok[3] + 3, "%u:%u", &b, &c) == 2) {
+		ev.busnum = 0;
+		ev.devnum = b;
+		ev.epnum = c;
+	} else {
+		return false;
+	}
+	if (tok[3][1] == 'i')
+		ev.epnum |= 0x80;
+
+	/* control submissions carry the setup packet instead of a status */
+	i = 4;
+	if (!strcmp(tok[i], "s")) {
+		ev.status = -EINPROGRESS;
+		i += 6;
+	} else {
+		ev.status = atoi(tok[i]);
+		i++;
+	}
+	ev.length = i < n ? strtoul(tok[i], NULL, 10) : 0;
+
+	return true;
+}
+
+int UsbMonFileSource::ReadText(vector<UsbMonEvent> &events)
+{
+	char line[1024];
+	int count = 0;
+
+	while (count < FILE_READ_MAX && fgets(line, sizeof(line), file_)) {
+		UsbMonEvent ev;
+
+		if (parse_text_event(line, ev)) {
+			events.push_back(ev);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+int UsbMonFileSource::Read(vector<UsbMonEvent> &events)
+{
+	if (!file_)
+		return -EBADF;
+
+	return pcap_ ? ReadPcap(events) : ReadText(events);
+}
+
+/* ---------------------------------------------------------------------- */
+
+unsigned int LatencyHistogram::BucketIndex(uint32_t us)
+{
+	unsigned int msb, shift;
+
+	if (us < LATENCY_SUB_BUCKETS)
+		return us;
+
+	msb = 31 - __builtin_clz(us);
+	shift = msb - (LATENCY_SUB_BUCKET_BITS - 1);
+	return shift * (LATENCY_SUB_BUCKETS / 2) + (us >> shift);
+}
+
+uint32_t LatencyHistogram::BucketHighest(unsigned int index)
+{
+	unsigned int shift;
+	uint64_t sub;
+
+	if (index < LATENCY_SUB_BUCKETS)
+		return index;
+
+	shift = index / (LATENCY_SUB_BUCKETS / 2) - 1;
+	sub = index % (LATENCY_SUB_BUCKETS / 2) + LATENCY_SUB_BUCKETS / 2;
+	return (((sub + 1) << shift) - 1) & 0xffffffff;
+}
+
+void LatencyHistogram::Record(uint64_t us)
+{
+	uint32_t v = us > 0xffffffff ? 0xffffffff : us;
+
+	counts[BucketIndex(v)]++;
+	total++;
+	if (v > max_us)
+		max_us = v;
+}
+
+uint32_t LatencyHistogram::Percentile(double q) const
+{
+	uint64_t rank, seen = 0;
+
+	if (!total)
+		return 0;
+
+	rank = (uint64_t)(q * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank)
+			return min(BucketHighest(i), max_us);
+	}
+	return max_us;
+}
+
+/* ---------------------------------------------------------------------- */
+
+TrafficSlot &EndpointTraffic::getSlot(uint64_t sec)
+{
+	TrafficSlot &slot = slots[sec % TRAFFIC_WINDOW_SECS];
+
+	if (slot.sec != sec) {
+		memset(&slot, 0, sizeof(slot));
+		slot.sec = sec;
+	}
+	return slot;
+}
+
+void EndpointTraffic::Sum(uint64_t now_sec, unsigned int secs,
+		TrafficSlot &total) const
+{
+	for (unsigned int i = 0; i < TRAFFIC_WINDOW_SECS; i++) {
+		const TrafficSlot &slot = slots[i];
+
+		if (slot.sec > now_sec || slot.sec + secs <= now_sec)
+			continue;
+		total.bytes += slot.bytes;
+		total.urbs += slot.urbs;
+		total.errors += slot.errors;
+		total.latency_us += slot.latency_us;
+		total.latency_count += slot.latency_count;
+	}
+}
+
+UsbMonitor::UsbMonitor()
+	: source_(NULL),
+	now_us_(0)
+{
+}
+
+UsbMonitor::~UsbMonitor()
+{
+	Close();
+}
+
+int UsbMonitor::Open(const string &spec)
+{
+	int r;
+
+	Close();
+
+	if (spec.compare(0, 11, "/dev/usbmon") == 0) {
+		UsbMonBinSource *bin = new UsbMonBinSource;
+		r = bin->Open(spec);
+		if (r < 0) {
+			delete bin;
+			return r;
+		}
+		source_ = bin;
+	} else {
+		UsbMonFileSource *file = new UsbMonFileSource;
+		r = file->Open(spec);
+		if (r < 0) {
+			delete file;
+			return r;
+		}
+		source_ = file;
+	}
+
+	return 0;
+}
+
+void UsbMonitor::Close()
+{
+	delete source_;
+	source_ = NULL;
+	endpoints_.clear();
+	pending_.clear();
+	now_us_ = 0;
+}
+
+void UsbMonitor::Account(const UsbMonEvent &ev)
+{
+	uint32_t key = (ev.busnum << 16) | (ev.devnum << 8) | ev.epnum;
+	map<uint32_t, EndpointTraffic>::iterator it = endpoints_.find(key);
+
+	if (it == endpoints_.end()) {
+		EndpointTraffic ep;
+
+		memset(&ep, 0, sizeof(ep));
+		ep.busnum = ev.busnum;
+		ep.devnum = ev.devnum;
+		ep.epnum = ev.epnum;
+		ep.xfer_type = ev.xfer_type;
+		it = endpoints_.insert(make_pair(key, ep)).first;
+	}
+
+	if (ev.ts_us > now_us_)
+		now_us_ = ev.ts_us;
+
+	TrafficSlot &slot = it->second.getSlot(ev.ts_us / 1000000);
+	map<uint64_t, uint64_t>::iterator sub;
+
+	switch (ev.type) {
+	case 'S':
+		if (pending_.size() >= PENDING_MAX)
+			pending_.clear();
+		pending_[ev.id] = ev.ts_us;
+		break;
+	case 'E':
+		slot.urbs++;
+		slot.errors++;
+		it->second.total_urbs++;
+		it->second.total_errors++;
+		pending_.erase(ev.id);
+		break;
+	case 'C':
+		slot.urbs++;
+		slot.bytes += ev.length;
+		it->second.total_urbs++;
+		it->second.total_bytes += ev.length;
+		sub = pending_.find(ev.id);
+
+		/*
+		 * Driver and libusb timeouts are seen as unlinks
+		 * (-ENOENT, -ECONNRESET), -ETIMEDOUT is rare: an URB
+		 * unlinked UNLINK_TIMEOUT_US or more after its submission
+		 * is taken as timed out, an earlier one as cancelled.
+		 * Neither goes in the latency histogram.
+		 */
+		if (ev.status == -ENOENT || ev.status == -ECONNRESET
+				|| ev.status == -ETIMEDOUT) {
+			if (ev.status == -ETIMEDOUT || (sub != pending_.end()
+					&& ev.ts_us >= sub->second + UNLINK_TIMEOUT_US)) {
+				it->second.timeouts++;
+				slot.errors++;
+				it->second.total_errors++;
+			} else {
+				it->second.unlinks++;
+			}
+			if (sub != pending_.end())
+				pending_.erase(sub);
+			break;
+		}
+
+		if (ev.status < 0) {
+			slot.errors++;
+			it->second.total_errors++;
+		}
+		if (sub != pending_.end()) {
+			if (ev.ts_us >= sub->second) {
+				slot.latency_us += ev.ts_us - sub->second;
+				slot.latency_count++;
+				it->second.latency.Record(ev.ts_us - sub->second);
+			}
+			pending_.erase(sub);
+		}
+		break;
+	}
+}
+
+const EndpointTraffic *UsbMonitor::getEndpoint(int busnum, int devnum,
+		uint8_t epnum) const
+{
+	uint32_t key = (busnum << 16) | (devnum << 8) | epnum;
+	map<uint32_t, EndpointTraffic>::const_iterator it = endpoints_.find(key);
+
+	return it == endpoints_.end() ? NULL : &it->second;
+}
+
+bool UsbMonitor::getDeviceTotals(int busnum, int devnum, uint64_t &bytes,
+		uint64_t &urbs, uint64_t &errors) const
+{
+	uint32_t key = (busnum << 16) | (devnum << 8);
+	map<uint32_t, EndpointTraffic>::const_iterator it;
+	bool found = false;
+
+	bytes = urbs = errors = 0;
+	/* the endpoints of a device are next to each other in the map */
+	for (it = endpoints_.lower_bound(key);
+			it != endpoints_.end() && (it->first & ~0xffU) == key; it++) {
+		bytes += it->second.total_bytes;
+		urbs += it->second.total_urbs;
+		errors += it->second.total_errors;
+		found = true;
+	}
+	return found;
+}
+
+int UsbMonitor::Poll()
+{
+	vector<UsbMonEvent> events;
+	int total = 0;
+	int r;
+
+	if (!source_)
+		return -EBADF;
+
+	do {
+		events.clear();
+		r = source_->Read(events);
+		for (unsigned int i = 0; i < events.size(); i++)
+			Account(events[i]);
+		total += events.size();
+	} while (r > 0 && total < 64 * 1024);
+
+	return r < 0 ? r : total;
+}
+
+static void format_rate(char *buf, size_t size, uint64_t bytes, unsigned int secs)
+{
+	double rate = (double)bytes / secs;
+
+	if (rate >= 1000000)
+		snprintf(buf, size, "%6.1f MB/s", rate / 1000000);
+	else if (rate >= 1000)
+		snprintf(buf, size, "%6.1f kB/s", rate / 1000);
+	else
+		snprintf(buf, size, "%6.0f  B/s", rate);
+}
+
+static void format_latency(char *buf, size_t size, const TrafficSlot &s)
+{
+	if (!s.latency_count)
+		snprintf(buf, size, "%9s", "-");
+	else
+		snprintf(buf, size, "%6llu us",
+			(unsigned long long)(s.latency_us / s.latency_count));
+}
+
+struct TopEntry {
+	TrafficSlot last;
+	TrafficSlot window;
+	const EndpointTraffic *ep;
+};
+
+static bool top_entry_cmp(const TopEntry &a, const TopEntry &b)
+{
+	return a.window.bytes > b.window.bytes;
+}
+
+void UsbMonitor::getTopList(vector<string> &list, const map<int, string> &labels)
+{
+	static const char * const types[] = { "Isoc", "Int", "Ctrl", "Bulk" };
+	map<int, vector<TopEntry> > per_device;
+	vector<TopEntry> devices;
+	uint64_t now_sec = now_us_ / 1000000;
+	char line[256], last[32], window[32], latency[32];
+
+	snprintf(line, sizeof(line), "Traffic from %s",
+			source_ ? source_->getName().c_str() : "(none)");
+	list.push_back(line);
+	snprintf(line, sizeof(line), "%-44s %11s %11s %7s %5s %9s",
+			"", "1s", "10s", "URB/s", "Err", "Latency");
+	list.push_back(line);
+
+	for (map<uint32_t, EndpointTraffic>::const_iterator it = endpoints_.begin();
+			it != endpoints_.end(); ++it) {
+		TopEntry e;
+
+		memset(&e.last, 0, sizeof(e.last));
+		memset(&e.window, 0, sizeof(e.window));
+		e.ep = &it->second;
+		e.ep->Sum(now_sec, 1, e.last);
+		e.ep->Sum(now_sec, TRAFFIC_WINDOW_SECS, e.window);
+		if (!e.window.urbs)
+			continue;
+		per_device[(e.ep->busnum << 8) | e.ep->devnum].push_back(e);
+	}
+
+	for (map<int, vector<TopEntry> >::iterator it = per_device.begin();
+			it != per_device.end(); ++it) {
+		TopEntry d;
+
+		memset(&d, 0, sizeof(d));
+		d.ep = it->second[0].ep;
+		for (unsigned int i = 0; i < it->second.size(); i++) {
+			const TopEntry &e = it->second[i];
+
+			d.last.bytes += e.last.bytes;
+			d.last.urbs += e.last.urbs;
+			d.window.bytes += e.window.bytes;
+			d.window.urbs += e.window.urbs;
+			d.window.errors += e.window.errors;
+			d.window.latency_us += e.window.latency_us;
+			d.window.latency_count += e.window.latency_count;
+		}
+		devices.push_back(d);
+		sort(it->second.begin(), it->second.end(), top_entry_cmp);
+	}
+	sort(devices.begin(), devices.end(), top_entry_cmp);
+
+	if (devices.empty())
+		list.push_back("  no traffic");
+
+	for (unsigned int i = 0; i < devices.size(); i++) {
+		const TopEntry &d = devices[i];
+		int key = (d.ep->busnum << 8) | d.ep->devnum;
+		map<int, string>::const_iterator label = labels.find(key);
+		char name[64];
+
+		if (label != labels.end())
+			snprintf(name, sizeof(name), "%s", label->second.c_str());
+		else
+			snprintf(name, sizeof(name), "Bus %03u Device %03u",
+					d.ep->busnum, d.ep->devnum);
+
+		format_rate(last, sizeof(last), d.last.bytes, 1);
+		format_rate(window, sizeof(window), d.window.bytes, TRAFFIC_WINDOW_SECS);
+		format_latency(latency, sizeof(latency), d.window);
+		snprintf(line, sizeof(line), "%-44.44s %11s %11s %7u %5u %9s",
+				name, last, window,
+				d.window.urbs / TRAFFIC_WINDOW_SECS,
+				d.window.errors, latency);
+		list.push_back(line);
+
+		const vector<TopEntry> &eps = per_device[key];
+		for (unsigned int j = 0; j < eps.size(); j++) {
+			const TopEntry &e = eps[j];
+
+			format_rate(last, sizeof(last), e.last.bytes, 1);
+			format_rate(window, sizeof(window), e.window.bytes,
+					TRAFFIC_WINDOW_SECS);
+			format_latency(latency, sizeof(latency), e.window);
+			snprintf(name, sizeof(name), "    EP 0x%02x %s %s",
+					e.ep->epnum, types[e.ep->xfer_type & 3],
+					(e.ep->epnum & 0x80) ? "IN" : "OUT");
+			snprintf(line, sizeof(line), "%-44.44s %11s %11s %7u %5u %9s",
+					name, last, window,
+					e.window.urbs / TRAFFIC_WINDOW_SECS,
+					e.window.errors, latency);
+			list.push_back(line);
+		}
+	}
+}
@@ -0,0 +1,502 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbquery.h"
+#include "usbdevice.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+using namespace std;
+
+enum FieldId {
+	F_VID, F_PID, F_BUS, F_ADDR, F_SPEED, F_BCDUSB, F_BCDDEVICE,
+	F_DCLASS, F_DSUBCLASS, F_DPROTOCOL, F_VENDOR, F_NAME,
+	F_MAXPOWER, F_CONFIG, F_CLASS, F_SUBCLASS, F_PROTOCOL, F_INTERFACE,
+	F_ALT, F_NUMEP, F_EP, F_TYPE, F_DIR, F_INTERVAL, F_MAXP,
+	F_SERIAL, F_MANUFACTURER, F_PRODUCT,
+};
+
+struct QuerySymbol {
+	const char *name;
+	int value;
+};
+
+static const QuerySymbol speed_symbols[] = {
+	{ "low", LIBUSB_SPEED_LOW },
+	{ "full", LIBUSB_SPEED_FULL },
+	{ "high", LIBUSB_SPEED_HIGH },
+	{ "super", LIBUSB_SPEED_SUPER },
+	{ "super+", LIBUSB_SPEED_SUPER_PLUS },
+	{ NULL, 0 }
+};
+
+static const QuerySymbol type_symbols[] = {
+	{ "control", LIBUSB_TRANSFER_TYPE_CONTROL },
+	{ "isochronous", LIBUSB_TRANSFER_TYPE_ISOCHRONOUS },
+	{ "iso", LIBUSB_TRANSFER_TYPE_ISOCHRONOUS },
+	{ "bulk", LIBUSB_TRANSFER_TYPE_BULK },
+	{ "interrupt", LIBUSB_TRANSFER_TYPE_INTERRUPT },
+	{ "int", LIBUSB_TRANSFER_TYPE_INTERRUPT },
+	{ NULL, 0 }
+};
+
+static const QuerySymbol dir_symbols[] = {
+	{ "in", 1 },
+	{ "out", 0 },
+	{ NULL, 0 }
+};
+
+struct QueryField {
+	const char *name;
+	FieldId id;
+	UsbQuery::Cost cost;
+	bool text;
+	const QuerySymbol *symbols;
+};
+
+/* names are matched case insensitively, descriptor field names are aliases */
+static const QueryField query_fields[] = {
+	{ "vid", F_VID, UsbQuery::COST_DEVICE, false, NULL },
+	{ "idVendor", F_VID, UsbQuery::COST_DEVICE, false, NULL },
+	{ "pid", F_PID, UsbQuery::COST_DEVICE, false, NULL },
+	{ "idProduct", F_PID, UsbQuery::COST_DEVICE, false, NULL },
+	{ "bus", F_BUS, UsbQuery::COST_DEVICE, false, NULL },
+	{ "addr", F_ADDR, UsbQuery::COST_DEVICE, false, NULL },
+	{ "speed", F_SPEED, UsbQuery::COST_DEVICE, false, speed_symbols },
+	{ "bcdUSB", F_BCDUSB, UsbQuery::COST_DEVICE, false, NULL },
+	{ "bcdDevice", F_BCDDEVICE, UsbQuery::COST_DEVICE, false, NULL },
+	{ "dclass", F_DCLASS, UsbQuery::COST_DEVICE, false, NULL },
+	{ "bDeviceClass", F_DCLASS, UsbQuery::COST_DEVICE, false, NULL },
+	{ "dsubclass", F_DSUBCLASS, UsbQuery::COST_DEVICE, false, NULL },
+	{ "bDeviceSubClass", F_DSUBCLASS, UsbQuery::COST_DEVICE, false, NULL },
+	{ "dprotocol", F_DPROTOCOL, UsbQuery::COST_DEVICE, false, NULL },
+	{ "bDeviceProtocol", F_DPROTOCOL, UsbQuery::COST_DEVICE, false, NULL },
+	{ "vendor", F_VENDOR, UsbQuery::COST_DEVICE, true, NULL },
+	{ "name", F_NAME, UsbQuery::COST_DEVICE, true, NULL },
+	{ "MaxPower", F_MAXPOWER, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "config", F_CONFIG, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bConfigurationValue", F_CONFIG, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "class", F_CLASS, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bInterfaceClass", F_CLASS, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "subclass", F_SUBCLASS, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bInterfaceSubClass", F_SUBCLASS, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "protocol", F_PROTOCOL, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bInterfaceProtocol", F_PROTOCOL, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "interface", F_INTERFACE, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bInterfaceNumber", F_INTERFACE, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "alt", F_ALT, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bAlternateSetting", F_ALT, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "numep", F_NUMEP, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bNumEndpoints", F_NUMEP, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "ep", F_EP, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "bEndpointAddress", F_EP, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "type", F_TYPE, UsbQuery::COST_DESCRIPTORS, false, type_symbols },
+	{ "dir", F_DIR, UsbQuery::COST_DESCRIPTORS, false, dir_symbols },
+	{ "bInterval", F_INTERVAL, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "maxp", F_MAXP, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "wMaxPacketSize", F_MAXP, UsbQuery::COST_DESCRIPTORS, false, NULL },
+	{ "serial", F_SERIAL, UsbQuery::COST_REQUESTS, true, NULL },
+	{ "manufacturer", F_MANUFACTURER, UsbQuery::COST_REQUESTS, true, NULL },
+	{ "product", F_PRODUCT, UsbQuery::COST_REQUESTS, true, NULL },
+	{ NULL, F_VID, UsbQuery::COST_DEVICE, false, NULL }
+};
+
+static string lower(const string &text)
+{
+	string s = text;
+
+	for (size_t i = 0; i < s.size(); i++)
+		s[i] = tolower((unsigned char)s[i]);
+	return s;
+}
+
+static bool is_word(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '+';
+}
+
+void UsbQuery::skip_space()
+{
+	while (isspace((unsigned char)*pos_))
+		pos_++;
+}
+
+bool UsbQuery::accept(const char *token)
+{
+	size_t len = strlen(token);
+
+	skip_space();
+	if (strncmp(pos_, token, len))
+		return false;
+	pos_ += len;
+	return true;
+}
+
+bool UsbQuery::parse_or()
+{
+	if (!parse_and())
+		return false;
+	while (accept("||")) {
+		Op op = { OP_OR, 0, CMP_EQ, 0, "" };
+
+		if (!parse_and())
+			return false;
+		program_.push_back(op);
+	}
+	return true;
+}
+
+bool UsbQuery::parse_and()
+{
+	if (!parse_unary())
+		return false;
+	while (accept("&&")) {
+		Op op = { OP_AND, 0, CMP_EQ, 0, "" };
+
+		if (!parse_unary())
+			return false;
+		program_.push_back(op);
+	}
+	return true;
+}
+
+bool UsbQuery::parse_unary()
+{
+	if (accept("!")) {
+		Op op = { OP_NOT, 0, CMP_EQ, 0, "" };
+
+		if (!parse_unary())
+			return false;
+		program_.push_back(op);
+		return true;
+	}
+	if (accept("(")) {
+		if (!parse_or())
+			return false;
+		if (!accept(")")) {
+			error_ = "missing )";
+			return false;
+		}
+		return true;
+	}
+	return parse_cmp();
+}
+
+bool UsbQuery::parse_cmp()
+{
+	static const struct {
+		const char *text;
+		CmpOp cmp;
+	} cmps[] = {
+		{ "==", CMP_EQ }, { "!=", CMP_NE }, { "<=", CMP_LE },
+		{ ">=", CMP_GE }, { "<", CMP_LT }, { ">", CMP_GT },
+		{ "~", CMP_CONTAINS }, { "=", CMP_EQ },
+	};
+	const QueryField *field;
+	const char *start;
+	string name, value;
+	Op op = { OP_CMP, 0, CMP_EQ, 0, "" };
+	unsigned int i;
+
+	skip_space();
+	for (start = pos_; is_word(*pos_); pos_++)
+		;
+	name.assign(start, pos_ - start);
+	if (name.empty()) {
+		error_ = *pos_ ? string("unexpected ") + *pos_ : "missing field";
+		return false;
+	}
+	for (field = query_fields; field->name; field++) {
+		if (!strcasecmp(field->name, name.c_str()))
+			break;
+	}
+	if (!field->name) {
+		error_ = "unknown field " + name;
+		return false;
+	}
+
+	for (i = 0; i < sizeof(cmps) / sizeof(cmps[0]); i++) {
+		if (accept(cmps[i].text))
+			break;
+	}
+	if (i == sizeof(cmps) / sizeof(cmps[0])) {
+		error_ = "missing comparison after " + name;
+		return false;
+	}
+	op.cmp = cmps[i].cmp;
+	if ((op.cmp == CMP_CONTAINS) != field->text
+			&& !(field->text && (op.cmp == CMP_EQ || op.cmp == CMP_NE))) {
+		error_ = field->text ? name + " only compares with ==, != and ~"
+			: "~ only applies to text fields";
+		return false;
+	}
+
+	skip_space();
+	if (*pos_ == '"') {
+		for (start = ++pos_; *pos_ && *pos_ != '"'; pos_++)
+			;
+		if (!*pos_) {
+			error_ = "missing \"";
+			return false;
+		}
+		value.assign(start, pos_++ - start);
+	} else {
+		for (start = pos_; is_word(*pos_); pos_++)
+			;
+		value.assign(start, pos_ - start);
+	}
+	if (value.empty()) {
+		error_ = "missing value for " + name;
+		return false;
+	}
+
+	op.field = field->id;
+	if (field->text) {
+		op.text = lower(value);
+	} else {
+		const QuerySymbol *sym = field->symbols;
+		char *end;
+
+		while (sym && sym->name && strcasecmp(sym->name, value.c_str()))
+			sym++;
+		if (sym && sym->name) {
+			op.number = sym->value;
+		} else {
+			op.number = strtoll(value.c_str(), &end, 0);
+			if (*end) {
+				error_ = "bad value " + value + " for " + name;
+				return false;
+			}
+		}
+	}
+
+	if (field->cost > cost_)
+		cost_ = field->cost;
+	program_.push_back(op);
+	return true;
+}
+
+bool UsbQuery::Compile(const string &text, string &error)
+{
+	program_.clear();
+	cost_ = COST_DEVICE;
+	error_.clear();
+	pos_ = text.c_str();
+
+	skip_space();
+	if (!*pos_)
+		return true;
+
+	if (parse_or()) {
+		skip_space();
+		if (!*pos_)
+			return true;
+		error_ = string("unexpected ") + pos_;
+	}
+
+	error = error_;
+	program_.clear();
+	return false;
+}
+
+UsbQuery::Value UsbQuery::compare(const Op &op, const Scope &scope)
+{
+	const QueryField *field = query_fields;
+	const struct libusb_device_descriptor &desc = scope.dev->getDescriptor();
+	int64_t n = 0;
+	string s;
+	bool present = true;
+
+	while (field->id != op.field)
+		field++;
+	if (field->cost > scope.cost)
+		return Q_UNKNOWN;
+
+	switch (op.field) {
+	case F_VID:		n = desc.idVendor; break;
+	case F_PID:		n = desc.idProduct; break;
+	case F_BUS:		n = scope.dev->getBusNumber(); break;
+	case F_ADDR:		n = scope.dev->getDeviceAddr(); break;
+	case F_SPEED:		n = scope.dev->getSpeed(); break;
+	case F_BCDUSB:		n = desc.bcdUSB; break;
+	case F_BCDDEVICE:	n = desc.bcdDevice; break;
+	case F_DCLASS:		n = desc.bDeviceClass; break;
+	case F_DSUBCLASS:	n = desc.bDeviceSubClass; break;
+	case F_DPROTOCOL:	n = desc.bDeviceProtocol; break;
+	case F_VENDOR:		s = scope.dev->getVendorName(); break;
+	case F_NAME:		s = scope.dev->getProductName(); break;
+	case F_SERIAL:		s = scope.dev->getString(desc.iSerialNumber); break;
+	case F_MANUFACTURER:	s = scope.dev->getString(desc.iManufacturer); break;
+	case F_PRODUCT:		s = scope.dev->getString(desc.iProduct); break;
+	case F_MAXPOWER:
+	case F_CONFIG:
+		present = scope.config;
+		if (!present)
+			break;
+		n = op.field == F_CONFIG ? scope.config->bConfigurationValue
+			: scope.config->MaxPower * (desc.bcdUSB >= 0x0300 ? 8 : 2);
+		break;
+	case F_CLASS:
+		/* devices without interfaces still have a class */
+		n = scope.alt ? scope.alt->bInterfaceClass : desc.bDeviceClass;
+		break;
+	case F_SUBCLASS:
+	case F_PROTOCOL:
+	case F_INTERFACE:
+	case F_ALT:
+	case F_NUMEP:
+		present = scope.alt;
+		if (!present)
+			break;
+		n = op.field == F_SUBCLASS ? scope.alt->bInterfaceSubClass
+			: op.field == F_PROTOCOL ? scope.alt->bInterfaceProtocol
+			: op.field == F_INTERFACE ? scope.alt->bInterfaceNumber
+			: op.field == F_ALT ? scope.alt->bAlternateSetting
+			: scope.alt->bNumEndpoints;
+		break;
+	default:
+		present = scope.ep;
+		if (!present)
+			break;
+		n = op.field == F_EP ? scope.ep->bEndpointAddress
+			: op.field == F_TYPE ? scope.ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK
+			: op.field == F_DIR ? !!(scope.ep->bEndpointAddress & LIBUSB_ENDPOINT_IN)
+			: op.field == F_INTERVAL ? scope.ep->bInterval
+			: scope.ep->wMaxPacketSize & 0x7ff;
+		break;
+	}
+
+	/* an endpoint condition does not hold where there is no endpoint */
+	if (!present)
+		return Q_FALSE;
+
+	if (field->text) {
+		bool found = op.cmp == CMP_CONTAINS ? lower(s).find(op.text) != string::npos
+			: lower(s) == op.text;
+
+		return (found != (op.cmp == CMP_NE)) ? Q_TRUE : Q_FALSE;
+	}
+
+	switch (op.cmp) {
+	case CMP_EQ: return n == op.number ? Q_TRUE : Q_FALSE;
+	case CMP_NE: return n != op.number ? Q_TRUE : Q_FALSE;
+	case CMP_LT: return n < op.number ? Q_TRUE : Q_FALSE;
+	case CMP_LE: return n <= op.number ? Q_TRUE : Q_FALSE;
+	case CMP_GT: return n > op.number ? Q_TRUE : Q_FALSE;
+	case CMP_GE: return n >= op.number ? Q_TRUE : Q_FALSE;
+	default: return Q_FALSE;
+	}
+}
+
+/* Kleene logic: an unknown operand only matters if the other one can't decide */
+UsbQuery::Value UsbQuery::run(const Scope &scope)
+{
+	vector<Value> stack;
+
+	for (unsigned int i = 0; i < program_.size(); i++) {
+		const Op &op = program_[i];
+		Value a, b;
+
+		switch (op.code) {
+		case OP_CMP:
+			stack.push_back(compare(op, scope));
+			break;
+		case OP_NOT:
+			a = stack.back();
+			stack.back() = a == Q_UNKNOWN ? Q_UNKNOWN
+				: a == Q_TRUE ? Q_FALSE : Q_TRUE;
+			break;
+		case OP_AND:
+			b = stack.back();
+			stack.pop_back();
+			a = stack.back();
+			stack.back() = (a == Q_FALSE || b == Q_FALSE) ? Q_FALSE
+				: (a == Q_TRUE && b == Q_TRUE) ? Q_TRUE : Q_UNKNOWN;
+			break;
+		case OP_OR:
+			b = stack.back();
+			stack.pop_back();
+			a = stack.back();
+			stack.back() = (a == Q_TRUE || b == Q_TRUE) ? Q_TRUE
+				: (a == Q_FALSE && b == Q_FALSE) ? Q_FALSE : Q_UNKNOWN;
+			break;
+		}
+	}
+
+	return stack.empty() ? Q_TRUE : stack.back();
+}
+
+/*
+ * Runs the program on every endpoint of the active configuration (and
+ * on every altsetting without endpoints): true if it holds on one,
+ * false if it fails on all.
+ */
+UsbQuery::Value UsbQuery::run_descriptors(UsbDevice &dev, Cost cost)
+{
+	struct libusb_config_descriptor *config = NULL;
+	Scope scope = { &dev, NULL, NULL, NULL, cost };
+	Value result = Q_FALSE, v;
+
+	if (dev.getLibusbDevice())
+		libusb_get_active_config_descriptor(dev.getLibusbDevice(), &config);
+	scope.config = config;
+
+	if (!config || !config->bNumInterfaces)
+		result = run(scope);
+
+	for (int i = 0; config && i < config->bNumInterfaces
+			&& result != Q_TRUE; i++) {
+		const struct libusb_interface *intf = &config->interface[i];
+
+		for (int j = 0; j < intf->num_altsetting && result != Q_TRUE; j++) {
+			scope.alt = &intf->altsetting[j];
+			scope.ep = NULL;
+			for (int k = 0; k < scope.alt->bNumEndpoints || k == 0; k++) {
+				if (scope.alt->bNumEndpoints)
+					scope.ep = &scope.alt->endpoint[k];
+				v = run(scope);
+				if (v == Q_TRUE || (v == Q_UNKNOWN && result == Q_FALSE))
+					result = v;
+				if (result == Q_TRUE)
+					break;
+			}
+		}
+	}
+
+	if (config)
+		libusb_free_config_descriptor(config);
+	return result;
+}
+
+bool UsbQuery::Match(UsbDevice &dev)
+{
+	Scope scope = { &dev, NULL, NULL, NULL, COST_DEVICE };
+	Value v;
+
+	v = run(scope);
+	if (v != Q_UNKNOWN)
+		return v == Q_TRUE;
+
+	v = run_descriptors(dev, COST_DESCRIPTORS);
+	if (v != Q_UNKNOWN || cost_ < COST_REQUESTS)
+		return v == Q_TRUE;
+
+	return run_descriptors(dev, COST_REQUESTS) == Q_TRUE;
+}
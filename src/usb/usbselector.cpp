@@ -0,0 +1,105 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbselector.h"
+#include "usbmisc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+/* a hex or decimal number up to max, or -1 for an empty field */
+static bool parse_number(const char *s, const char *end, int base,
+		unsigned long max, int *value)
+{
+	char *p;
+	unsigned long n;
+
+	if (s == end) {
+		*value = -1;
+		return true;
+	}
+	n = strtoul(s, &p, base);
+	if (p != end || n > max)
+		return false;
+	*value = n;
+	return true;
+}
+
+bool UsbSelector::Parse(char option, const char *arg)
+{
+	const char *colon = strchr(arg, ':');
+	const char *end = arg + strlen(arg);
+	unsigned int bnum, dnum;
+
+	switch (option) {
+	case 'd':
+		/* vid:pid, vid: or :pid, in hex */
+		if (!colon)
+			return false;
+		return parse_number(arg, colon, 16, 0xffff, &vendor_)
+			&& parse_number(colon + 1, end, 16, 0xffff, &product_);
+	case 's':
+		/* [[bus]:][dev], in decimal */
+		if (!colon)
+			return parse_number(arg, end, 10, 127, &device_);
+		return parse_number(arg, colon, 10, 255, &bus_)
+			&& parse_number(colon + 1, end, 10, 127, &device_);
+	case 'D':
+		if (get_usbfs_busdev(arg, &bnum, &dnum) < 0)
+			return false;
+		bus_ = bnum;
+		device_ = dnum;
+		return true;
+	case 'p':
+		/* "1-2.3", or the sysfs path of the device */
+		if (strrchr(arg, '/'))
+			arg = strrchr(arg, '/') + 1;
+		if (!*arg)
+			return false;
+		devpath_ = arg;
+		return true;
+	}
+	return false;
+}
+
+bool UsbSelector::Match(libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+	char name[32];
+
+	if (bus_ >= 0 && libusb_get_bus_number(dev) != bus_)
+		return false;
+	if (device_ >= 0 && libusb_get_device_address(dev) != device_)
+		return false;
+	if (!devpath_.empty()) {
+		get_sysfs_name(name, sizeof(name), dev);
+		if (devpath_ != name)
+			return false;
+	}
+	if (vendor_ >= 0 || product_ >= 0) {
+		/* cached by libusb at enumeration, no request is sent */
+		if (libusb_get_device_descriptor(dev, &desc) < 0)
+			return false;
+		if (vendor_ >= 0 && desc.idVendor != vendor_)
+			return false;
+		if (product_ >= 0 && desc.idProduct != product_)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,716 @@
+/*
+    Copyright (C) 2018  Gilles Talis
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "usbsnapshot.h"
+#include "usbcontext.h"
+#include "usbmisc.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+#define SNAPSHOT_MAGIC		"NLSUSBSNAP 1"
+
+/* the log separators can't appear in names and serial numbers */
+static string clean(const string &s)
+{
+	string out = s;
+
+	for (size_t i = 0; i < out.size(); i++) {
+		if (out[i] == '\t' || out[i] == '\n' || out[i] == '|')
+			out[i] = ' ';
+	}
+	return out;
+}
+
+static void split(const string &s, char sep, vector<string> &fields)
+{
+	size_t start = 0, end;
+
+	while ((end = s.find(sep, start)) != string::npos) {
+		fields.push_back(s.substr(start, end - start));
+		start = end + 1;
+	}
+	fields.push_back(s.substr(start));
+}
+
+static bool path_cmp(const SnapshotDevice &a, const SnapshotDevice &b)
+{
+	return a.path < b.path;
+}
+
+bool SnapshotDevice::operator==(const SnapshotDevice &o) const
+{
+	return path == o.path && bus == o.bus && addr == o.addr
+		&& vid == o.vid && pid == o.pid && bcd_usb == o.bcd_usb
+		&& bcd_device == o.bcd_device && speed == o.speed
+		&& config == o.config && altsettings == o.altsettings
+		&& ports == o.ports && serial == o.serial
+		&& vendor == o.vendor && product == o.product;
+}
+
+string SnapshotDevice::Encode() const
+{
+	char buf[128];
+	string alts, states;
+
+	for (unsigned int i = 0; i < altsettings.size(); i++) {
+		snprintf(buf, sizeof(buf), "%s%d=%d", i ? "," : "",
+				altsettings[i].first, altsettings[i].second);
+		alts += buf;
+	}
+	for (unsigned int i = 0; i < ports.size(); i++)
+		states += (i ? "|" : "") + clean(ports[i]);
+
+	snprintf(buf, sizeof(buf), "\t%d\t%d\t%04x\t%04x\t%04x\t%04x\t%d\t%d\t",
+			bus, addr, vid, pid, bcd_usb, bcd_device, speed, config);
+	return clean(path) + buf + alts + "\t" + states + "\t" + clean(serial)
+		+ "\t" + clean(vendor) + "\t" + clean(product);
+}
+
+bool SnapshotDevice::Decode(const string &line)
+{
+	vector<string> f, items;
+
+	split(line, '\t', f);
+	if (f.size() != 14 || f[0].empty())
+		return false;
+
+	path = f[0];
+	bus = atoi(f[1].c_str());
+	addr = atoi(f[2].c_str());
+	vid = strtoul(f[3].c_str(), NULL, 16);
+	pid = strtoul(f[4].c_str(), NULL, 16);
+	bcd_usb = strtoul(f[5].c_str(), NULL, 16);
+	bcd_device = strtoul(f[6].c_str(), NULL, 16);
+	speed = atoi(f[7].c_str());
+	config = atoi(f[8].c_str());
+
+	altsettings.clear();
+	if (!f[9].empty()) {
+		split(f[9], ',', items);
+		for (unsigned int i = 0; i < items.size(); i++) {
+			int intf, alt;
+
+			if (sscanf(items[i].c_str(), "%d=%d", &intf, &alt) == 2)
+				altsettings.push_back(make_pair(intf, alt));
+		}
+	}
+	ports.clear();
+	if (!f[10].empty())
+		split(f[10], '|', ports);
+
+	serial = f[11];
+	vendor = f[12];
+	product = f[13];
+	return true;
+}
+
+/*
+ * Everything but the serial number comes from enumeration and sysfs;
+ * the serial is read once per device and then kept by the descriptor
+ * cache.
+ */
+void Snapshot::Capture(UsbContext &ctx, Snapshot &snap)
+{
+	char state[64];
+
+	snap.time = ::time(NULL);
+	snap.devices.clear();
+
+	for (unsigned int i = 0; i < ctx.getUsbDevicesCount(); i++) {
+		UsbDevice &dev = ctx.getUsbDevice(i);
+		const struct libusb_device_descriptor &desc = dev.getDescriptor();
+		SnapshotDevice d;
+
+		d.path = dev.getSysfsName();
+		d.bus = dev.getBusNumber();
+		d.addr = dev.getDeviceAddr();
+		d.vid = desc.idVendor;
+		d.pid = desc.idProduct;
+		d.bcd_usb = desc.bcdUSB;
+		d.bcd_device = desc.bcdDevice;
+		d.speed = dev.getSpeed();
+		d.config = dev.getActiveConfig();
+		dev.getCurrentAltsettings(d.altsettings);
+		if (dev.isHub()) {
+			for (int port = 1; port <= SYSFS_MAX_PORTS; port++) {
+				if (read_sysfs_port_prop(state, sizeof(state),
+						d.path.c_str(), port, "state") <= 0)
+					break;
+				d.ports.push_back(state);
+			}
+		}
+		d.serial = dev.getString(desc.iSerialNumber);
+		d.vendor = dev.getVendorName();
+		d.product = dev.getProductName();
+		snap.devices.push_back(d);
+	}
+
+	sort(snap.devices.begin(), snap.devices.end(), path_cmp);
+}
+
+bool Snapshot::ParseTime(const string &text, int64_t &time)
+{
+	struct tm tm;
+	const char *end;
+
+	memset(&tm, 0, sizeof(tm));
+	end = strptime(text.c_str(), "%Y-%m-%d %H:%M", &tm);
+	if (end && *end == ':')
+		end = strptime(end, ":%S", &tm);
+	if (!end || *end)
+		return false;
+	tm.tm_isdst = -1;
+	time = mktime(&tm);
+	return true;
+}
+
+static string device_name(const SnapshotDevice &d)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), " %04x:%04x", d.vid, d.pid);
+	return d.path + buf + (d.product.empty() ? "" : " " + d.product);
+}
+
+static string bcd(uint16_t value)
+{
+	char buf[16];
+
+	snprintf(buf, sizeof(buf), "%x.%02x", value >> 8, value & 0xff);
+	return buf;
+}
+
+static void diff_device(const SnapshotDevice &a, const SnapshotDevice &b,
+		vector<string> &out)
+{
+	string name = "~ " + device_name(b) + ": ";
+	char buf[128];
+	unsigned int i, j;
+
+	if (a.path != b.path)
+		out.push_back(name + "moved from " + a.path);
+	if (a.vid != b.vid || a.pid != b.pid) {
+		snprintf(buf, sizeof(buf), "ID %04x:%04x -> %04x:%04x",
+				a.vid, a.pid, b.vid, b.pid);
+		out.push_back(name + buf);
+	}
+	if (a.speed != b.speed)
+		out.push_back(name + "speed " + UsbDevice::getSpeedName(a.speed)
+				+ " -> " + UsbDevice::getSpeedName(b.speed));
+	if (a.bcd_usb != b.bcd_usb)
+		out.push_back(name + "bcdUSB " + bcd(a.bcd_usb) + " -> "
+				+ bcd(b.bcd_usb));
+	if (a.bcd_device != b.bcd_device)
+		out.push_back(name + "bcdDevice " + bcd(a.bcd_device) + " -> "
+				+ bcd(b.bcd_device));
+	if (a.config != b.config) {
+		snprintf(buf, sizeof(buf), "configuration %d -> %d",
+				a.config, b.config);
+		out.push_back(name + buf);
+	}
+
+	/* altsettings are sorted by interface number */
+	for (i = 0, j = 0; i < a.altsettings.size() || j < b.altsettings.size(); ) {
+		if (j == b.altsettings.size() || (i < a.altsettings.size()
+				&& a.altsettings[i].first < b.altsettings[j].first)) {
+			snprintf(buf, sizeof(buf), "interface %d removed",
+					a.altsettings[i++].first);
+		} else if (i == a.altsettings.size()
+				|| b.altsettings[j].first < a.altsettings[i].first) {
+			snprintf(buf, sizeof(buf), "interface %d added, alt %d",
+					b.altsettings[j].first, b.altsettings[j].second);
+			j++;
+		} else {
+			buf[0] = '\0';
+			if (a.altsettings[i].second != b.altsettings[j].second)
+				snprintf(buf, sizeof(buf), "interface %d alt %d -> %d",
+						a.altsettings[i].first,
+						a.altsettings[i].second,
+						b.altsettings[j].second);
+			i++;
+			j++;
+		}
+		if (buf[0])
+			out.push_back(name + buf);
+	}
+
+	for (i = 0; i < a.ports.size() || i < b.ports.size(); i++) {
+		string from = i < a.ports.size() ? a.ports[i] : "absent";
+		string to = i < b.ports.size() ? b.ports[i] : "absent";
+
+		if (from == to)
+			continue;
+		snprintf(buf, sizeof(buf), "port %u ", i + 1);
+		out.push_back(name + buf + from + " -> " + to);
+	}
+}
+
+/*
+ * One pass over each side: the devices of b are hashed by path and
+ * serial, then each device of a looks up its counterpart.
+ */
+int Snapshot::Diff(const Snapshot &a, const Snapshot &b, vector<string> &out)
+{
+	unordered_map<string, unsigned int> paths, serials_a, serials_b;
+	vector<int> match(a.devices.size(), -1);
+	vector<bool> matched(b.devices.size(), false);
+	size_t count = out.size();
+
+	for (unsigned int j = 0; j < b.devices.size(); j++) {
+		paths[b.devices[j].path] = j;
+		if (!b.devices[j].serial.empty())
+			serials_b[b.devices[j].serial]++;
+	}
+	for (unsigned int i = 0; i < a.devices.size(); i++) {
+		if (!a.devices[i].serial.empty())
+			serials_a[a.devices[i].serial]++;
+	}
+
+	/* same path, unless the serials say it is another device */
+	for (unsigned int i = 0; i < a.devices.size(); i++) {
+		const SnapshotDevice &d = a.devices[i];
+		unordered_map<string, unsigned int>::iterator it;
+
+		it = paths.find(d.path);
+		if (it == paths.end() || matched[it->second])
+			continue;
+		if (!d.serial.empty() && !b.devices[it->second].serial.empty()
+				&& d.serial != b.devices[it->second].serial)
+			continue;
+		match[i] = it->second;
+		matched[it->second] = true;
+	}
+
+	/*
+	 * Then a device moved to another port, when its serial tells it
+	 * apart: identical serials (all zeroes, or none at all behind a
+	 * string) are common.
+	 */
+	for (unsigned int j = 0; j < b.devices.size(); j++) {
+		const string &serial = b.devices[j].serial;
+
+		if (matched[j] || serial.empty() || serials_b[serial] != 1
+				|| serials_a[serial] != 1)
+			continue;
+		for (unsigned int i = 0; i < a.devices.size(); i++) {
+			if (a.devices[i].serial != serial)
+				continue;
+			if (match[i] < 0) {
+				match[i] = j;
+				matched[j] = true;
+			}
+			break;
+		}
+	}
+
+	for (unsigned int i = 0; i < a.devices.size(); i++) {
+		if (match[i] < 0)
+			out.push_back("- " + device_name(a.devices[i]));
+		else
+			diff_device(a.devices[i], b.devices[match[i]], out);
+	}
+
+	for (unsigned int j = 0; j < b.devices.size(); j++) {
+		if (!matched[j])
+			out.push_back("+ " + device_name(b.devices[j]));
+	}
+
+	return out.size() - count;
+}
+
+int Snapshot::Find(const string &path) const
+{
+	SnapshotDevice key;
+	vector<SnapshotDevice>::const_iterator it;
+
+	key.path = path;
+	it = lower_bound(devices.begin(), devices.end(), key, path_cmp);
+	if (it == devices.end() || it->path != path)
+		return -1;
+	return it - devices.begin();
+}
+
+void Snapshot::getList(vector<string> &list) const
+{
+	char line[128];
+
+	for (unsigned int i = 0; i < devices.size(); i++) {
+		const SnapshotDevice &d = devices[i];
+
+		snprintf(line, 128, "%-12s ID %04x:%04x %-5s %s %s",
+				d.path.c_str(), d.vid, d.pid,
+				UsbDevice::getSpeedName(d.speed),
+				d.vendor.c_str(), d.product.c_str());
+		list.push_back(line);
+	}
+}
+
+void Snapshot::getDetails(unsigned int index, vector<string> &info) const
+{
+	const SnapshotDevice &d = devices[index];
+	char line[128];
+
+	snprintf(line, 128, "Device %s: Bus %03d Device %03d", d.path.c_str(),
+			d.bus, d.addr);
+	info.push_back(line);
+	snprintf(line, 128, "  ID %04x:%04x %s %s", d.vid, d.pid,
+			d.vendor.c_str(), d.product.c_str());
+	info.push_back(line);
+	if (!d.serial.empty()) {
+		snprintf(line, 128, "  Serial: %s", d.serial.c_str());
+		info.push_back(line);
+	}
+	snprintf(line, 128, "  USB %x.%02x, bcdDevice %x.%02x, speed %s",
+			d.bcd_usb >> 8, d.bcd_usb & 0xff,
+			d.bcd_device >> 8, d.bcd_device & 0xff,
+			UsbDevice::getSpeedName(d.speed));
+	info.push_back(line);
+	snprintf(line, 128, "  Configuration %d", d.config);
+	info.push_back(line);
+	for (unsigned int i = 0; i < d.altsettings.size(); i++) {
+		snprintf(line, 128, "    Interface %d: alt %d",
+				d.altsettings[i].first, d.altsettings[i].second);
+		info.push_back(line);
+	}
+	if (!d.ports.empty()) {
+		info.push_back(" ");
+		info.push_back("Hub ports:");
+	}
+	for (unsigned int i = 0; i < d.ports.size(); i++) {
+		snprintf(line, 128, "  Port %u: %s", i + 1, d.ports[i].c_str());
+		info.push_back(line);
+	}
+}
+
+int SnapshotWriter::Open(const string &path)
+{
+	SnapshotReader reader;
+	long size, end = 0;
+
+	Close();
+	file_ = fopen(path.c_str(), "a");
+	if (!file_)
+		return -errno;
+	index_ = fopen((path + ".idx").c_str(), "a");
+	if (!index_) {
+		int r = -errno;
+
+		fclose(file_);
+		file_ = NULL;
+		return r;
+	}
+
+	fseek(file_, 0, SEEK_END);
+	size = ftell(file_);
+	if (size > 0) {
+		/* the next record would be read as the end of a torn one */
+		if (reader.Open(path) == 0) {
+			end = reader.getEnd();
+		} else if (size > (long)strlen(SNAPSHOT_MAGIC) + 1) {
+			/* not a log, or a damaged one: leave it alone */
+			Close();
+			return -EINVAL;
+		}
+		if (end < size && ftruncate(fileno(file_), end) < 0) {
+			int r = -errno;
+
+			Close();
+			return r;
+		}
+		/* Append() takes the keyframe offsets from there */
+		fseek(file_, 0, SEEK_END);
+	}
+	if (end == 0) {
+		fprintf(file_, "%s\n", SNAPSHOT_MAGIC);
+		fflush(file_);
+	}
+
+	/* what is in the log is not known: start with a keyframe */
+	has_last_ = false;
+	return 0;
+}
+
+void SnapshotWriter::Close()
+{
+	if (file_)
+		fclose(file_);
+	if (index_)
+		fclose(index_);
+	file_ = NULL;
+	index_ = NULL;
+}
+
+int SnapshotWriter::Append(const Snapshot &snap)
+{
+	vector<const SnapshotDevice *> changed;
+	vector<string> removed;
+	unsigned int i = 0, j = 0;
+	long offset;
+
+	if (!file_)
+		return -EBADF;
+
+	offset = ftell(file_);
+	if (!has_last_ || snap.time - key_time_ >= SNAPSHOT_KEYFRAME_SECS
+			|| deltas_ >= SNAPSHOT_KEYFRAME_DELTAS) {
+		fprintf(file_, "K %lld %u\n", (long long)snap.time,
+				(unsigned int)snap.devices.size());
+		for (i = 0; i < snap.devices.size(); i++)
+			fprintf(file_, "%s\n", snap.devices[i].Encode().c_str());
+		fflush(file_);
+		/* indexed once the keyframe is complete in the log */
+		fprintf(index_, "%lld %ld\n", (long long)snap.time, offset);
+		fflush(index_);
+
+		key_time_ = snap.time;
+		deltas_ = 0;
+		last_ = snap;
+		has_last_ = true;
+		return 1;
+	}
+
+	/* both lists are sorted by path */
+	while (i < snap.devices.size() || j < last_.devices.size()) {
+		if (j == last_.devices.size() || (i < snap.devices.size()
+				&& snap.devices[i].path < last_.devices[j].path)) {
+			changed.push_back(&snap.devices[i++]);
+		} else if (i == snap.devices.size()
+				|| last_.devices[j].path < snap.devices[i].path) {
+			removed.push_back(last_.devices[j++].path);
+		} else {
+			if (snap.devices[i] != last_.devices[j])
+				changed.push_back(&snap.devices[i]);
+			i++;
+			j++;
+		}
+	}
+	if (changed.empty() && removed.empty())
+		return 0;
+
+	fprintf(file_, "D %lld %u %u\n", (long long)snap.time,
+			(unsigned int)changed.size(), (unsigned int)removed.size());
+	for (i = 0; i < changed.size(); i++)
+		fprintf(file_, "%s\n", changed[i]->Encode().c_str());
+	for (i = 0; i < removed.size(); i++)
+		fprintf(file_, "%s\n", removed[i].c_str());
+	fflush(file_);
+
+	deltas_++;
+	last_ = snap;
+	return 1;
+}
+
+bool SnapshotReader::read_line(string &line)
+{
+	char buf[512];
+	size_t len;
+
+	line.clear();
+	while (fgets(buf, sizeof(buf), file_)) {
+		len = strlen(buf);
+		if (len && buf[len - 1] == '\n') {
+			line.append(buf, len - 1);
+			return true;
+		}
+		line += buf;
+	}
+	/* a record cut by a crash is ignored */
+	return false;
+}
+
+bool SnapshotReader::read_header(Header &h)
+{
+	string line;
+	long long t;
+
+	h.changed = h.removed = 0;
+	if (!read_line(line))
+		return false;
+	if (sscanf(line.c_str(), "K %lld %u", &t, &h.changed) == 2)
+		h.type = 'K';
+	else if (sscanf(line.c_str(), "D %lld %u %u", &t, &h.changed, &h.removed) == 3)
+		h.type = 'D';
+	else
+		return false;
+	h.time = t;
+	return true;
+}
+
+bool SnapshotReader::apply(const Header &h, Snapshot &snap)
+{
+	string line;
+	SnapshotDevice d;
+	int i;
+
+	if (h.type == 'K')
+		snap.devices.clear();
+	for (unsigned int n = 0; n < h.changed; n++) {
+		if (!read_line(line) || !d.Decode(line))
+			return false;
+		i = snap.Find(d.path);
+		if (i >= 0)
+			snap.devices[i] = d;
+		else
+			snap.devices.insert(lower_bound(snap.devices.begin(),
+					snap.devices.end(), d, path_cmp), d);
+	}
+	for (unsigned int n = 0; n < h.removed; n++) {
+		if (!read_line(line))
+			return false;
+		i = snap.Find(line);
+		if (i >= 0)
+			snap.devices.erase(snap.devices.begin() + i);
+	}
+	snap.time = h.time;
+	return true;
+}
+
+/*
+ * Reads the records from offset on, adding the keyframes the index
+ * missed (the writer was stopped in between) and noting the last time.
+ */
+void SnapshotReader::scan(long from)
+{
+	Snapshot snap;
+	Header h;
+	long offset;
+
+	fseek(file_, from, SEEK_SET);
+	end_ = from;
+	for (;;) {
+		offset = ftell(file_);
+		if (!read_header(h))
+			break;
+		if (h.type == 'K' && (keys_.empty() || offset > keys_.back().offset)) {
+			Keyframe k = { h.time, offset };
+
+			keys_.push_back(k);
+		}
+		if (!apply(h, snap))
+			break;
+		last_time_ = h.time;
+		end_ = ftell(file_);
+	}
+}
+
+int SnapshotReader::Open(const string &path)
+{
+	FILE *index;
+	string magic;
+	long long t;
+	long offset, size;
+
+	Close();
+	file_ = fopen(path.c_str(), "r");
+	if (!file_)
+		return -errno;
+	if (!read_line(magic) || magic != SNAPSHOT_MAGIC) {
+		Close();
+		return -EINVAL;
+	}
+
+	fseek(file_, 0, SEEK_END);
+	size = ftell(file_);
+
+	index = fopen((path + ".idx").c_str(), "r");
+	while (index && fscanf(index, "%lld %ld", &t, &offset) == 2) {
+		Keyframe k = { t, offset };
+
+		/* the index of another log, or a truncated one */
+		if (offset >= size || (!keys_.empty() && offset <= keys_.back().offset))
+			break;
+		keys_.push_back(k);
+	}
+	if (index)
+		fclose(index);
+
+	/* only what follows the last indexed keyframe has to be read */
+	scan(keys_.empty() ? strlen(SNAPSHOT_MAGIC) + 1 : keys_.back().offset);
+	return 0;
+}
+
+void SnapshotReader::Close()
+{
+	if (file_)
+		fclose(file_);
+	file_ = NULL;
+	keys_.clear();
+	last_time_ = 0;
+	end_ = 0;
+}
+
+bool SnapshotReader::seek(int64_t time, Snapshot &snap, bool one_more)
+{
+	vector<Keyframe>::iterator k;
+	Snapshot s;
+	Header h;
+
+	if (keys_.empty() || time < keys_[0].time)
+		return false;
+
+	/* the last keyframe at or before time */
+	k = keys_.begin() + 1;
+	for (size_t n = keys_.size() - 1; n > 0; ) {
+		size_t half = n / 2;
+
+		if (k[half].time <= time) {
+			k += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+	--k;
+
+	fseek(file_, k->offset, SEEK_SET);
+	while (read_header(h)) {
+		if (h.time > time && !one_more)
+			break;
+		if (!apply(h, s))
+			break;
+		if (h.time > time)
+			break;
+	}
+	if (s.time == 0 || (one_more && s.time <= time))
+		return false;
+
+	snap = s;
+	return true;
+}
+
+bool SnapshotReader::Seek(int64_t time, Snapshot &snap)
+{
+	return seek(time, snap, false);
+}
+
+bool SnapshotReader::Next(Snapshot &snap)
+{
+	return seek(snap.time, snap, true);
+}
+
+bool SnapshotReader::Prev(Snapshot &snap)
+{
+	return snap.time > getFirstTime() && seek(snap.time - 1, snap, false);
+}